@@ -20,8 +20,10 @@ namespace bx3   = boost::spirit::x3;
 
 using baio_context      = boost::asio::io_context;
 using baio_ip_net4      = boost::asio::ip::network_v4;
+using baio_ip_net6      = boost::asio::ip::network_v6;
 using baio_ip_addr4     = boost::asio::ip::address_v4;
 using baio_ip_addr4_rng = boost::asio::ip::address_v4_range;
+using baio_ip_addr6     = boost::asio::ip::address_v6;
 using baio_tcp_acceptor = boost::asio::ip::tcp::acceptor;
 using baio_tcp_endpoint = boost::asio::ip::tcp::endpoint;
 using baio_tcp_socket   = boost::asio::ip::tcp::socket;
@@ -32,14 +32,18 @@ class application_impl
 
     [[no_unique_address]] dpdk_eal eal_;
 
-    mgmt::inc_messages_queue g2m_queue_;
-    mgmt::out_messages_queue m2g_queue_;
+    const app::priv::config::cpu_idxs cpus_;
+    // The count of the CPUs used by every generation worker
+    const uint32_t cpus_per_worker_;
+
+    // Every generation worker has its own pair of queues to the management
+    const uint32_t cnt_workers_;
+    std::unique_ptr<mgmt::inc_messages_queue[]> g2m_queues_;
+    std::unique_ptr<mgmt::out_messages_queue[]> m2g_queues_;
 
     gen::manager genr_;
     mgmt::manager mgmt_;
 
-    const std::array<uint16_t, 2> cpus_;
-
     static inline std::atomic_flag stop_flag_{};
 
 public:
@@ -55,15 +59,23 @@ private:
 
 application_impl::application_impl(const app::priv::config& cfg)
 : eal_(cfg)
-, genr_({.working_dir    = cfg.working_dir(),
-         .max_cnt_mbufs  = cfg.max_cnt_mbufs(),
-         .nic_queue_size = cfg.nic_queue_size(),
-         .inc_queue      = &m2g_queue_,
-         .out_queue      = &g2m_queue_})
-, mgmt_({.endpoint  = cfg.mgmt_endpoint(),
-         .inc_queue = &g2m_queue_,
-         .out_queue = &m2g_queue_})
 , cpus_(cfg.cpus())
+, cpus_per_worker_(cfg.tx_pipeline() ? 2 : 1)
+, cnt_workers_((cpus_.size() - 1) / cpus_per_worker_)
+, g2m_queues_(std::make_unique<mgmt::inc_messages_queue[]>(cnt_workers_))
+, m2g_queues_(std::make_unique<mgmt::out_messages_queue[]>(cnt_workers_))
+, genr_({.working_dir             = cfg.working_dir(),
+         .templates_cache_dir     = cfg.templates_cache_dir(),
+         .cnt_loader_threads      = cfg.cnt_loader_threads(),
+         .templates_library_share = cfg.templates_library_share(),
+         .max_cnt_mbufs           = cfg.max_cnt_mbufs(),
+         .nic_queue_size          = cfg.nic_queue_size(),
+         .tx_pipeline             = cfg.tx_pipeline(),
+         .inc_queues              = {m2g_queues_.get(), cnt_workers_},
+         .out_queues              = {g2m_queues_.get(), cnt_workers_}})
+, mgmt_({.endpoint   = cfg.mgmt_endpoint(),
+         .inc_queues = {g2m_queues_.get(), cnt_workers_},
+         .out_queues = {m2g_queues_.get(), cnt_workers_}})
 {
     auto sig_sub = [](auto... sig) {
         return ((::signal(sig, signal_handler) != SIG_ERR) && ...);
@@ -75,16 +87,25 @@ application_impl::application_impl(const app::priv::config& cfg)
 
 void application_impl::run() noexcept
 {
-    auto run_loop = [](auto& mgr) {
+    auto run_loop = [](auto&& process_events) {
         while (!stop_flag_.test(std::memory_order_seq_cst)) {
-            mgr.process_events();
+            process_events();
         }
     };
 
-    if (const auto lcore = rte_lcore_id(); lcore == cpus_[0]) {
-        run_loop(mgmt_);
-    } else if (lcore == cpus_[1]) {
-        run_loop(genr_);
+    const auto lcore = rte_lcore_id();
+    if (lcore == cpus_[0]) {
+        run_loop([this] { mgmt_.process_events(); });
+    } else if (auto it = std::find(cpus_.begin() + 1, cpus_.end(), lcore);
+               it != cpus_.end()) {
+        const uint32_t pos        = it - cpus_.begin() - 1;
+        const uint32_t worker_idx = pos / cpus_per_worker_;
+        if ((pos % cpus_per_worker_) == 0) {
+            run_loop([this, worker_idx] { genr_.process_events(worker_idx); });
+        } else {
+            run_loop(
+                [this, worker_idx] { genr_.process_tx_events(worker_idx); });
+        }
     } else {
         TG_UNREACHABLE();
     }
@@ -120,14 +141,19 @@ application_impl::dpdk_eal::dpdk_eal(const app::priv::config& cfg)
     };
 
     const auto& cpus = cfg.cpus();
-    TG_ENFORCE(cpus.size() == 2);
+    TG_ENFORCE(cpus.size() >= 2);
+    if (cfg.tx_pipeline() && ((cpus.size() % 2) == 0)) {
+        put::throw_runtime_error("The pipeline mode needs two CPUs per "
+                                 "generation worker. CPUs: {}",
+                                 fmt::join(cpus, ","));
+    }
     // The argc/argv must live throughout the application lifetime.
     // That's why the `args` is static and the memory for them too.
     static std::array<char, 1024> mem_buf;
     std::span<char> buf(mem_buf);
     static std::array args = {
         make_arg(buf, "xproxy"), make_arg(buf, "--no-telemetry"),
-        make_arg(buf, "-l {},{}", cpus[0], cpus[1]),
+        make_arg(buf, "-l {}", fmt::join(cpus, ",")),
         make_arg(buf, "-n {}", cfg.num_memory_channels())};
     if (rte_eal_init(args.size(), args.data()) < 0) {
         put::throw_dpdk_error(
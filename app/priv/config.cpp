@@ -44,11 +44,11 @@ void validate(boost::any& out,
             parts, s, [](char c) { return (c == ','); },
             balgo::token_compress_on);
         app::priv::config::cpu_idxs ret;
-        if (const auto cnt = ret.size(); parts.size() != cnt) {
-            put::throw_runtime_error("Expect {} cpus", cnt);
+        if (parts.size() < 2) {
+            put::throw_runtime_error("Expect at least 2 cpus");
         }
-        for (auto idx = 0uz; const auto& p : parts) {
-            ret[idx++] = put::str_to_int<uint16_t>(put::str_trim(p)).value();
+        for (const auto& p : parts) {
+            ret.push_back(put::str_to_int<uint16_t>(put::str_trim(p)).value());
         }
         out = std::move(ret);
     } catch (...) {
@@ -94,6 +94,11 @@ config::config(const stdfs::path& config_path)
             }
         });
         if (!err.empty()) throw std::runtime_error(err);
+        // The templates are loaded only by the loader threads
+        if (tmp.cnt_loader_threads_ == 0) {
+            put::throw_runtime_error(
+                "Config option 'cnt_loader_threads' must be at least 1.");
+        }
 
         opts_ = std::move(tmp);
     } catch (const std::exception& ex) {
@@ -5,12 +5,16 @@ namespace app::priv
 // boost::container::vector is used instead of std::vector because the
 // boost::program_options library provides special treatment for std::vector
 // which is not applicable to our usage.
-#define TGN_CONFIG_SETTINGS(MACRO)          \
-    MACRO(stdfs::path, working_dir)         \
-    MACRO(baio_tcp_endpoint, mgmt_endpoint) \
-    MACRO(cpu_idxs, cpus)                   \
-    MACRO(uint32_t, max_cnt_mbufs)          \
-    MACRO(uint16_t, num_memory_channels)    \
+#define TGN_CONFIG_SETTINGS(MACRO)           \
+    MACRO(stdfs::path, working_dir)          \
+    MACRO(stdfs::path, templates_cache_dir)  \
+    MACRO(baio_tcp_endpoint, mgmt_endpoint)  \
+    MACRO(cpu_idxs, cpus)                    \
+    MACRO(bool, tx_pipeline)                 \
+    MACRO(uint16_t, cnt_loader_threads)      \
+    MACRO(uint16_t, templates_library_share) \
+    MACRO(uint32_t, max_cnt_mbufs)           \
+    MACRO(uint16_t, num_memory_channels)     \
     MACRO(uint16_t, nic_queue_size)
 
 // The class holds the settings coming from the configuration file
@@ -19,7 +23,11 @@ class config
     friend class fmt::formatter<config>;
 
 public:
-    struct cpu_idxs : std::array<uint16_t, 2>
+    // The first CPU is used for the management and the rest of them are used
+    // for the generation, one generation worker per CPU. In the pipeline mode
+    // every generation worker uses two consecutive CPUs, the first one for the
+    // scheduling and the second one for the transmission.
+    struct cpu_idxs : bcont::vector<uint16_t>
     {
     };
 
@@ -0,0 +1,266 @@
+// Compares the `gen::priv::event_scheduler` against the DPDK `rte_timer`
+// functionality which was used before it.
+// Every event is scheduled at random time in the next second and it's
+// re-scheduled from its callback again at random time in the next second.
+// Thus the count of the active events stays constant during the run.
+// The benchmark reports:
+// - the time needed to create all events and to destroy them at the end
+// - the average cost of the initial scheduling of an event
+// - the count of the expired events per second of processing time
+// - the average lateness of the expired events
+//
+// Usage: bench-event-scheduler <EAL args>
+// e.g.: bench-event-scheduler -l 1 --no-huge --no-pci
+// Note that the run with 10M events needs about 1GB of memory.
+#include <rte_eal.h>
+#include <rte_timer.h>
+
+#include <random>
+
+#include "gen/priv/event_handle.h"
+#include "gen/priv/event_scheduler.h"
+
+#include "put/time_utils.h"
+
+namespace
+{
+
+constexpr auto run_duration = stdcr::seconds{5};
+constexpr auto max_delay    = stdcr::seconds{1};
+
+// The random delays are pre-generated so that the random generator doesn't
+// take part in the measurements.
+class delays_gen
+{
+    std::vector<put::cycles> vals_;
+    size_t idx_ = 0;
+
+public:
+    delays_gen()
+    {
+        constexpr size_t cnt = 1 << 20;
+        std::mt19937_64 rng(42);
+        std::uniform_int_distribution<uint64_t> dist(
+            1, put::cycles::from_duration(max_delay).num);
+        vals_.reserve(cnt);
+        for (size_t i = 0; i < cnt; ++i) vals_.push_back({dist(rng)});
+    }
+
+    put::cycles next() noexcept { return vals_[idx_++ & (vals_.size() - 1)]; }
+};
+
+struct bench_result
+{
+    put::cycles setup_cycles;
+    put::cycles teardown_cycles;
+    put::cycles sched_cycles;
+    put::cycles proc_cycles;
+    uint64_t cnt_expired;
+    put::cycles lateness;
+};
+
+struct bench_state
+{
+    delays_gen delays;
+    uint64_t cnt_expired = 0;
+    put::cycles lateness = {0};
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class wheel_bench
+{
+    struct entry
+    {
+        gen::priv::event_handle event;
+        put::cycles deadline;
+    };
+
+    gen::priv::event_scheduler scheduler_;
+    std::vector<entry> entries_;
+    bench_state state_;
+
+public:
+    static constexpr std::string_view name = "timing wheel";
+
+    bench_result run(size_t cnt_events)
+    {
+        const auto setup_beg = put::cycles::current();
+        entries_.reserve(cnt_events);
+        if (!scheduler_.reserve_events(cnt_events)) return {};
+        for (size_t i = 0; i < cnt_events; ++i) {
+            entries_.push_back(entry{
+                .event    = gen::priv::event_handle(&scheduler_),
+                .deadline = {0},
+            });
+        }
+        const auto setup_dur = put::cycles::current() - setup_beg;
+
+        // The entries are passed to the callback by their index.
+        const auto sched_beg = put::cycles::current();
+        for (uint32_t i = 0; i < cnt_events; ++i) schedule(i);
+        const auto sched_dur = put::cycles::current() - sched_beg;
+
+        put::cycles proc_dur{0};
+        const auto run_end =
+            put::cycles::current() + put::cycles::from_duration(run_duration);
+        for (auto now = put::cycles::current(); now < run_end;) {
+            scheduler_.process_events();
+            const auto tmp = put::cycles::current();
+            proc_dur += tmp - now;
+            now = tmp;
+        }
+
+        const auto teardown_beg = put::cycles::current();
+        scheduler_.release_all([this] { entries_.clear(); });
+        const auto teardown_dur = put::cycles::current() - teardown_beg;
+        return {
+            .setup_cycles    = setup_dur,
+            .teardown_cycles = teardown_dur,
+            .sched_cycles    = sched_dur,
+            .proc_cycles     = proc_dur,
+            .cnt_expired     = state_.cnt_expired,
+            .lateness        = state_.lateness,
+        };
+    }
+
+private:
+    void schedule(uint32_t idx) noexcept
+    {
+        auto& ent        = entries_[idx];
+        const auto delay = state_.delays.next();
+        ent.deadline     = put::cycles::current() + delay;
+        ent.event.schedule_single(delay, on_event, this, idx);
+    }
+
+    static void on_event(void* ctx, std::span<const uint32_t> tags) noexcept
+    {
+        auto* self     = static_cast<wheel_bench*>(ctx);
+        const auto now = put::cycles::current();
+        for (const uint32_t idx : tags) {
+            self->state_.cnt_expired += 1;
+            self->state_.lateness += now - self->entries_[idx].deadline;
+            self->schedule(idx);
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+class rte_timer_bench
+{
+    struct entry
+    {
+        rte_timer tmr;
+        put::cycles deadline;
+        bench_state* state;
+    };
+
+    // The timers must not move in the memory once initialized.
+    std::unique_ptr<entry[]> entries_;
+    bench_state state_;
+
+public:
+    static constexpr std::string_view name = "rte_timer";
+
+    rte_timer_bench() noexcept { rte_timer_subsystem_init(); }
+    ~rte_timer_bench() noexcept { rte_timer_subsystem_finalize(); }
+
+    bench_result run(size_t cnt_events)
+    {
+        const auto setup_beg = put::cycles::current();
+        entries_ = std::make_unique<entry[]>(cnt_events);
+        for (auto& ent : std::span(entries_.get(), cnt_events)) {
+            rte_timer_init(&ent.tmr);
+            ent.state = &state_;
+        }
+        const auto setup_dur = put::cycles::current() - setup_beg;
+
+        const auto sched_beg = put::cycles::current();
+        for (auto& ent : std::span(entries_.get(), cnt_events)) schedule(ent);
+        const auto sched_dur = put::cycles::current() - sched_beg;
+
+        put::cycles proc_dur{0};
+        const auto run_end =
+            put::cycles::current() + put::cycles::from_duration(run_duration);
+        for (auto now = put::cycles::current(); now < run_end;) {
+            rte_timer_manage();
+            const auto tmp = put::cycles::current();
+            proc_dur += tmp - now;
+            now = tmp;
+        }
+
+        const auto teardown_beg = put::cycles::current();
+        for (auto& ent : std::span(entries_.get(), cnt_events)) {
+            rte_timer_stop(&ent.tmr);
+        }
+        entries_.reset();
+        const auto teardown_dur = put::cycles::current() - teardown_beg;
+        return {
+            .setup_cycles    = setup_dur,
+            .teardown_cycles = teardown_dur,
+            .sched_cycles    = sched_dur,
+            .proc_cycles     = proc_dur,
+            .cnt_expired     = state_.cnt_expired,
+            .lateness        = state_.lateness,
+        };
+    }
+
+private:
+    static void schedule(entry& ent) noexcept
+    {
+        const auto delay = ent.state->delays.next();
+        ent.deadline     = put::cycles::current() + delay;
+        rte_timer_reset(&ent.tmr, delay.num, rte_timer_type::SINGLE,
+                        rte_lcore_id(), on_event, &ent);
+    }
+
+    static void on_event(rte_timer*, void* ctx) noexcept
+    {
+        auto& ent = *static_cast<entry*>(ctx);
+        ent.state->cnt_expired += 1;
+        ent.state->lateness += put::cycles::current() - ent.deadline;
+        schedule(ent);
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Bench>
+void run_bench(size_t cnt_events)
+{
+    const auto res = std::make_unique<Bench>()->run(cnt_events);
+    const auto ns  = [](put::cycles c) {
+        return c.to<stdcr::nanoseconds>().count();
+    };
+    const auto cnt_exp = std::max<uint64_t>(res.cnt_expired, 1);
+    fmt::print(stdout,
+               "{:>12} {:>10}: setup {:>8} us, teardown {:>8} us, "
+               "schedule {:>6} ns/event, expired {:>10}/s of "
+               "processing, {:>6} ns/expire, avg lateness {:>8} ns\n",
+               Bench::name, cnt_events, ns(res.setup_cycles) / 1'000,
+               ns(res.teardown_cycles) / 1'000,
+               ns(res.sched_cycles) / cnt_events,
+               (res.cnt_expired * 1'000'000'000ull) /
+                   std::max<uint64_t>(ns(res.proc_cycles), 1),
+               ns(res.proc_cycles) / cnt_exp, ns(res.lateness) / cnt_exp);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (rte_eal_init(argc, argv) < 0) {
+        fmt::print(stderr, "Failed to initialize the DPDK EAL: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+
+    for (size_t cnt : {1'000uz, 100'000uz, 10'000'000uz}) {
+        run_bench<wheel_bench>(cnt);
+        run_bench<rte_timer_bench>(cnt);
+    }
+
+    rte_eal_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,321 @@
+// Measures the packets per second which a single core generates with the
+// batch send path of the flows generator, i.e. the expired events of a tick
+// are passed as a batch and the packets of the whole batch are copied,
+// rewritten and sent together. It's compared against the per packet copy
+// which was used before the batching. The header and the indirect payload
+// mbufs of every packet are allocated one by one there and the payload is
+// attached with `rte_pktmbuf_clone`.
+// The flows generator works in the event per flow mode with many more flows
+// than a core can handle. Thus it's always late and every pass over the
+// scheduler sends as many packets as possible. The packets are freed instead
+// of transmitted so that no NIC takes part in the measurements.
+// The benchmark reports the count of the sent packets per second of
+// processing and the average schedule error for several packet counts.
+//
+// Usage: bench-flows-generator <EAL args>
+// e.g.: bench-flows-generator -l 1 --no-huge --no-pci
+#include <rte_eal.h>
+
+#include "gen/priv/event_handle.h"
+#include "gen/priv/event_scheduler.h"
+#include "gen/priv/flows_generator.h"
+#include "gen/priv/generation_ops.h"
+#include "gen/priv/mbuf_pool.h"
+
+#include "put/pkt_utils.h"
+#include "put/time_utils.h"
+
+namespace
+{
+
+constexpr auto run_duration     = stdcr::seconds{5};
+constexpr uint32_t cnt_flows    = 1'000'000;
+constexpr uint32_t cnt_mbufs    = 256 * 1024;
+constexpr uint16_t payload_len  = 512;
+constexpr auto inter_pkts_gap   = stdcr::microseconds{10};
+constexpr auto ol_flags = RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM |
+                          RTE_MBUF_F_TX_TCP_CKSUM;
+
+using pkt_templates = gen::priv::pkt_templates;
+
+// Every flow sends the given count of Ethernet + IPv4 + TCP packets with
+// payload, in both directions.
+std::shared_ptr<const pkt_templates> make_templates(gen::priv::mbuf_pool& pool,
+                                                    uint32_t cnt_pkts)
+{
+    constexpr uint16_t hdrs_len =
+        sizeof(rte_ether_hdr) + sizeof(rte_ipv4_hdr) + sizeof(rte_tcp_hdr);
+    std::vector<pkt_templates::pkt> pkts;
+    for (uint32_t i = 0; i < cnt_pkts; ++i) {
+        rte_mbuf* hdr     = rte_pktmbuf_alloc(pool.hdr_pool());
+        rte_mbuf* payload = rte_pktmbuf_alloc(pool.pool());
+        if (!hdr || !payload) {
+            fmt::print(stderr, "Failed to allocate the template packets\n");
+            std::exit(EXIT_FAILURE);
+        }
+        ::memset(rte_pktmbuf_append(hdr, hdrs_len), 0, hdrs_len);
+        ::memset(rte_pktmbuf_append(payload, payload_len), 0, payload_len);
+        auto* eh       = put::read_hdr<rte_ether_hdr>(hdr, 0);
+        eh->ether_type = ben::native_to_big<uint16_t>(RTE_ETHER_TYPE_IPV4);
+        auto* ih = put::read_hdr<rte_ipv4_hdr>(hdr, sizeof(rte_ether_hdr));
+        ih->version_ihl   = RTE_IPV4_VHL_DEF;
+        ih->next_proto_id = IPPROTO_TCP;
+        const auto rel_time =
+            (i == 0) ? stdcr::microseconds(pkt_templates::if_gap)
+                     : inter_pkts_gap;
+        pkts.push_back(pkt_templates::pkt{
+            .rel_tsc  = put::cycles::from_duration(rel_time),
+            .hdr      = pkt_templates::mbuf_ptr_type(hdr),
+            .payload  = pkt_templates::mbuf_ptr_type(payload),
+            .len      = hdrs_len + payload_len,
+            .from_cln = ((i % 2) == 0),
+            .l4_ports = 0,
+            .tx_meta  = put::make_hw_tx_meta(ol_flags, sizeof(rte_ether_hdr),
+                                             sizeof(rte_ipv4_hdr)),
+        });
+    }
+    return std::make_shared<const pkt_templates>(std::move(pkts));
+}
+
+class bench_ops_base : public gen::priv::generation_ops
+{
+protected:
+    gen::priv::event_scheduler* scheduler_;
+    gen::priv::mbuf_pool* pool_;
+
+public:
+    uint64_t cnt_sent   = 0;
+    uint64_t cnt_nombuf = 0;
+
+    bench_ops_base(gen::priv::event_scheduler& sched,
+                   gen::priv::mbuf_pool& pool) noexcept
+    : scheduler_(&sched), pool_(&pool)
+    {
+    }
+
+    void send_pkts(std::span<rte_mbuf* const> pkts) noexcept override
+    {
+        cnt_sent += pkts.size();
+        rte_pktmbuf_free_bulk(const_cast<rte_mbuf**>(pkts.data()),
+                              pkts.size());
+    }
+    gen::priv::event_handle create_scheduler_event() noexcept override
+    {
+        return gen::priv::event_handle(scheduler_);
+    }
+    gen::priv::event_block
+    create_scheduler_events(uint32_t cnt) noexcept override
+    {
+        return gen::priv::event_block(scheduler_, cnt);
+    }
+    void do_reports(
+        std::span<const gen::priv::generation_report>) noexcept override
+    {
+    }
+    void do_reports(
+        std::span<const gen::priv::generation_report6>) noexcept override
+    {
+    }
+};
+
+// The copy as it's done by the generation workers
+class batch_ops final : public bench_ops_base
+{
+    std::vector<rte_mbuf*> copy_mbufs_;
+
+public:
+    static constexpr std::string_view name = "batch";
+
+    using bench_ops_base::bench_ops_base;
+
+    void copy_pkts(std::span<const gen::priv::pkt_segs> pkts,
+                   rte_mbuf** out) noexcept override
+    {
+        size_t cnt = 0;
+        for (const auto& pkt : pkts) {
+            cnt += 1 + (pkt.payload ? pkt.payload->nb_segs : 0);
+        }
+        copy_mbufs_.resize(cnt);
+        if (rte_pktmbuf_alloc_bulk(pool_->hdr_pool(), copy_mbufs_.data(),
+                                   cnt) != 0) {
+            cnt_nombuf += pkts.size();
+            std::fill_n(out, pkts.size(), nullptr);
+            return;
+        }
+        for (rte_mbuf** mbufs = copy_mbufs_.data(); const auto& pkt : pkts) {
+            rte_mbuf* ret  = *mbufs++;
+            const auto len = rte_pktmbuf_data_len(pkt.hdr);
+            ::memcpy(rte_pktmbuf_append(ret, len),
+                     rte_pktmbuf_mtod(pkt.hdr, const char*), len);
+            for (rte_mbuf* seg = pkt.payload; seg; seg = seg->next) {
+                rte_mbuf* mi = *mbufs++;
+                rte_pktmbuf_attach(mi, seg);
+                rte_pktmbuf_chain(ret, mi);
+            }
+            *out++ = ret;
+        }
+    }
+};
+
+// The copy as it was done before the batching
+class per_pkt_ops final : public bench_ops_base
+{
+public:
+    static constexpr std::string_view name = "per packet";
+
+    using bench_ops_base::bench_ops_base;
+
+    void copy_pkts(std::span<const gen::priv::pkt_segs> pkts,
+                   rte_mbuf** out) noexcept override
+    {
+        for (const auto& pkt : pkts) *out++ = copy_pkt(pkt);
+    }
+
+private:
+    rte_mbuf* copy_pkt(const gen::priv::pkt_segs& pkt) noexcept
+    {
+        rte_mbuf* ret = rte_pktmbuf_alloc(pool_->hdr_pool());
+        if (!ret) {
+            ++cnt_nombuf;
+            return nullptr;
+        }
+        const auto len = rte_pktmbuf_data_len(pkt.hdr);
+        ::memcpy(rte_pktmbuf_append(ret, len),
+                 rte_pktmbuf_mtod(pkt.hdr, const char*), len);
+        if (!pkt.payload) return ret;
+        rte_mbuf* pl = rte_pktmbuf_clone(pkt.payload, pool_->hdr_pool());
+        if (!pl || (rte_pktmbuf_chain(ret, pl) != 0)) {
+            rte_pktmbuf_free(pl);
+            rte_pktmbuf_free(ret);
+            ++cnt_nombuf;
+            return nullptr;
+        }
+        return ret;
+    }
+};
+
+struct bench_result
+{
+    put::cycles proc_cycles;
+    uint64_t cnt_sent;
+    uint64_t cnt_nombuf;
+    gen::priv::flows_generator::sched_error sched_err;
+};
+
+template <typename Ops>
+bench_result run_bench(gen::priv::mbuf_pool& pool,
+                       const std::shared_ptr<const pkt_templates>& tmpls)
+{
+    gen::priv::event_scheduler scheduler;
+    Ops ops(scheduler, pool);
+    if (!scheduler.reserve_events(cnt_flows + 2)) {
+        fmt::print(stderr, "Failed to allocate {} events\n", cnt_flows + 2);
+        std::exit(EXIT_FAILURE);
+    }
+    auto gen = std::make_unique<gen::priv::flows_generator>(
+        gen::priv::flows_generator::config{
+            .idx                  = 0,
+            .shard_idx            = 0,
+            .shard_cnt            = 1,
+            .cap_fpath            = "bench.pcap",
+            .templates            = tmpls,
+            .streamed             = false,
+            .stream               = {},
+            .cln_ether_addr       = {},
+            .srv_ether_addr       = {},
+            .burst                = 1,
+            .flows_per_sec        = cnt_flows,
+            .inter_pkts_gap       = std::nullopt,
+            .cln_addrs            = {.nets   = {baio_ip_net4(
+                                         baio_ip_addr4(0x10000000), 8)},
+                                     .nets6  = {},
+                                     .stride = 1,
+                                     .seed   = std::nullopt},
+            .srv_addrs            = {.nets   = {baio_ip_net4(
+                                         baio_ip_addr4(0x30000000), 16)},
+                                     .nets6  = {},
+                                     .stride = 1,
+                                     .seed   = std::nullopt},
+            .cln_ports            = std::nullopt,
+            .srv_ports            = std::nullopt,
+            .ports_policy = gen::priv::flows_generator::port_policy::sequential,
+            .vlans                = std::nullopt,
+            .inner_vlans          = std::nullopt,
+            .mpls_labels          = std::nullopt,
+            .hw_vlans             = false,
+            .tunnel               = std::nullopt,
+            .precompiled_schedule = false,
+            .prerender_budget     = 0,
+            .max_variant_refs     = 0,
+            .sw_cksum             = false,
+            .isn_offsets          = false,
+            .gen_ops              = &ops,
+        });
+
+    // The generator starts sending after the gap of the first packets
+    put::cycles proc_dur{0};
+    const auto run_end = put::cycles::current() +
+                         put::cycles::from_duration(pkt_templates::if_gap) +
+                         put::cycles::from_duration(run_duration);
+    for (auto now = put::cycles::current(); now < run_end;) {
+        const auto cnt_sent = ops.cnt_sent;
+        scheduler.process_events();
+        const auto tmp = put::cycles::current();
+        if (ops.cnt_sent != cnt_sent) proc_dur += tmp - now;
+        now = tmp;
+    }
+
+    const auto sched_err = gen->schedule_error();
+    scheduler.release_all([&gen] { gen.reset(); });
+    return {
+        .proc_cycles = proc_dur,
+        .cnt_sent    = ops.cnt_sent,
+        .cnt_nombuf  = ops.cnt_nombuf,
+        .sched_err   = sched_err,
+    };
+}
+
+template <typename Ops>
+void print_bench(gen::priv::mbuf_pool& pool, uint32_t cnt_pkts)
+{
+    const auto tmpls = make_templates(pool, cnt_pkts);
+    const bench_result res = run_bench<Ops>(pool, tmpls);
+    // The processing time is converted in microseconds because the
+    // conversion of several seconds in nanoseconds may overflow.
+    const auto proc_us = std::max<uint64_t>(
+        res.proc_cycles.to<stdcr::microseconds>().count(), 1);
+    const auto cnt_sched = std::max<uint64_t>(res.sched_err.cnt, 1);
+    fmt::print(stdout,
+               "{:>10} {:>2} pkts/flow: sent {:>10} pkts/s of processing, "
+               "{:>6} ns/pkt, no mbufs {:>8}, avg schedule error {:>10} ns\n",
+               Ops::name, cnt_pkts, (res.cnt_sent * 1'000'000ull) / proc_us,
+               (proc_us * 1'000ull) / std::max<uint64_t>(res.cnt_sent, 1),
+               res.cnt_nombuf,
+               res.sched_err.total.to<stdcr::nanoseconds>().count() /
+                   cnt_sched);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (rte_eal_init(argc, argv) < 0) {
+        fmt::print(stderr, "Failed to initialize the DPDK EAL: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+
+    {
+        gen::priv::mbuf_pool pool({
+            .cnt_mbufs = cnt_mbufs,
+            .socket_id = rte_socket_id(),
+        });
+        for (uint32_t cnt_pkts : {2u, 8u, 32u}) {
+            print_bench<batch_ops>(pool, cnt_pkts);
+            print_bench<per_pkt_ops>(pool, cnt_pkts);
+        }
+    }
+
+    rte_eal_cleanup();
+    return EXIT_SUCCESS;
+}
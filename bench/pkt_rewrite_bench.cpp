@@ -0,0 +1,214 @@
+// Compares the batch rewrite of the packet headers from `put/pkt_rewrite.h`
+// against the per packet rewrite which was used before it. The latter reads
+// the IPv4 header with `put::read_hdr`, chooses and byte swaps the addresses
+// and sets the offload flags and lengths packet by packet.
+// The packets are Ethernet + IPv4 + TCP headers in pool mbufs and the
+// addresses and the directions are pre-generated so that the random generator
+// doesn't take part in the measurements.
+// The benchmark reports the average cost of the rewrite per packet for
+// several batch sizes. It also reports the cost of the batch rewrite of
+// Ethernet + IPv6 + TCP packets relative to the IPv4 one.
+//
+// Usage: bench-pkt-rewrite <EAL args>
+// e.g.: bench-pkt-rewrite -l 1 --no-huge --no-pci
+#include <rte_eal.h>
+
+#include <random>
+
+#include "put/pkt_rewrite.h"
+#include "put/pkt_utils.h"
+#include "put/time_utils.h"
+
+namespace
+{
+
+constexpr size_t cnt_pkts   = 4 * 1024;
+constexpr size_t cnt_rounds = 2'000;
+constexpr auto ol_flags = RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM |
+                          RTE_MBUF_F_TX_TCP_CKSUM;
+
+struct bench_input
+{
+    std::vector<rte_mbuf*> pkts;
+    std::vector<rte_mbuf*> pkts6;
+    std::vector<uint32_t> cln_addrs;
+    std::vector<uint32_t> srv_addrs;
+    std::vector<put::uint128> cln_addrs6;
+    std::vector<put::uint128> srv_addrs6;
+    std::vector<uint8_t> from_cln;
+};
+
+std::vector<rte_mbuf*> alloc_pkts(rte_mempool* pool, size_t hdrs_len)
+{
+    std::vector<rte_mbuf*> pkts(cnt_pkts);
+    if (rte_pktmbuf_alloc_bulk(pool, pkts.data(), cnt_pkts) != 0) {
+        fmt::print(stderr, "Failed to allocate {} packets\n", cnt_pkts);
+        std::exit(EXIT_FAILURE);
+    }
+    for (rte_mbuf* pkt : pkts) {
+        auto* data = rte_pktmbuf_append(pkt, hdrs_len);
+        ::memset(data, 0, hdrs_len);
+    }
+    return pkts;
+}
+
+bench_input make_input(rte_mempool* pool)
+{
+    constexpr size_t hdrs_len =
+        sizeof(rte_ether_hdr) + sizeof(rte_ipv4_hdr) + sizeof(rte_tcp_hdr);
+    constexpr size_t hdrs6_len =
+        sizeof(rte_ether_hdr) + sizeof(rte_ipv6_hdr) + sizeof(rte_tcp_hdr);
+    std::mt19937_64 rng(42);
+    bench_input in;
+    in.pkts  = alloc_pkts(pool, hdrs_len);
+    in.pkts6 = alloc_pkts(pool, hdrs6_len);
+    for (size_t i = 0; i < cnt_pkts; ++i) {
+        auto* eh       = put::read_hdr<rte_ether_hdr>(in.pkts[i], 0);
+        eh->ether_type = ben::native_to_big<uint16_t>(RTE_ETHER_TYPE_IPV4);
+        auto* ih =
+            put::read_hdr<rte_ipv4_hdr>(in.pkts[i], sizeof(rte_ether_hdr));
+        ih->version_ihl   = RTE_IPV4_VHL_DEF;
+        ih->next_proto_id = IPPROTO_TCP;
+        auto* eh6         = put::read_hdr<rte_ether_hdr>(in.pkts6[i], 0);
+        eh6->ether_type = ben::native_to_big<uint16_t>(RTE_ETHER_TYPE_IPV6);
+        auto* ih6 =
+            put::read_hdr<rte_ipv6_hdr>(in.pkts6[i], sizeof(rte_ether_hdr));
+        ih6->vtc_flow = ben::native_to_big<uint32_t>(6u << 28);
+        ih6->proto    = IPPROTO_TCP;
+        in.cln_addrs.push_back(static_cast<uint32_t>(rng()));
+        in.srv_addrs.push_back(static_cast<uint32_t>(rng()));
+        in.cln_addrs6.push_back((put::uint128(rng()) << 64) | rng());
+        in.srv_addrs6.push_back((put::uint128(rng()) << 64) | rng());
+        in.from_cln.push_back(rng() & 1);
+    }
+    return in;
+}
+
+// The rewrite as it was done before the batch kernel
+void rewrite_scalar(std::span<rte_mbuf* const> pkts,
+                    const uint32_t* cln_addrs,
+                    const uint32_t* srv_addrs,
+                    const uint8_t* from_cln) noexcept
+{
+    for (size_t i = 0; i < pkts.size(); ++i) {
+        rte_mbuf* pkt = pkts[i];
+        auto* ih = put::read_hdr<rte_ipv4_hdr>(pkt, sizeof(rte_ether_hdr));
+        const uint32_t cln = ben::native_to_big(cln_addrs[i]);
+        const uint32_t srv = ben::native_to_big(srv_addrs[i]);
+        ih->src_addr       = from_cln[i] ? cln : srv;
+        ih->dst_addr       = from_cln[i] ? srv : cln;
+        pkt->ol_flags |= ol_flags;
+        pkt->l2_len = sizeof(rte_ether_hdr);
+        pkt->l3_len = put::hdr_len(ih);
+    }
+}
+
+template <size_t BatchSize>
+void rewrite_batch(std::span<rte_mbuf* const> pkts,
+                   const uint32_t* cln_addrs,
+                   const uint32_t* srv_addrs,
+                   const uint8_t* from_cln,
+                   const put::tx_meta* meta) noexcept
+{
+    std::array<put::ipv4_addrs, BatchSize> addrs;
+    std::array<const put::tx_meta*, BatchSize> metas;
+    metas.fill(meta);
+    put::select_ipv4_addrs({addrs.data(), pkts.size()}, cln_addrs, srv_addrs,
+                           from_cln);
+    put::write_ipv4_hdrs(pkts, addrs.data(), metas.data());
+}
+
+template <size_t BatchSize>
+void rewrite_batch6(std::span<rte_mbuf* const> pkts,
+                    const put::uint128* cln_addrs,
+                    const put::uint128* srv_addrs,
+                    const uint8_t* from_cln,
+                    const put::tx_meta* meta) noexcept
+{
+    std::array<put::ipv6_addrs, BatchSize> addrs;
+    std::array<const put::tx_meta*, BatchSize> metas;
+    metas.fill(meta);
+    put::select_ipv6_addrs({addrs.data(), pkts.size()}, cln_addrs, srv_addrs,
+                           from_cln);
+    put::write_ipv6_hdrs(pkts, addrs.data(), metas.data());
+}
+
+template <size_t BatchSize>
+void run_bench(const bench_input& in)
+{
+    static_assert((cnt_pkts % BatchSize) == 0);
+    const auto meta = put::make_hw_tx_meta(ol_flags, sizeof(rte_ether_hdr),
+                                           sizeof(rte_ipv4_hdr));
+    const auto meta6 = put::make_hw_tx_meta(
+        RTE_MBUF_F_TX_IPV6 | RTE_MBUF_F_TX_TCP_CKSUM, sizeof(rte_ether_hdr),
+        sizeof(rte_ipv6_hdr));
+    auto measure = [&](const auto& pkts, const auto& cln_addrs,
+                       const auto& srv_addrs, auto&& fn) {
+        const auto beg = put::cycles::current();
+        for (size_t r = 0; r < cnt_rounds; ++r) {
+            for (size_t i = 0; i < cnt_pkts; i += BatchSize) {
+                fn(std::span(pkts.data() + i, BatchSize), cln_addrs.data() + i,
+                   srv_addrs.data() + i, in.from_cln.data() + i);
+            }
+        }
+        const auto dur = put::cycles::current() - beg;
+        // Fractions of nanoseconds matter here
+        return double(dur.to<stdcr::nanoseconds>().count()) /
+               double(cnt_rounds * cnt_pkts);
+    };
+    const double scalar_ns =
+        measure(in.pkts, in.cln_addrs, in.srv_addrs, rewrite_scalar);
+    const double batch_ns = measure(
+        in.pkts, in.cln_addrs, in.srv_addrs,
+        [&](auto pkts, auto cln, auto srv, auto fc) {
+            rewrite_batch<BatchSize>(pkts, cln, srv, fc, &meta);
+        });
+    const double batch6_ns = measure(
+        in.pkts6, in.cln_addrs6, in.srv_addrs6,
+        [&](auto pkts, auto cln, auto srv, auto fc) {
+            rewrite_batch6<BatchSize>(pkts, cln, srv, fc, &meta6);
+        });
+    fmt::print(stdout,
+               "batch {:>3}: scalar {:>6.2f} ns/pkt, batch kernel {:>6.2f} "
+               "ns/pkt, speedup {:>4.2f}x, IPv6 batch kernel {:>6.2f} "
+               "ns/pkt, {:>4.2f}x of IPv4\n",
+               BatchSize, scalar_ns, batch_ns, scalar_ns / batch_ns,
+               batch6_ns, batch6_ns / batch_ns);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (rte_eal_init(argc, argv) < 0) {
+        fmt::print(stderr, "Failed to initialize the DPDK EAL: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+
+    rte_mempool* pool = rte_pktmbuf_pool_create(
+        "bench_pool", cnt_pkts * 3, 0, 0, RTE_MBUF_DEFAULT_BUF_SIZE,
+        rte_socket_id());
+    if (!pool) {
+        fmt::print(stderr, "Failed to create the packet pool: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+    auto in = make_input(pool);
+#if defined(__AVX2__)
+    fmt::print(stdout, "The batch kernel uses AVX2\n");
+#elif defined(__SSE4_2__)
+    fmt::print(stdout, "The batch kernel uses SSE4.2\n");
+#else
+    fmt::print(stdout, "The batch kernel uses no SIMD\n");
+#endif
+    run_bench<8>(in);
+    run_bench<16>(in);
+    run_bench<64>(in);
+
+    rte_pktmbuf_free_bulk(in.pkts.data(), in.pkts.size());
+    rte_pktmbuf_free_bulk(in.pkts6.data(), in.pkts6.size());
+    rte_mempool_free(pool);
+    rte_eal_cleanup();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,148 @@
+// Measures the `gen::priv::tcap_loader` against the plain sequential read of
+// the capture file, with `::read` in 1MB chunks, which is the upper bound of
+// the loading speed. The file is read once before the measurements so that
+// all rounds run from the page cache.
+// The loaded packets are freed after every batch and thus the loading doesn't
+// need a packet pool as large as the capture.
+// The benchmark reports:
+// - the time needed to open, map and index the file
+// - the bandwidth and the packet rate of the loading of the packets
+// - the bandwidth of the plain read
+//
+// Usage: bench-tcap-loader <EAL args> -- <capture file>
+// e.g.: bench-tcap-loader -l 1 --no-huge --no-pci -- ./traffic.pcapng
+#include <rte_eal.h>
+
+#include "gen/priv/tcap_loader.h"
+
+#include "put/time_utils.h"
+
+namespace
+{
+
+constexpr size_t cnt_rounds = 5;
+constexpr size_t batch_size = 64;
+constexpr size_t cnt_mbufs  = 4 * 1024;
+
+struct read_result
+{
+    size_t cnt_bytes;
+    double secs;
+};
+
+read_result read_file(const char* fpath)
+{
+    const int fd = ::open(fpath, O_RDONLY);
+    if (fd < 0) {
+        fmt::print(stderr, "Failed to open {}: {}\n", fpath,
+                   std::strerror(errno));
+        std::exit(EXIT_FAILURE);
+    }
+    std::vector<uint8_t> buf(1024 * 1024);
+    size_t cnt_bytes = 0;
+    const auto beg   = stdcr::steady_clock::now();
+    for (;;) {
+        const ssize_t ret = ::read(fd, buf.data(), buf.size());
+        if (ret <= 0) break;
+        cnt_bytes += ret;
+    }
+    const auto end = stdcr::steady_clock::now();
+    ::close(fd);
+    return {cnt_bytes, stdcr::duration<double>(end - beg).count()};
+}
+
+struct load_result
+{
+    size_t cnt_pkts;
+    size_t cnt_bytes;
+    double index_secs;
+    double load_secs;
+};
+
+load_result load_file(const char* fpath, rte_mempool* pool)
+{
+    const auto beg = stdcr::steady_clock::now();
+    gen::priv::tcap_loader tcap{fpath};
+    const auto mid = stdcr::steady_clock::now();
+
+    auto alloc_mbufs = [pool](std::span<rte_mbuf*> mbufs) {
+        return rte_pktmbuf_alloc_bulk(pool, mbufs.data(), mbufs.size()) == 0;
+    };
+    std::array<gen::priv::tcap_loader::pkt, batch_size> pkts;
+    size_t cnt_pkts  = 0;
+    size_t cnt_bytes = 0;
+    while (!tcap.is_eof()) {
+        auto ret = tcap.load_pkts(pkts, alloc_mbufs);
+        if (!ret) {
+            fmt::print(stderr, "Failed to load packets from {}: {}\n", fpath,
+                       ret.error().message());
+            std::exit(EXIT_FAILURE);
+        }
+        for (size_t i = 0; i < ret.value(); ++i) {
+            cnt_bytes += rte_pktmbuf_pkt_len(pkts[i].mbuf);
+            rte_pktmbuf_free(pkts[i].mbuf);
+        }
+        cnt_pkts += ret.value();
+    }
+    const auto end = stdcr::steady_clock::now();
+    return {
+        .cnt_pkts   = cnt_pkts,
+        .cnt_bytes  = cnt_bytes,
+        .index_secs = stdcr::duration<double>(mid - beg).count(),
+        .load_secs  = stdcr::duration<double>(end - mid).count(),
+    };
+}
+
+void run_bench(const char* fpath, rte_mempool* pool)
+{
+    constexpr double mb = 1024 * 1024;
+
+    read_file(fpath); // warms up the page cache
+    for (size_t i = 0; i < cnt_rounds; ++i) {
+        const auto rd = read_file(fpath);
+        const auto ld = load_file(fpath, pool);
+        fmt::print(stdout,
+                   "round {}: index {:>8.3f} ms, load {:>9.2f} MB/s "
+                   "{:>7.3f} Mpkts/s, plain read {:>9.2f} MB/s\n",
+                   i, ld.index_secs * 1e3, (ld.cnt_bytes / mb) / ld.load_secs,
+                   (ld.cnt_pkts / 1e6) / ld.load_secs,
+                   (rd.cnt_bytes / mb) / rd.secs);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const int ret = rte_eal_init(argc, argv);
+    if (ret < 0) {
+        fmt::print(stderr, "Failed to initialize the DPDK EAL: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+    argc -= ret;
+    argv += ret;
+    if (argc != 2) {
+        fmt::print(stderr, "Usage: bench-tcap-loader <EAL args> -- <file>\n");
+        return EXIT_FAILURE;
+    }
+
+    rte_mempool* pool = rte_pktmbuf_pool_create(
+        "bench_pool", cnt_mbufs, 0, 0, RTE_MBUF_DEFAULT_BUF_SIZE,
+        rte_socket_id());
+    if (!pool) {
+        fmt::print(stderr, "Failed to create the packet pool: {}\n",
+                   rte_strerror(rte_errno));
+        return EXIT_FAILURE;
+    }
+    try {
+        run_bench(argv[1], pool);
+    } catch (const std::exception& ex) {
+        fmt::print(stderr, "{}\n", ex.what());
+        return EXIT_FAILURE;
+    }
+
+    rte_mempool_free(pool);
+    rte_eal_cleanup();
+    return EXIT_SUCCESS;
+}
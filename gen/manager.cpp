@@ -1,35 +1,114 @@
 #include "gen/manager.h"
 #include "gen/priv/eth_dev.h"
+#include "gen/priv/flows_balancer.h"
 #include "gen/priv/flows_generator.h"
 #include "gen/priv/generation_ops.h"
 #include "gen/priv/mbuf_pool.h"
 #include "gen/priv/event_scheduler.h"
+#include "gen/priv/templates_cache.h"
+#include "gen/priv/templates_library.h"
+#include "gen/priv/templates_loader.h"
+#include "gen/priv/tx_stage.h"
 
 #include "log/tg_log.h"
 #include "mgmt/gen_config.h"
 #include "mgmt/messages.h"
 #include "mgmt/stats.h"
+#include "put/num_utils.h"
 #include "put/tg_assert.h"
+#include "put/throw.h"
 #include "put/time_utils.h"
 
 namespace gen // generator
 {
 
-class manager_impl final : public gen::priv::generation_ops
+// Currently we always work with single port only and the ports start from 0
+static constexpr uint16_t nic_port_id = 0;
+
+// How often every worker checks its lag when the flows rebalancing is enabled
+// and the max count of flows which it hands over on a single check.
+static constexpr stdcr::milliseconds balance_period(10);
+static constexpr size_t max_balance_flows = 64;
+
+static gen::priv::flows_generator::port_policy
+to_gen_policy(mgmt::port_policy policy) noexcept
 {
-    using config_type = manager::config;
+    using gen_policy = gen::priv::flows_generator::port_policy;
+    switch (policy) {
+    case mgmt::port_policy::sequential: return gen_policy::sequential;
+    case mgmt::port_policy::random: return gen_policy::random;
+    case mgmt::port_policy::paired: return gen_policy::paired;
+    }
+    TG_UNREACHABLE();
+}
+
+// The two sides get different seeds so that their random orders don't follow
+// each other.
+static gen::priv::addr_space::config
+to_addr_space_cfg(const mgmt::flows_config& cfg, bool cln)
+{
+    std::optional<uint64_t> seed;
+    if (cfg.ips_order == mgmt::addr_order::random) {
+        seed = cln ? cfg.ips_seed : put::mix64(cfg.ips_seed);
+    }
+    const auto& nets = cln ? cfg.cln_ips : cfg.srv_ips;
+    return {
+        .nets   = nets.v4,
+        .nets6  = nets.v6,
+        .stride = cln ? cfg.cln_ips_stride : cfg.srv_ips_stride,
+        .seed   = seed,
+    };
+}
 
-    // Currently we always work with single port only and the ports start from 0
-    static constexpr uint16_t nic_port_id  = 0;
+// The outer addresses are always taken in order, without stride
+static std::optional<gen::priv::flows_generator::tunnel_config>
+to_gen_tunnel(const std::optional<mgmt::tunnel_config>& cfg)
+{
+    if (!cfg) return std::nullopt;
+    put::tunnel_type type = put::tunnel_type::none;
+    switch (cfg->type) {
+    case mgmt::tunnel_type::vxlan: type = put::tunnel_type::vxlan; break;
+    case mgmt::tunnel_type::gre: type = put::tunnel_type::gre; break;
+    case mgmt::tunnel_type::gtpu: type = put::tunnel_type::gtpu; break;
+    }
+    auto addrs_cfg = [](const std::vector<baio_ip_net4>& nets) {
+        return gen::priv::addr_space::config{
+            .nets   = nets,
+            .nets6  = {},
+            .stride = 1,
+            .seed   = std::nullopt,
+        };
+    };
+    return gen::priv::flows_generator::tunnel_config{
+        .type      = type,
+        .cln_addrs = addrs_cfg(cfg->cln_ips),
+        .srv_addrs = addrs_cfg(cfg->srv_ips),
+        .ids       = cfg->ids,
+    };
+}
+
+// Every worker runs on its own CPU core and uses its own NIC queue pair, event
+// scheduler and shard of the flows. The memory pools are shared but every core
+// has its own cache in them.
+class worker_impl final : public gen::priv::generation_ops
+{
     static constexpr size_t cnt_burst_pkts = 64;
 
-    gen::priv::mbuf_pool mbuf_pool_;
-    gen::priv::eth_dev eth_dev_;
+    const uint32_t idx_;
+    const uint32_t cnt_workers_;
+    const uint16_t queue_id_;
+    const uint32_t max_variant_refs_;
+    gen::priv::mbuf_pool* mbuf_pool_;
+    gen::priv::eth_dev* eth_dev_;
+    gen::priv::flows_balancer* balancer_;
+    gen::priv::tx_stage* tx_stage_; // null, if not in pipeline mode
+    gen::priv::templates_loader* loader_;
+    const gen::priv::templates_library* library_;
     mgmt::out_messages_queue* inc_queue_;
     mgmt::inc_messages_queue* out_queue_;
 
     // The event scheduler needs to be destroyed after the generators because
-    // the latter use the timer subsystem.
+    // the latter hold events from it.
     gen::priv::event_scheduler scheduler_;
 
     using flows_generator_type = gen::priv::flows_generator;
@@ -42,16 +121,81 @@ class manager_impl final : public gen::priv::generation_ops
     };
     std::optional<const gen_cycles> gen_cycles_;
 
+    // The start request which waits for its packet templates
+    struct pending_start
+    {
+        uint32_t epoch;
+        std::unique_ptr<mgmt::gen_config> cfg;
+        std::vector<flows_generator_type::config> gen_cfgs;
+        gen::priv::templates_loader::batch_ptr batch;
+    };
+    std::optional<pending_start> pending_;
+
+    // Every start request starts new epoch, assigned by the management.
+    // The flows are handed over only between workers which run generation
+    // started in the same epoch.
+    uint32_t epoch_     = 0;
+    uint32_t gen_epoch_ = 0; // the epoch of the current generation, if any
+    struct balance_state
+    {
+        put::cycles max_lag;
+        put::cycles next_tsc;   // the time of the next check
+        put::cycles sent_error; // the total schedule error at the last check
+        uint64_t sent_cnt;      // the count of sent packets at the last check
+    };
+    std::optional<balance_state> balance_;
+
     std::vector<rte_mbuf*> tx_pkts_;
+    // Used by the copying of the packets. It's a member only to avoid
+    // allocations on every copy.
+    std::vector<rte_mbuf*> copy_mbufs_;
 
     uint64_t cnt_tx_pkts_qfull_  = 0;
     uint64_t cnt_tx_pkts_nombuf_ = 0;
+    // The stats of the transmission stage at the start of the generation
+    gen::priv::tx_stage::stats tx_stats_beg_ = {};
 
     const stdfs::path working_dir_;
 
 public:
-    manager_impl(const config_type&);
-    ~manager_impl() noexcept override = default;
+    struct config
+    {
+        uint32_t idx;
+        uint32_t cnt_workers;
+        uint32_t max_variant_refs;
+        stdfs::path working_dir;
+        gen::priv::mbuf_pool* mbuf_pool;
+        gen::priv::eth_dev* eth_dev;
+        gen::priv::flows_balancer* balancer;
+        gen::priv::tx_stage* tx_stage;
+        gen::priv::templates_loader* loader;
+        const gen::priv::templates_library* library;
+        mgmt::out_messages_queue* inc_queue;
+        mgmt::inc_messages_queue* out_queue;
+    };
+
+public:
+    explicit worker_impl(const config&);
+    ~worker_impl() noexcept override = default;
+
+    worker_impl()                              = delete;
+    worker_impl(worker_impl&&)                 = delete;
+    worker_impl(const worker_impl&)            = delete;
+    worker_impl& operator=(worker_impl&&)      = delete;
+    worker_impl& operator=(const worker_impl&) = delete;
+
+    // The packets which a worker may have sent but not yet freed: the ones
+    // which wait for a full burst, the ones in the ring and the pending burst
+    // of the transmission stage and the ones in the TX descriptors.
+    static uint64_t max_pkts_in_flight(uint16_t nic_queue_size,
+                                       bool tx_pipeline) noexcept
+    {
+        return (cnt_burst_pkts * 2) +
+               (tx_pipeline ? (gen::priv::tx_stage::ring_size +
+                               gen::priv::tx_stage::cnt_burst_pkts)
+                            : 0) +
+               nic_queue_size;
+    }
 
     void process_events() noexcept;
 
@@ -61,48 +205,68 @@ private:
     void on_inc_msg(mgmt::req_stats_report&&) noexcept;
 
     mgmt::stats get_eth_stats() noexcept;
+    std::vector<mgmt::summary_stats::pipeline_entry> get_tx_stats() noexcept;
 
+    void start_generation() noexcept;
     void stop_generation() noexcept;
     bool generation_started() const noexcept { return !!gen_cycles_; }
 
+    void receive_flows() noexcept;
+    void balance_flows() noexcept;
+    void handover_flows(uint32_t to_idx) noexcept;
+
 private:
     void transmit_tx_pkts() noexcept;
     void receive_rx_pkts() noexcept;
 
 private: // The `generation_ops` interface
-    rte_mbuf* alloc_mbuf() noexcept override;
-    rte_mbuf* copy_pkt(const rte_mbuf*) noexcept override;
-    void send_pkt(rte_mbuf*) noexcept override;
+    void copy_pkts(std::span<const gen::priv::pkt_segs>,
+                   rte_mbuf**) noexcept override;
+    void send_pkts(std::span<rte_mbuf* const>) noexcept override;
     gen::priv::event_handle create_scheduler_event() noexcept override;
-    void do_report(const gen::priv::generation_report&) noexcept override;
+    gen::priv::event_block
+    create_scheduler_events(uint32_t cnt) noexcept override;
+    void do_reports(
+        std::span<const gen::priv::generation_report>) noexcept override;
+    void do_reports(
+        std::span<const gen::priv::generation_report6>) noexcept override;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
 
-manager_impl::manager_impl(const config_type& cfg)
-: mbuf_pool_({.cnt_mbufs = cfg.max_cnt_mbufs, .socket_id = rte_socket_id()})
-, eth_dev_({.port_id    = nic_port_id,
-            .queue_size = cfg.nic_queue_size,
-            .socket_id  = rte_socket_id(),
-            .mempool    = mbuf_pool_.pool()})
+worker_impl::worker_impl(const config& cfg)
+: idx_(cfg.idx)
+, cnt_workers_(cfg.cnt_workers)
+, queue_id_(cfg.idx)
+, max_variant_refs_(cfg.max_variant_refs)
+, mbuf_pool_(cfg.mbuf_pool)
+, eth_dev_(cfg.eth_dev)
+, balancer_(cfg.balancer)
+, tx_stage_(cfg.tx_stage)
+, loader_(cfg.loader)
+, library_(cfg.library)
 , inc_queue_(cfg.inc_queue)
 , out_queue_(cfg.out_queue)
 , working_dir_(cfg.working_dir)
 {
-    tx_pkts_.reserve(cnt_burst_pkts);
-    TG_LOG_INFO("Constructed the generation manager with working dir: {}\n",
-                working_dir_);
+    // The packets are sent in batches which may be up to a burst long and
+    // they are transmitted once there is a full burst.
+    tx_pkts_.reserve(cnt_burst_pkts * 2);
 }
 
-void manager_impl::process_events() noexcept
+void worker_impl::process_events() noexcept
 {
     // We need to receive management messages even if the generation is not
     // started.
     inc_queue_->dequeue([this](auto&& msg) { on_inc_msg(std::move(msg)); });
 
+    // The generation starts as soon as its packet templates are loaded.
+    if (pending_ && pending_->batch->is_done()) start_generation();
+
     // There could be packets which we may need to receive and throw away just
-    // to keep the queue empty.
-    receive_rx_pkts();
+    // to keep the queue empty. The transmission stage does this in the
+    // pipeline mode.
+    if (!tx_stage_) receive_rx_pkts();
 
     // If the generation is not started no functionality should need timers and
     // as a result no functionality should generate packets for transmission.
@@ -121,8 +285,14 @@ void manager_impl::process_events() noexcept
         return;
     }
 
-    // This call may generate packets for transmission and statistics
+    // These calls may generate packets for transmission and statistics
     scheduler_.process_events();
+    for (auto& gen : generators_) gen.process_schedule();
+
+    if (balance_) {
+        receive_flows();
+        balance_flows();
+    }
 
     // We need to transmit the packets which have been enqueued for sending
     // during this cycle of `process_events`. We need to keep the latency as
@@ -130,78 +300,263 @@ void manager_impl::process_events() noexcept
     if (!tx_pkts_.empty()) transmit_tx_pkts();
 }
 
-void manager_impl::on_inc_msg(mgmt::req_start_generation&& msg) noexcept
+void worker_impl::on_inc_msg(mgmt::req_start_generation&& msg) noexcept
 {
-    TG_LOG_INFO(
-        "Got request to start generation for {} with {} capture files\n",
-        msg.cfg->duration(), msg.cfg->flows_configs().size());
-    if (generation_started()) {
-        TG_LOG_INFO("Generation already started\n");
+    TG_LOG_INFO("Worker {} got request to start generation for {} with {} "
+                "capture files\n",
+                idx_, msg.cfg->duration(), msg.cfg->flows_configs().size());
+    // The epoch comes with the request so that a worker which has missed
+    // some requests catches up with the others regardless of the outcome of
+    // the request.
+    epoch_ = msg.epoch;
+    if (generation_started() || pending_) {
+        TG_LOG_INFO("Worker {} generation already started\n", idx_);
         out_queue_->enqueue(
             mgmt::res_start_generation{.res = "Already started"});
         return;
     }
 
-    std::vector<flows_generator_type> gens;
-    gens.reserve(msg.cfg->flows_configs().size());
+    // The template packets are loaded by the loader threads and the
+    // generation starts once all of them are ready. Meanwhile the worker
+    // keeps serving its queues.
     try {
-        const auto cln_ether_addr = eth_dev_.get_mac_addr();
+        std::vector<flows_generator_type::config> gen_cfgs;
+        gen_cfgs.reserve(msg.cfg->flows_configs().size());
+        const auto cln_ether_addr = eth_dev_->get_mac_addr();
         for (auto idx = 0u; const auto& cap_cfg : msg.cfg->flows_configs()) {
-            gens.emplace_back(flows_generator_type::config{
-                .idx            = idx++,
-                .cap_fpath      = working_dir_ / cap_cfg.name,
-                .cln_ether_addr = cln_ether_addr,
-                .srv_ether_addr = msg.cfg->dut_address(),
-                .burst          = cap_cfg.burst,
-                .flows_per_sec  = cap_cfg.flows_per_sec,
-                .inter_pkts_gap = cap_cfg.inter_pkts_gap,
-                .cln_ip_addrs   = cap_cfg.cln_ips,
-                .srv_ip_addrs   = cap_cfg.srv_ips,
-                .cln_port       = cap_cfg.cln_port,
-                .gen_ops        = this,
+            // The flows of every capture are spread between the workers.
+            // Every worker has a generator for every capture, even without
+            // flows, so that it can take flows from the other workers.
+            // The tunneled packets need the outer checksum offload as well.
+            const bool hw_cksum =
+                cap_cfg.tunnel ? eth_dev_->has_tx_outer_cksum_offload()
+                               : eth_dev_->has_tx_cksum_offload();
+            gen_cfgs.push_back(flows_generator_type::config{
+                .idx                  = idx++,
+                .shard_idx            = idx_,
+                .shard_cnt            = cnt_workers_,
+                .cap_fpath            = working_dir_ / cap_cfg.name,
+                .templates            = {}, // set once loaded
+                .streamed             = cap_cfg.stream,
+                .stream               = {}, // set once loaded
+                .cln_ether_addr       = cln_ether_addr,
+                .srv_ether_addr       = msg.cfg->dut_address(),
+                .burst                = cap_cfg.burst,
+                .flows_per_sec        = cap_cfg.flows_per_sec,
+                .inter_pkts_gap       = cap_cfg.inter_pkts_gap,
+                .cln_addrs            = to_addr_space_cfg(cap_cfg, true),
+                .srv_addrs            = to_addr_space_cfg(cap_cfg, false),
+                .cln_ports            = cap_cfg.cln_ports,
+                .srv_ports            = cap_cfg.srv_ports,
+                .ports_policy         = to_gen_policy(cap_cfg.ports_policy),
+                .vlans                = cap_cfg.vlans,
+                .inner_vlans          = cap_cfg.inner_vlans,
+                .mpls_labels          = cap_cfg.mpls_labels,
+                .hw_vlans             = cap_cfg.inner_vlans
+                                            ? eth_dev_->has_tx_qinq_insert()
+                                            : eth_dev_->has_tx_vlan_insert(),
+                .tunnel               = to_gen_tunnel(cap_cfg.tunnel),
+                .precompiled_schedule = cap_cfg.precompiled_schedule,
+                .prerender_budget     = 0, // set upon start
+                .max_variant_refs     = 0, // set upon start
+                .sw_cksum             = !hw_cksum,
+                .isn_offsets          = cap_cfg.isn_offsets,
+                .gen_ops              = this,
             });
         }
+        std::vector<gen::priv::pkt_templates::config> tmpl_cfgs;
+        tmpl_cfgs.reserve(gen_cfgs.size());
+        for (const auto& cfg : gen_cfgs) {
+            tmpl_cfgs.push_back(flows_generator_type::templates_config(cfg));
+        }
+        auto batch = loader_->load(epoch_, std::move(tmpl_cfgs));
+        pending_.emplace(pending_start{
+            .epoch    = epoch_,
+            .cfg      = std::move(msg.cfg),
+            .gen_cfgs = std::move(gen_cfgs),
+            .batch    = std::move(batch),
+        });
     } catch (const std::exception& ex) {
-        TG_LOG_INFO("Failed to create flows generator: {}\n", ex.what());
+        TG_LOG_INFO("Worker {} failed to request the packet templates: {}\n",
+                    idx_, ex.what());
+        out_queue_->enqueue(mgmt::res_start_generation{.res = ex.what()});
+        return;
+    }
+    TG_LOG_INFO("Worker {} waits for the packet templates of {} captures\n",
+                idx_, pending_->gen_cfgs.size());
+}
+
+void worker_impl::start_generation() noexcept
+{
+    const auto pend = std::move(*pending_);
+    pending_.reset();
+    if (const auto err = pend.batch->error(); err) {
+        TG_LOG_INFO("Worker {} failed to load the packet templates: {}\n",
+                    idx_, *err);
+        out_queue_->enqueue(
+            mgmt::res_start_generation{.res = std::string(*err)});
+        return;
+    }
+    // The batch is shared by all workers and only the first one reports it
+    if (idx_ == 0) {
+        using source = gen::priv::templates_loader::source;
+        TG_LOG_INFO("Worker {} got the packet templates of {} captures from "
+                    "the library, {} from the cache and {} from the captures\n",
+                    idx_, pend.batch->cnt_from(source::library),
+                    pend.batch->cnt_from(source::cache),
+                    pend.batch->cnt_from(source::capture));
+        if (const auto err = pend.batch->cache_error(); err) {
+            TG_LOG_ERROR("Failed to store packet templates in the cache: {}\n",
+                         *err);
+        }
+    }
+
+    std::vector<flows_generator_type> gens;
+    gens.reserve(pend.gen_cfgs.size());
+    try {
+        // The flows of the event per flow mode take an event each and every
+        // generator may take one more. The events of the flows taken from
+        // other workers are allocated on demand.
+        size_t cnt_events = 0;
+        for (const auto& cfg : pend.gen_cfgs) {
+            cnt_events += (cfg.flows_per_sec / cnt_workers_) + 2;
+        }
+        if (!scheduler_.reserve_events(cnt_events)) {
+            put::throw_runtime_error("Failed to allocate {} events",
+                                     cnt_events);
+        }
+        // The budget for the pre-rendered packets is per worker and the
+        // generators take from it in the order of the captures.
+        // The captures with the same templates configuration may share the
+        // templates and thus the payload references are split between all
+        // generators.
+        size_t prerender_budget = pend.cfg->prerender_budget().value_or(0);
+        const auto max_variant_refs =
+            max_variant_refs_ / static_cast<uint32_t>(pend.gen_cfgs.size());
+        for (auto idx = 0u; auto cfg : pend.gen_cfgs) {
+            cfg.templates        = pend.batch->templates(idx);
+            cfg.stream           = pend.batch->stream(idx++);
+            cfg.prerender_budget = prerender_budget;
+            cfg.max_variant_refs = max_variant_refs;
+            const auto& gen      = gens.emplace_back(cfg);
+            prerender_budget    -= gen.prerendered_size();
+        }
+    } catch (const std::exception& ex) {
+        TG_LOG_INFO("Worker {} failed to create flows generator: {}\n", idx_,
+                    ex.what());
         out_queue_->enqueue(mgmt::res_start_generation{.res = ex.what()});
         return;
     }
 
     // TODO: Add debug log the prepared flows.
+    for (const auto& gen : gens) {
+        TG_LOG_INFO("Worker {} flows generator {} uses {} scheduling\n", idx_,
+                    gen.idx(), gen.schedule_mode());
+        if (const auto size = gen.prerendered_size(); size > 0) {
+            TG_LOG_INFO("Worker {} flows generator {} uses {} KB of "
+                        "pre-rendered packets\n",
+                        idx_, gen.idx(), size / 1024);
+        } else if (pend.cfg->prerender_budget() &&
+                   flows_generator_type::can_prerender(
+                       pend.gen_cfgs[gen.idx()])) {
+            TG_LOG_INFO("Worker {} flows generator {} packets don't fit in "
+                        "the pre-render budget and are rewritten per send\n",
+                        idx_, gen.idx());
+        }
+    }
 
     TG_ENFORCE(generators_.empty());
     generators_ = std::move(gens);
 
-    // Every generation run should report summary stats only from its own run
-    if (const int err = rte_eth_stats_reset(nic_port_id); err == 0) {
-        cnt_tx_pkts_qfull_  = 0;
-        cnt_tx_pkts_nombuf_ = 0;
-    } else {
-        TG_LOG_ERROR("Failed to reset the ethernet device stats: ({}) {}\n",
-                     -err, ::strerrordesc_np(-err));
+    // Every generation run should report summary stats only from its own run.
+    // The device stats are common for all workers and only the first worker
+    // resets and reports them.
+    cnt_tx_pkts_qfull_  = 0;
+    cnt_tx_pkts_nombuf_ = 0;
+    if (tx_stage_) tx_stats_beg_ = tx_stage_->take_stats();
+    if (idx_ == 0) {
+        if (const int err = rte_eth_stats_reset(nic_port_id); err != 0) {
+            TG_LOG_ERROR("Failed to reset the ethernet device stats: ({}) {}\n",
+                         -err, ::strerrordesc_np(-err));
+        }
     }
 
     TG_ENFORCE(!gen_cycles_);
     gen_cycles_.emplace(gen_cycles{
         .begin    = put::cycles::current(),
-        .duration = put::cycles::from_duration(msg.cfg->duration()),
+        .duration = put::cycles::from_duration(pend.cfg->duration()),
     });
 
-    TG_LOG_INFO("Generation started with {} flows generators\n",
-                generators_.size());
+    gen_epoch_ = pend.epoch;
+    if (const auto lag = pend.cfg->rebalance_lag(); lag) {
+        balance_.emplace(balance_state{
+            .max_lag    = put::cycles::from_duration(*lag),
+            .next_tsc   = gen_cycles_->begin,
+            .sent_error = {0},
+            .sent_cnt   = 0,
+        });
+    }
+
+    TG_LOG_INFO("Worker {} generation started with {} flows generators\n",
+                idx_, generators_.size());
 
     out_queue_->enqueue(mgmt::res_start_generation{});
 }
 
-void manager_impl::on_inc_msg(mgmt::req_stop_generation&&) noexcept
+void worker_impl::on_inc_msg(mgmt::req_stop_generation&& msg) noexcept
 {
     // The generation stop request is always fully processed so that the
     // summary stats can be reported via the response.
-    TG_LOG_INFO("Got request to stop generation\n");
+    TG_LOG_INFO("Worker {} got request to stop generation\n", idx_);
+
+    // All workers have responded to the failed start before its rollback and
+    // thus only its generation, not its pending start, can be here.
+    const bool rollback = (msg.rollback_epoch != 0);
+    if (rollback && (gen_epoch_ != msg.rollback_epoch)) {
+        TG_LOG_INFO("Worker {} has no generation from the failed start\n",
+                    idx_);
+        out_queue_->enqueue(mgmt::res_stop_generation{.rollback = true});
+        return;
+    }
+
+    // The start which waits for its templates is canceled. The templates are
+    // still loaded if other workers wait for them.
+    if (pending_) {
+        pending_.reset();
+        out_queue_->enqueue(mgmt::res_start_generation{
+            .res = "Stopped before the packet templates got loaded"});
+    }
 
     std::vector<mgmt::summary_stats::entry> detailed;
+    std::vector<mgmt::summary_stats::sched_entry> schedule;
     for (const auto& gen : generators_) {
-        for (const auto& flow : gen.flows()) {
+        const auto& err  = gen.schedule_error();
+        const auto& migr = gen.migration();
+        schedule.push_back({
+            .worker_idx    = idx_,
+            .gen_idx       = gen.idx(),
+            .cnt_pkts      = err.cnt,
+            .total_error   = err.total,
+            .max_error     = err.max,
+            .cnt_flows_in  = migr.cnt_flows_in,
+            .cnt_flows_out = migr.cnt_flows_out,
+        });
+        // Only the generator with the streamed flow uses the stream
+        if (gen.count_owned_flows() > 0) {
+            if (const auto cnt = gen.count_stream_stalls(); cnt > 0) {
+                TG_LOG_INFO("Worker {} flows generator {} waited {} times for "
+                            "its streamed packets\n",
+                            idx_, gen.idx(), cnt);
+            }
+            if (const auto serr = gen.stream_error(); serr) {
+                TG_LOG_ERROR("Worker {} flows generator {} stream failed: "
+                             "{}\n",
+                             idx_, gen.idx(), *serr);
+            }
+        }
+        // The flows which have been handed over are reported by the worker
+        // which owns them at the end.
+        gen.visit_owned_flows([&](const auto& flow) {
             detailed.push_back({
                 .gen_idx   = gen.idx(),
                 .flow_idx  = flow.idx,
@@ -209,104 +564,256 @@ void manager_impl::on_inc_msg(mgmt::req_stop_generation&&) noexcept
                 .cnt_bytes = flow.cnt_bytes,
                 .duration  = flow.tstamp_end - flow.tstamp_beg,
             });
-        }
+        });
     }
 
     stop_generation();
 
     out_queue_->enqueue(mgmt::res_stop_generation{
-        .res = {.summary = get_eth_stats(), .detailed = std::move(detailed)}});
+        .res      = {.summary  = get_eth_stats(),
+                     .detailed = std::move(detailed),
+                     .schedule = std::move(schedule),
+                     .pipeline = get_tx_stats()},
+        .rollback = rollback,
+    });
 }
 
-void manager_impl::on_inc_msg(mgmt::req_stats_report&&) noexcept
+void worker_impl::on_inc_msg(mgmt::req_stats_report&&) noexcept
 {
     out_queue_->enqueue(mgmt::res_stats_report{.res = get_eth_stats()});
 }
 
-mgmt::stats manager_impl::get_eth_stats() noexcept
+mgmt::stats worker_impl::get_eth_stats() noexcept
 {
+    // The stats from all workers are summed by the management and thus the
+    // device and the templates library stats are reported only by the first
+    // worker.
     rte_eth_stats tmp = {};
-    rte_eth_stats_get(nic_port_id, &tmp);
+    gen::priv::templates_library::stats lib = {};
+    if (idx_ == 0) {
+        rte_eth_stats_get(nic_port_id, &tmp);
+        lib = library_->get_stats();
+    }
     return {
-        .cnt_rx_pkts        = tmp.ipackets,
-        .cnt_tx_pkts        = tmp.opackets,
-        .cnt_rx_bytes       = tmp.ibytes,
-        .cnt_tx_bytes       = tmp.obytes,
-        .cnt_rx_pkts_qfull  = tmp.imissed,
-        .cnt_rx_pkts_nombuf = tmp.rx_nombuf,
-        .cnt_tx_pkts_qfull  = cnt_tx_pkts_qfull_,
-        .cnt_tx_pkts_nombuf = cnt_tx_pkts_nombuf_,
-        .cnt_rx_pkts_err    = tmp.ierrors,
-        .cnt_tx_pkts_err    = tmp.oerrors,
+        .cnt_rx_pkts            = tmp.ipackets,
+        .cnt_tx_pkts            = tmp.opackets,
+        .cnt_rx_bytes           = tmp.ibytes,
+        .cnt_tx_bytes           = tmp.obytes,
+        .cnt_rx_pkts_qfull      = tmp.imissed,
+        .cnt_rx_pkts_nombuf     = tmp.rx_nombuf,
+        .cnt_tx_pkts_qfull      = cnt_tx_pkts_qfull_,
+        .cnt_tx_pkts_nombuf     = cnt_tx_pkts_nombuf_,
+        .cnt_rx_pkts_err        = tmp.ierrors,
+        .cnt_tx_pkts_err        = tmp.oerrors,
+        .cnt_tmpl_lib_hits      = lib.cnt_hits,
+        .cnt_tmpl_lib_misses    = lib.cnt_misses,
+        .cnt_tmpl_lib_evictions = lib.cnt_evictions,
+        .tmpl_lib_cnt_entries   = lib.cnt_entries,
+        .tmpl_lib_cnt_mbufs     = lib.cnt_mbufs,
+        .tmpl_lib_cnt_bytes     = lib.cnt_bytes,
     };
 }
 
-void manager_impl::stop_generation() noexcept
+std::vector<mgmt::summary_stats::pipeline_entry>
+worker_impl::get_tx_stats() noexcept
 {
-    generators_.clear();
+    if (!tx_stage_) return {};
+    const auto end         = tx_stage_->take_stats();
+    const auto& beg        = tx_stats_beg_;
+    const auto cnt_samples = end.cnt_samples - beg.cnt_samples;
+    const auto occupancy   = end.total_occupancy - beg.total_occupancy;
+    return {{
+        .worker_idx    = idx_,
+        .ring_size     = gen::priv::tx_stage::ring_size,
+        .avg_occupancy = cnt_samples ? (occupancy / cnt_samples) : 0,
+        .max_occupancy = end.max_occupancy,
+        .cnt_tx_busy   = end.cnt_tx_busy - beg.cnt_tx_busy,
+    }};
+}
+
+void worker_impl::stop_generation() noexcept
+{
+    // All events are returned to the scheduler at once instead of one by one
+    // from the destructors of the flows.
+    scheduler_.release_all([this] { generators_.clear(); });
 
-    // Removing the generators should automatically remove all registered timers
-    // because every generator should unregister its timers upon destruction.
     TG_ENFORCE(scheduler_.count_events() == 0);
 
     gen_cycles_.reset();
+    gen_epoch_ = 0;
+    balance_.reset();
+    // The other workers should stop handing over flows to this one.
+    balancer_->publish_load(idx_, 0, {0});
 
-    TG_LOG_INFO("Generation stopped\n");
+    TG_LOG_INFO("Worker {} generation stopped\n", idx_);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void manager_impl::transmit_tx_pkts() noexcept
+void worker_impl::receive_flows() noexcept
+{
+    balancer_->receive(idx_, [this](gen::priv::flows_balancer::handoff&& ho) {
+        // The hand over from a worker which has already processed a start
+        // request which this one hasn't yet is left for later.
+        if (ho.epoch > epoch_) return false;
+        // The hand overs from previous generations are thrown away.
+        if (ho.epoch != gen_epoch_) return true;
+        TG_ASSERT(ho.gen_idx < generators_.size());
+        generators_[ho.gen_idx].adopt_flow(ho.flow);
+        return true;
+    });
+}
+
+void worker_impl::balance_flows() noexcept
 {
-    const auto cnt = eth_dev_.transmit_pkts(tx_pkts_);
+    auto& bal      = *balance_;
+    const auto now = put::cycles::current();
+    if (now < bal.next_tsc) return;
+    bal.next_tsc = now + put::cycles::from_duration(balance_period);
+
+    // The lag is the average schedule error of the packets sent since the
+    // previous check.
+    put::cycles sent_error{0};
+    uint64_t sent_cnt = 0;
+    for (const auto& gen : generators_) {
+        sent_error += gen.schedule_error().total;
+        sent_cnt += gen.schedule_error().cnt;
+    }
+    const auto cnt = sent_cnt - bal.sent_cnt;
+    const put::cycles lag{cnt ? ((sent_error - bal.sent_error).num / cnt) : 0};
+    bal.sent_error = sent_error;
+    bal.sent_cnt   = sent_cnt;
+    balancer_->publish_load(idx_, gen_epoch_, lag);
+
+    if (lag <= bal.max_lag) return;
+    // The flows go only to a worker which is well below the threshold.
+    // Otherwise the flows may start bouncing between the workers.
+    const put::cycles target_lag{bal.max_lag.num / 2};
+    if (const auto to = balancer_->find_target(idx_, gen_epoch_, target_lag)) {
+        handover_flows(*to);
+    }
+}
+
+void worker_impl::handover_flows(uint32_t to_idx) noexcept
+{
+    using handoff_type = gen::priv::flows_balancer::handoff;
+    using state_type   = gen::priv::flows_generator::flow_state;
+    // No more flows than the free space in the ring are released and thus all
+    // of them are sent for sure.
+    size_t cnt_left = std::min(max_balance_flows,
+                               balancer_->count_free_slots(idx_, to_idx));
+    std::array<state_type, max_balance_flows> states;
+    std::array<handoff_type, max_balance_flows> hos;
+    for (auto& gen : generators_) {
+        if (cnt_left == 0) break;
+        if (!gen.can_release_flows() || (gen.count_owned_flows() == 0)) {
+            continue;
+        }
+        // Every generator gives away up to 1/8 of its flows at once.
+        const size_t cnt_gen =
+            std::min<size_t>(cnt_left, (gen.count_owned_flows() + 7) / 8);
+        const auto cnt = gen.release_flows({states.data(), cnt_gen});
+        for (size_t i = 0; i < cnt; ++i) {
+            hos[i] = {
+                .epoch   = gen_epoch_,
+                .gen_idx = gen.idx(),
+                .flow    = states[i],
+            };
+        }
+        [[maybe_unused]] const auto cnt_sent =
+            balancer_->send(idx_, to_idx, {hos.data(), cnt});
+        TG_ASSERT(cnt_sent == cnt);
+        cnt_left -= cnt;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void worker_impl::transmit_tx_pkts() noexcept
+{
+    // In the pipeline mode the packets are dropped only if the ring to the
+    // transmission stage is full.
+    const auto cnt = tx_stage_ ? tx_stage_->enqueue_pkts(tx_pkts_)
+                               : eth_dev_->transmit_pkts(queue_id_, tx_pkts_);
     if (const auto cnt_all = tx_pkts_.size(); cnt_all > cnt) {
         const auto cnt_drop = cnt_all - cnt;
         rte_pktmbuf_free_bulk(&tx_pkts_[cnt], cnt_drop);
         cnt_tx_pkts_qfull_ += cnt_drop;
-        TG_LOG_ERROR("Dropped {} of {} on transmit\n", cnt_drop, cnt_all);
+        TG_LOG_ERROR("Worker {} dropped {} of {} on transmit\n", idx_,
+                     cnt_drop, cnt_all);
     }
     tx_pkts_.clear();
 }
 
-void manager_impl::receive_rx_pkts() noexcept
+void worker_impl::receive_rx_pkts() noexcept
 {
     // TODO: Further development
     // We need to detect which sent packets are not received back and
     // reflect this in the generated reports.
     rte_mbuf* pkts[cnt_burst_pkts];
-    if (const auto cnt = eth_dev_.receive_pkts(pkts); cnt > 0) {
+    if (const auto cnt = eth_dev_->receive_pkts(queue_id_, pkts); cnt > 0) {
         rte_pktmbuf_free_bulk(pkts, cnt);
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-rte_mbuf* manager_impl::alloc_mbuf() noexcept
+void worker_impl::copy_pkts(std::span<const gen::priv::pkt_segs> pkts,
+                             rte_mbuf** out) noexcept
 {
-    rte_mbuf* ret = rte_pktmbuf_alloc(mbuf_pool_.pool());
-    if (!ret) ++cnt_tx_pkts_nombuf_;
-    return ret;
+    // The header segment is always a single small mbuf and thus it's cheaper
+    // to copy it directly instead of using the generic `rte_pktmbuf_copy`.
+    // Every payload segment is attached to an indirect mbuf which only
+    // increments the reference count of the payload mbuf. The indirect mbufs
+    // are taken from the header pool because they don't use their own data
+    // room. All needed mbufs are allocated at once.
+    size_t cnt_mbufs = 0;
+    for (const auto& pkt : pkts) {
+        cnt_mbufs += 1 + (pkt.payload ? pkt.payload->nb_segs : 0);
+    }
+    copy_mbufs_.resize(cnt_mbufs);
+    if (rte_pktmbuf_alloc_bulk(mbuf_pool_->hdr_pool(), copy_mbufs_.data(),
+                               cnt_mbufs) != 0) {
+        cnt_tx_pkts_nombuf_ += pkts.size();
+        std::fill_n(out, pkts.size(), nullptr);
+        return;
+    }
+    for (rte_mbuf** mbufs = copy_mbufs_.data(); const auto& pkt : pkts) {
+        rte_mbuf* ret  = *mbufs++;
+        const auto len = rte_pktmbuf_data_len(pkt.hdr);
+        ::memcpy(rte_pktmbuf_append(ret, len),
+                 rte_pktmbuf_mtod(pkt.hdr, const char*), len);
+        for (rte_mbuf* seg = pkt.payload; seg; seg = seg->next) {
+            rte_mbuf* mi = *mbufs++;
+            rte_pktmbuf_attach(mi, seg);
+            // Can't fail because the copy has one segment more than the
+            // loaded packet.
+            [[maybe_unused]] const int err = rte_pktmbuf_chain(ret, mi);
+            TG_ASSERT(err == 0);
+        }
+        *out++ = ret;
+    }
 }
 
-rte_mbuf* manager_impl::copy_pkt(const rte_mbuf* pkt) noexcept
+void worker_impl::send_pkts(std::span<rte_mbuf* const> pkts) noexcept
 {
-    rte_mbuf* ret = rte_pktmbuf_copy(pkt, mbuf_pool_.pool(), 0, pkt->pkt_len);
-    if (!ret) ++cnt_tx_pkts_nombuf_;
-    return ret;
+    tx_pkts_.insert(tx_pkts_.end(), pkts.begin(), pkts.end());
+    if (tx_pkts_.size() >= cnt_burst_pkts) transmit_tx_pkts();
 }
 
-void manager_impl::send_pkt(rte_mbuf* pkt) noexcept
+gen::priv::event_handle worker_impl::create_scheduler_event() noexcept
 {
-    tx_pkts_.push_back(pkt);
-    if (tx_pkts_.size() == cnt_burst_pkts) transmit_tx_pkts();
+    return gen::priv::event_handle(&scheduler_);
 }
 
-gen::priv::event_handle manager_impl::create_scheduler_event() noexcept
+gen::priv::event_block
+worker_impl::create_scheduler_events(uint32_t cnt) noexcept
 {
-    return gen::priv::event_handle(&scheduler_);
+    return gen::priv::event_block(&scheduler_, cnt);
 }
 
-void manager_impl::do_report(const gen::priv::generation_report& r) noexcept
+void worker_impl::do_reports(
+    std::span<const gen::priv::generation_report> reports) noexcept
 {
     // There is some repeating work converting between
     // gen::priv::generation_report and mgmt::generation_report.
@@ -318,17 +825,141 @@ void manager_impl::do_report(const gen::priv::generation_report& r) noexcept
     // and `mgmt` modules is designed to be in single direction but they can
     // not be totally independent unless they both depend on another module
     // which exposes the types needed for communication between them.
-    out_queue_->enqueue(mgmt::generation_report{
-        .tstamp   = r.tstamp,
-        .gen_idx  = r.gen_idx,
-        .flow_idx = r.flow_idx,
-        .pkt_idx  = r.pkt_idx,
-        .pkt_len  = r.pkt_len,
-        .src_addr = r.src_addr,
-        .dst_addr = r.dst_addr,
-        .from_cln = r.from_cln,
-        .ok       = r.ok,
-    });
+    for (const auto& r : reports) {
+        out_queue_->enqueue(mgmt::generation_report{
+            .tstamp   = r.tstamp,
+            .gen_idx  = r.gen_idx,
+            .flow_idx = r.flow_idx,
+            .pkt_idx  = r.pkt_idx,
+            .pkt_len  = r.pkt_len,
+            .src_addr = r.src_addr,
+            .dst_addr = r.dst_addr,
+            .from_cln = r.from_cln,
+            .ok       = r.ok,
+        });
+    }
+}
+
+void worker_impl::do_reports(
+    std::span<const gen::priv::generation_report6> reports) noexcept
+{
+    for (const auto& r : reports) {
+        out_queue_->enqueue(mgmt::generation_report6{
+            .tstamp   = r.tstamp,
+            .gen_idx  = r.gen_idx,
+            .flow_idx = r.flow_idx,
+            .pkt_idx  = r.pkt_idx,
+            .pkt_len  = r.pkt_len,
+            .src_addr = r.addrs.src,
+            .dst_addr = r.addrs.dst,
+            .from_cln = r.from_cln,
+            .ok       = r.ok,
+        });
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+class manager_impl
+{
+    using config_type = manager::config;
+
+    gen::priv::mbuf_pool mbuf_pool_;
+    gen::priv::eth_dev eth_dev_;
+    gen::priv::flows_balancer balancer_;
+    gen::priv::templates_cache cache_;
+    gen::priv::templates_library library_;
+    gen::priv::templates_loader loader_;
+    // Every worker and stage is allocated separately in order to be in
+    // different cache lines than the others.
+    std::vector<std::unique_ptr<gen::priv::tx_stage>> tx_stages_;
+    std::vector<std::unique_ptr<worker_impl>> workers_;
+
+public:
+    explicit manager_impl(const config_type&);
+
+    void process_events(uint32_t worker_idx) noexcept
+    {
+        workers_[worker_idx]->process_events();
+    }
+    void process_tx_events(uint32_t worker_idx) noexcept
+    {
+        tx_stages_[worker_idx]->process_events();
+    }
+};
+
+manager_impl::manager_impl(const config_type& cfg)
+: mbuf_pool_({.cnt_mbufs = cfg.max_cnt_mbufs, .socket_id = rte_socket_id()})
+, eth_dev_({.port_id    = nic_port_id,
+            .cnt_queues = static_cast<uint16_t>(cfg.inc_queues.size()),
+            .queue_size = cfg.nic_queue_size,
+            .socket_id  = rte_socket_id(),
+            .mempool    = mbuf_pool_.pool()})
+, balancer_(static_cast<uint32_t>(cfg.inc_queues.size()))
+, cache_(cfg.templates_cache_dir)
+, library_((uint64_t(cfg.max_cnt_mbufs) *
+           std::min(cfg.templates_library_share, 100u)) /
+          100)
+, loader_({.cnt_threads = cfg.cnt_loader_threads,
+           .mbuf_pool   = &mbuf_pool_,
+           .cache       = &cache_,
+           .library     = &library_})
+{
+    TG_ENFORCE(cfg.inc_queues.size() == cfg.out_queues.size());
+    const auto cnt_workers = static_cast<uint32_t>(cfg.inc_queues.size());
+    // Every packet in flight holds a reference to the payload of its template
+    // and the templates are shared by all workers. The reference counters of
+    // the mbufs are 16 bits and they must not wrap around even if all packets
+    // in flight come from the same template. The pre-rendered packets take
+    // only the references which are left.
+    const uint64_t refs_in_flight =
+        cnt_workers *
+        worker_impl::max_pkts_in_flight(cfg.nic_queue_size, cfg.tx_pipeline);
+    if (refs_in_flight >= UINT16_MAX) {
+        put::throw_runtime_error(
+            "The {} workers may have up to {} packets in flight which is more "
+            "than the reference counters of the mbufs allow. Use fewer "
+            "workers or smaller NIC queues",
+            cnt_workers, refs_in_flight);
+    }
+    const auto max_variant_refs =
+        static_cast<uint32_t>(UINT16_MAX - refs_in_flight);
+    if (cfg.tx_pipeline) {
+        tx_stages_.reserve(cnt_workers);
+        for (uint32_t idx = 0; idx < cnt_workers; ++idx) {
+            tx_stages_.push_back(std::make_unique<gen::priv::tx_stage>(
+                gen::priv::tx_stage::config{
+                    .dev      = &eth_dev_,
+                    .queue_id = static_cast<uint16_t>(idx),
+                }));
+        }
+    }
+    workers_.reserve(cnt_workers);
+    for (uint32_t idx = 0; idx < cnt_workers; ++idx) {
+        workers_.push_back(std::make_unique<worker_impl>(worker_impl::config{
+            .idx              = idx,
+            .cnt_workers      = cnt_workers,
+            .max_variant_refs = max_variant_refs,
+            .working_dir      = cfg.working_dir,
+            .mbuf_pool        = &mbuf_pool_,
+            .eth_dev          = &eth_dev_,
+            .balancer         = &balancer_,
+            .tx_stage         = cfg.tx_pipeline ? tx_stages_[idx].get()
+                                                : nullptr,
+            .loader           = &loader_,
+            .library          = &library_,
+            .inc_queue        = &cfg.inc_queues[idx],
+            .out_queue        = &cfg.out_queues[idx],
+        }));
+    }
+    TG_LOG_INFO("Constructed the generation manager with {} workers, "
+                "{} loader threads, pipeline mode: {}, {} checksums, "
+                "working dir: {}, templates cache dir: {} and templates "
+                "library share: {}%\n",
+                cnt_workers, cfg.cnt_loader_threads, cfg.tx_pipeline,
+                eth_dev_.has_tx_cksum_offload() ? "hardware" : "software",
+                cfg.working_dir, cfg.templates_cache_dir,
+                cfg.templates_library_share);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -339,9 +970,14 @@ manager::manager(const config& cfg) : impl_(std::make_unique<manager_impl>(cfg))
 
 manager::~manager() noexcept = default;
 
-void manager::process_events() noexcept
+void manager::process_events(uint32_t worker_idx) noexcept
+{
+    impl_->process_events(worker_idx);
+}
+
+void manager::process_tx_events(uint32_t worker_idx) noexcept
 {
-    impl_->process_events();
+    impl_->process_tx_events(worker_idx);
 }
 
 } // namespace gen
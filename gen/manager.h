@@ -14,15 +14,28 @@ class manager
     std::unique_ptr<class manager_impl> impl_;
 
 public:
-    // The incoming queue for the management module is outgoing queue for us.
-    // And vice versa.
+    // The incoming queues for the management module are outgoing queues for
+    // us. And vice versa.
+    // There is one pair of queues per generation worker. Every worker runs on
+    // its own CPU core and works with its own NIC queue.
+    // In the pipeline mode every worker uses one more CPU core which does only
+    // the transmission of the packets prepared by the worker.
+    // The packets of the captures are loaded by separate threads which run on
+    // the CPU cores not used by the workers. The prepared packets are kept in
+    // the templates cache directory and reused by the next loads of the
+    // same captures. The templates of the recently used captures are also
+    // kept in the memory, in up to the given percent of the mbufs.
     struct config
     {
         stdfs::path working_dir;
+        stdfs::path templates_cache_dir;
+        uint32_t cnt_loader_threads;
+        uint32_t templates_library_share; // percent of max_cnt_mbufs
         uint32_t max_cnt_mbufs;
         uint16_t nic_queue_size;
-        mgmt::out_messages_queue* inc_queue;
-        mgmt::inc_messages_queue* out_queue;
+        bool tx_pipeline;
+        std::span<mgmt::out_messages_queue> inc_queues;
+        std::span<mgmt::inc_messages_queue> out_queues;
     };
 
 public:
@@ -35,7 +48,11 @@ public:
     manager& operator=(manager&&)      = delete;
     manager& operator=(const manager&) = delete;
 
-    void process_events() noexcept;
+    // Must be called only from the CPU core of the given worker.
+    void process_events(uint32_t worker_idx) noexcept;
+    // Must be called only from the transmission CPU core of the given worker
+    // and only in the pipeline mode.
+    void process_tx_events(uint32_t worker_idx) noexcept;
 };
 
 } // namespace gen
@@ -0,0 +1,87 @@
+#include "gen/priv/addr_space.h"
+
+#include "put/throw.h"
+
+namespace gen::priv
+{
+
+// Every IPv6 network is limited to so many addresses
+static constexpr uint64_t max_net6_addrs = 1ull << 32;
+
+// The first host address of the network and the count of its host addresses
+struct net_hosts
+{
+    put::uint128 first;
+    uint64_t cnt;
+};
+
+static net_hosts hosts_of(const baio_ip_net4& net) noexcept
+{
+    const auto hosts     = net.hosts();
+    const uint32_t first = (*hosts.begin()).to_uint();
+    return {.first = first, .cnt = (*hosts.end()).to_uint() - first};
+}
+
+static net_hosts hosts_of(const baio_ip_net6& net) noexcept
+{
+    put::uint128 first = 0;
+    for (const auto byte : net.network().to_bytes()) {
+        first = (first << 8) | byte;
+    }
+    // The first address of the network is the Subnet-Router anycast address
+    // and it's skipped, except for the point-to-point and single address
+    // networks.
+    const uint32_t host_bits = 128 - net.prefix_length();
+    if (host_bits <= 1) return {.first = first, .cnt = 1ull << host_bits};
+    const uint64_t cnt = (host_bits < 64) ? ((1ull << host_bits) - 1)
+                                          : UINT64_MAX;
+    return {.first = first + 1, .cnt = std::min(cnt, max_net6_addrs)};
+}
+
+addr_space::addr_space(const config& cfg)
+: cnt_addrs_(0), stride_(cfg.stride), ipv6_(cfg.is_ipv6())
+{
+    if (cfg.nets.empty() == cfg.nets6.empty()) {
+        put::throw_runtime_error(
+            "The addresses need either IPv4 or IPv6 networks");
+    }
+    auto add_net = [this](const auto& net) {
+        const auto [first, cnt] = hosts_of(net);
+        if (cnt == 0) {
+            put::throw_runtime_error("No host addresses in network {}",
+                                     net.to_string());
+        }
+        const put::uint128 last = first + (cnt - 1);
+        for (const auto& rng : nets_) {
+            const put::uint128 rng_last = rng.first + (rng.end - rng.beg - 1);
+            if ((first <= rng_last) && (rng.first <= last)) {
+                put::throw_runtime_error("The network {} overlaps with another "
+                                         "network of the same side",
+                                         net.to_string());
+            }
+        }
+        nets_.push_back(net_range{
+            .first = first,
+            .beg   = cnt_addrs_,
+            .end   = cnt_addrs_ + cnt,
+        });
+        cnt_addrs_ += cnt;
+    };
+    nets_.reserve(cfg.nets.size() + cfg.nets6.size());
+    for (const auto& net : cfg.nets) add_net(net);
+    for (const auto& net : cfg.nets6) add_net(net);
+    if (cfg.seed) {
+        perm_.emplace(cnt_addrs_, *cfg.seed);
+    } else if (std::gcd(stride_ % cnt_addrs_, cnt_addrs_) != 1) {
+        put::throw_runtime_error("The address stride {} must be coprime with "
+                                 "the count of the addresses {}",
+                                 stride_, cnt_addrs_);
+    }
+    stride_ %= cnt_addrs_;
+}
+
+addr_space::~addr_space() noexcept                       = default;
+addr_space::addr_space(addr_space&&) noexcept            = default;
+addr_space& addr_space::operator=(addr_space&&) noexcept = default;
+
+} // namespace gen::priv
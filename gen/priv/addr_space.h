@@ -0,0 +1,95 @@
+#pragma once
+
+#include "put/num_utils.h"
+#include "put/permutation.h"
+#include "put/tg_assert.h"
+
+namespace gen::priv
+{
+
+// The IPv4 or IPv6 addresses of one side, client or server, of the flows of
+// a capture. The addresses may come from several disjoint networks and they
+// are numbered one after another in the order of the networks.
+// The addresses are kept as 128 bit numbers for both IP versions. Every IPv6
+// network gives at most 2^32 addresses because the flows can't use more.
+// The address for a given sequence number is computed in O(1), without
+// walking the addresses, in one of the following orders:
+// - in order with a stride, i.e. the address with number `seq * stride`. The
+// stride must be coprime with the count of the addresses so that all of them
+// are used before the first one is used again.
+// - in a seeded pseudo random permutation of the addresses.
+// The random order spreads the consecutive flows over the whole address
+// space as the real traffic does, which matters for the hashing in the DUT.
+class addr_space
+{
+    // The addresses of every network take the numbers [beg, end).
+    struct net_range
+    {
+        put::uint128 first; // the first host address of the network
+        uint64_t beg;
+        uint64_t end;
+    };
+    std::vector<net_range> nets_;
+    uint64_t cnt_addrs_;
+    uint64_t stride_;
+    std::optional<put::feistel_permutation> perm_;
+    bool ipv6_;
+
+public:
+    // Only one of the vectors of networks may be non-empty
+    struct config
+    {
+        std::vector<baio_ip_net4> nets;
+        std::vector<baio_ip_net6> nets6;
+        uint32_t stride;              // used only for the in order addresses
+        std::optional<uint64_t> seed; // random order, if present
+
+        bool is_ipv6() const noexcept { return !nets6.empty(); }
+    };
+
+public:
+    explicit addr_space(const config&);
+    ~addr_space() noexcept;
+
+    addr_space(addr_space&&) noexcept;
+    addr_space& operator=(addr_space&&) noexcept;
+
+    addr_space()                             = delete;
+    addr_space(const addr_space&)            = delete;
+    addr_space& operator=(const addr_space&) = delete;
+
+    uint64_t size() const noexcept { return cnt_addrs_; }
+    bool is_ipv6() const noexcept { return ipv6_; }
+
+    // Return the address, in host byte order, for the given sequence number.
+    // The sequence wraps around after all addresses have been used.
+    uint32_t addr_at(uint64_t seq) const noexcept
+    {
+        TG_ASSERT(!ipv6_);
+        return static_cast<uint32_t>(addr_of(seq));
+    }
+    put::uint128 addr6_at(uint64_t seq) const noexcept
+    {
+        TG_ASSERT(ipv6_);
+        return addr_of(seq);
+    }
+
+private:
+    put::uint128 addr_of(uint64_t seq) const noexcept
+    {
+        uint64_t num = seq % cnt_addrs_;
+        // Both orders are bijections of the address numbers. The product of
+        // the address number and the stride doesn't fit in 64 bits when there
+        // are more than 2^32 addresses.
+        num = perm_ ? (*perm_)(num)
+                    : static_cast<uint64_t>((put::uint128(num) * stride_) %
+                                            cnt_addrs_);
+        // There is usually a single network or just a few of them and the
+        // linear search is faster than a binary one for them.
+        auto it = nets_.begin();
+        while (num >= it->end) ++it;
+        return it->first + (num - it->beg);
+    }
+};
+
+} // namespace gen::priv
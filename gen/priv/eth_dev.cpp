@@ -6,6 +6,12 @@
 namespace gen::priv
 {
 
+// The checksum offloads are used only if all of them are supported. Otherwise
+// the checksums are calculated in software.
+static constexpr uint64_t tx_cksum_offloads = RTE_ETH_TX_OFFLOAD_IPV4_CKSUM |
+                                              RTE_ETH_TX_OFFLOAD_TCP_CKSUM |
+                                              RTE_ETH_TX_OFFLOAD_UDP_CKSUM;
+
 eth_dev::eth_dev(config cfg)
 {
     const auto [dev_info, dev_conf] = set_capabilities(cfg);
@@ -17,7 +23,15 @@ eth_dev::eth_dev(config cfg)
     start(cfg);
 
     // Everything has been setup successfully. Mark the device as valid.
-    port_id_ = cfg.port_id;
+    port_id_          = cfg.port_id;
+    tx_cksum_offload_ = (dev_conf.txmode.offloads & tx_cksum_offloads) != 0;
+    tx_vlan_insert_ =
+        (dev_conf.txmode.offloads & RTE_ETH_TX_OFFLOAD_VLAN_INSERT) != 0;
+    tx_qinq_insert_ =
+        (dev_conf.txmode.offloads & RTE_ETH_TX_OFFLOAD_QINQ_INSERT) != 0;
+    tx_outer_cksum_ = tx_cksum_offload_ &&
+                      ((dev_conf.txmode.offloads &
+                        RTE_ETH_TX_OFFLOAD_OUTER_IPV4_CKSUM) != 0);
 }
 
 eth_dev::~eth_dev() noexcept
@@ -30,6 +44,10 @@ eth_dev::~eth_dev() noexcept
 
 eth_dev::eth_dev(eth_dev&& rhs) noexcept
 : port_id_(std::exchange(rhs.port_id_, invalid_port_id))
+, tx_cksum_offload_(std::exchange(rhs.tx_cksum_offload_, false))
+, tx_vlan_insert_(std::exchange(rhs.tx_vlan_insert_, false))
+, tx_qinq_insert_(std::exchange(rhs.tx_qinq_insert_, false))
+, tx_outer_cksum_(std::exchange(rhs.tx_outer_cksum_, false))
 {
 }
 
@@ -38,6 +56,10 @@ eth_dev& eth_dev::operator=(eth_dev&& rhs) noexcept
     using std::swap;
     eth_dev tmp(std::move(rhs));
     swap(port_id_, tmp.port_id_);
+    swap(tx_cksum_offload_, tmp.tx_cksum_offload_);
+    swap(tx_vlan_insert_, tmp.tx_vlan_insert_);
+    swap(tx_qinq_insert_, tmp.tx_qinq_insert_);
+    swap(tx_outer_cksum_, tmp.tx_outer_cksum_);
     return *this;
 }
 
@@ -82,35 +104,38 @@ eth_dev::set_capabilities(const config& cfg)
             "Failed to initialize DPDK port {}. Failed to get device info",
             cfg.port_id);
     }
+    // The received packets are only counted and freed. The Rx checksum
+    // offload is used if available but it's not required.
     if (check_capa(dev_info.rx_offload_capa, RTE_ETH_RX_OFFLOAD_CHECKSUM)) {
         dev_conf.rxmode.offloads |= RTE_ETH_RX_OFFLOAD_CHECKSUM;
-    } else {
-        put::throw_runtime_error("Failed to initialize DPDK port {}. No "
-                                 "support for Rx checksum offload",
-                                 cfg.port_id);
     }
-    if (check_capa(dev_info.tx_offload_capa, RTE_ETH_TX_OFFLOAD_IPV4_CKSUM)) {
-        dev_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_IPV4_CKSUM;
-    } else {
-        put::throw_runtime_error("Failed to initialize DPDK port {}. No "
-                                 "support for Tx IPv4 checksum offload",
-                                 cfg.port_id);
+    // Many virtual and cheap devices, e.g. virtio, af_packet, net_ring, can't
+    // calculate the checksums of the transmitted packets. The generator
+    // updates the checksums in software for such devices.
+    if (check_capa(dev_info.tx_offload_capa, tx_cksum_offloads)) {
+        dev_conf.txmode.offloads |= tx_cksum_offloads;
+    }
+    // The VLAN tags are inserted in software if the NIC can't do it. The
+    // same is valid for the outer checksum of the tunneled packets.
+    for (const uint64_t flag : {RTE_ETH_TX_OFFLOAD_VLAN_INSERT,
+                                RTE_ETH_TX_OFFLOAD_QINQ_INSERT,
+                                RTE_ETH_TX_OFFLOAD_OUTER_IPV4_CKSUM}) {
+        if (check_capa(dev_info.tx_offload_capa, flag)) {
+            dev_conf.txmode.offloads |= flag;
+        }
     }
-    if (auto capa = RTE_ETH_TX_OFFLOAD_TCP_CKSUM | RTE_ETH_TX_OFFLOAD_UDP_CKSUM;
-        check_capa(dev_info.tx_offload_capa, capa)) {
-        dev_conf.txmode.offloads |= capa;
+    // The transmitted packets consist of a header segment and an attached
+    // payload segment. Note that the fast release of mbufs optimization,
+    // RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE, is not possible because the segments
+    // of the transmitted packets come from different memory pools and the
+    // payload segments have reference count bigger than 1.
+    if (check_capa(dev_info.tx_offload_capa, RTE_ETH_TX_OFFLOAD_MULTI_SEGS)) {
+        dev_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_MULTI_SEGS;
     } else {
         put::throw_runtime_error("Failed to initialize DPDK port {}. No "
-                                 "support for Tx TCP/UDP checksum offload",
+                                 "support for Tx multi-segment packets",
                                  cfg.port_id);
     }
-    // An optimization for fast release of mbufs.
-    // Possible when all mbufs enqueued to given TX queue come from the same
-    // memory pool and have reference count of 1.
-    if (check_capa(dev_info.tx_offload_capa,
-                   RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE)) {
-        dev_conf.txmode.offloads |= RTE_ETH_TX_OFFLOAD_MBUF_FAST_FREE;
-    }
 
     return {dev_info, dev_conf};
 }
@@ -119,6 +144,15 @@ void eth_dev::configure(const config& cfg,
                         const rte_eth_dev_info& dev_info,
                         const rte_eth_conf& dev_conf)
 {
+    const auto nqueues = cfg.cnt_queues;
+    if ((nqueues == 0) || (nqueues > dev_info.max_rx_queues) ||
+        (nqueues > dev_info.max_tx_queues)) {
+        put::throw_runtime_error(
+            "Failed to initialize DPDK port {}. Can't work with {} queues. "
+            "HW max Rx queues {}, max Tx queues {}",
+            cfg.port_id, nqueues, dev_info.max_rx_queues,
+            dev_info.max_tx_queues);
+    }
     if (rte_eth_dev_configure(cfg.port_id, nqueues, nqueues, &dev_conf) != 0) {
         put::throw_dpdk_error(
             rte_errno,
@@ -127,25 +161,28 @@ void eth_dev::configure(const config& cfg,
     }
     rte_eth_rxconf rxq_conf = dev_info.default_rxconf;
     rxq_conf.offloads       = dev_conf.rxmode.offloads;
-    if (rte_eth_rx_queue_setup(cfg.port_id, queue_id, cfg.queue_size,
-                               cfg.socket_id, &rxq_conf, cfg.mempool) != 0) {
-        const auto& lim = dev_info.rx_desc_lim;
-        put::throw_dpdk_error(
-            rte_errno,
-            "Failed to initialize DPDK port {}. Failed to setup Rx queue {} "
-            "with size {}. HW queue size range {}-{}",
-            cfg.port_id, queue_id, cfg.queue_size, lim.nb_min, lim.nb_max);
-    }
     rte_eth_txconf txq_conf = dev_info.default_txconf;
     txq_conf.offloads       = dev_conf.txmode.offloads;
-    if (rte_eth_tx_queue_setup(cfg.port_id, queue_id, cfg.queue_size,
-                               cfg.socket_id, &txq_conf) != 0) {
-        const auto& lim = dev_info.tx_desc_lim;
-        put::throw_dpdk_error(
-            rte_errno,
-            "Failed to initialize DPDK port {}. Failed to setup Tx queue {} "
-            "with size {}. HW queue size range {}-{}",
-            cfg.port_id, queue_id, cfg.queue_size, lim.nb_min, lim.nb_max);
+    for (uint16_t queue_id = 0; queue_id < nqueues; ++queue_id) {
+        if (rte_eth_rx_queue_setup(cfg.port_id, queue_id, cfg.queue_size,
+                                   cfg.socket_id, &rxq_conf,
+                                   cfg.mempool) != 0) {
+            const auto& lim = dev_info.rx_desc_lim;
+            put::throw_dpdk_error(
+                rte_errno,
+                "Failed to initialize DPDK port {}. Failed to setup Rx queue "
+                "{} with size {}. HW queue size range {}-{}",
+                cfg.port_id, queue_id, cfg.queue_size, lim.nb_min, lim.nb_max);
+        }
+        if (rte_eth_tx_queue_setup(cfg.port_id, queue_id, cfg.queue_size,
+                                   cfg.socket_id, &txq_conf) != 0) {
+            const auto& lim = dev_info.tx_desc_lim;
+            put::throw_dpdk_error(
+                rte_errno,
+                "Failed to initialize DPDK port {}. Failed to setup Tx queue "
+                "{} with size {}. HW queue size range {}-{}",
+                cfg.port_id, queue_id, cfg.queue_size, lim.nb_min, lim.nb_max);
+        }
     }
 }
 
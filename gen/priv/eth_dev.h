@@ -5,16 +5,19 @@ namespace gen::priv // generator
 
 class eth_dev
 {
-    static constexpr uint16_t queue_id        = 0;
-    static constexpr uint16_t nqueues         = 1;
     static constexpr uint16_t invalid_port_id = UINT16_MAX;
 
     uint16_t port_id_ = invalid_port_id;
+    bool tx_cksum_offload_ = false;
+    bool tx_vlan_insert_   = false;
+    bool tx_qinq_insert_   = false;
+    bool tx_outer_cksum_   = false;
 
 public:
     struct config
     {
         uint16_t port_id;
+        uint16_t cnt_queues; // the count of the Rx and of the Tx queues
         uint16_t queue_size;
         uint32_t socket_id;
         rte_mempool* mempool;
@@ -37,12 +40,24 @@ public:
 
     uint16_t port_id() const noexcept { return port_id_; }
     bool is_valid() const noexcept { return (port_id_ != invalid_port_id); }
+    // True if the NIC calculates the IPv4, TCP and UDP checksums of the
+    // transmitted packets. Otherwise they need to be calculated in software.
+    bool has_tx_cksum_offload() const noexcept { return tx_cksum_offload_; }
+    // True if the NIC inserts a single VLAN tag, or two VLAN tags for QinQ,
+    // in the transmitted packets. Otherwise the tags are put in software.
+    bool has_tx_vlan_insert() const noexcept { return tx_vlan_insert_; }
+    bool has_tx_qinq_insert() const noexcept { return tx_qinq_insert_; }
+    // True if the NIC calculates the outer IPv4 checksum of the tunneled
+    // packets. The checksums of such packets are calculated in software, all
+    // of them, if it can't.
+    bool has_tx_outer_cksum_offload() const noexcept { return tx_outer_cksum_; }
 
-    size_t receive_pkts(std::span<rte_mbuf*> into) noexcept
+    // Every queue must be used only from single thread.
+    size_t receive_pkts(uint16_t queue_id, std::span<rte_mbuf*> into) noexcept
     {
         return rte_eth_rx_burst(port_id_, queue_id, into.data(), into.size());
     }
-    size_t transmit_pkts(std::span<rte_mbuf*> pkts) noexcept
+    size_t transmit_pkts(uint16_t queue_id, std::span<rte_mbuf*> pkts) noexcept
     {
         return rte_eth_tx_burst(port_id_, queue_id, pkts.data(), pkts.size());
     }
@@ -4,19 +4,23 @@
 namespace gen::priv
 {
 
+static_assert(std::is_same_v<event_handle::event_callback_type,
+                             event_scheduler::event_callback_type>);
+
 event_handle::event_handle() noexcept = default;
 
 event_handle::event_handle(event_scheduler* scheduler) noexcept
-: tmr_(scheduler->get_timer()), scheduler_(scheduler)
+: event_id_(scheduler->get_event()), scheduler_(scheduler)
 {
 }
 event_handle::~event_handle() noexcept
 {
-    if (tmr_) scheduler_->ret_timer(std::move(tmr_));
+    if (event_id_ != invalid_event_id) scheduler_->ret_event(event_id_);
 }
 
 event_handle::event_handle(event_handle&& rhs) noexcept
-: tmr_(std::move(rhs.tmr_)), scheduler_(std::exchange(rhs.scheduler_, nullptr))
+: event_id_(std::exchange(rhs.event_id_, invalid_event_id))
+, scheduler_(std::exchange(rhs.scheduler_, nullptr))
 {
 }
 
@@ -24,22 +28,84 @@ event_handle& event_handle::operator=(event_handle&& rhs) noexcept
 {
     using std::swap;
     auto tmp(std::move(rhs));
-    swap(tmp, *this);
+    swap(event_id_, tmp.event_id_);
+    swap(scheduler_, tmp.scheduler_);
     return *this;
 }
 
 void event_handle::schedule_single(put::cycles rel_time,
                                    event_callback_type cb,
-                                   void* ctx) noexcept
+                                   void* ctx,
+                                   uint32_t tag) noexcept
+{
+    scheduler_->schedule_single(event_id_, rel_time, cb, ctx, tag);
+}
+
+void event_handle::schedule_single_at(put::cycles abs_time,
+                                      event_callback_type cb,
+                                      void* ctx,
+                                      uint32_t tag) noexcept
 {
-    scheduler_->schedule_single(tmr_, rel_time, cb, ctx);
+    scheduler_->schedule_single_at(event_id_, abs_time, cb, ctx, tag);
 }
 
 void event_handle::schedule_periodic(put::cycles rel_time,
                                      event_callback_type cb,
-                                     void* ctx) noexcept
+                                     void* ctx,
+                                     uint32_t tag) noexcept
+{
+    scheduler_->schedule_periodic(event_id_, rel_time, cb, ctx, tag);
+}
+
+void event_handle::cancel() noexcept
+{
+    scheduler_->cancel(event_id_);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+event_block::event_block() noexcept = default;
+
+event_block::event_block(event_scheduler* scheduler, uint32_t cnt) noexcept
+: first_id_(scheduler->get_events(cnt)), cnt_(cnt), scheduler_(scheduler)
+{
+}
+event_block::~event_block() noexcept
+{
+    if (cnt_ > 0) scheduler_->ret_events(first_id_, cnt_);
+}
+
+event_block::event_block(event_block&& rhs) noexcept
+: first_id_(std::exchange(rhs.first_id_, invalid_event_id))
+, cnt_(std::exchange(rhs.cnt_, 0))
+, scheduler_(std::exchange(rhs.scheduler_, nullptr))
+{
+}
+
+event_block& event_block::operator=(event_block&& rhs) noexcept
+{
+    using std::swap;
+    auto tmp(std::move(rhs));
+    swap(first_id_, tmp.first_id_);
+    swap(cnt_, tmp.cnt_);
+    swap(scheduler_, tmp.scheduler_);
+    return *this;
+}
+
+void event_block::schedule_single_at(uint32_t idx,
+                                     put::cycles abs_time,
+                                     event_callback_type cb,
+                                     void* ctx,
+                                     uint32_t tag) noexcept
+{
+    TG_ASSERT(idx < cnt_);
+    scheduler_->schedule_single_at(first_id_ + idx, abs_time, cb, ctx, tag);
+}
+
+void event_block::cancel(uint32_t idx) noexcept
 {
-    scheduler_->schedule_periodic(tmr_, rel_time, cb, ctx);
+    TG_ASSERT(idx < cnt_);
+    scheduler_->cancel(first_id_ + idx);
 }
 
 } // namespace gen::priv
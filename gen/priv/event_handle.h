@@ -10,17 +10,15 @@ class event_scheduler;
 
 class event_handle
 {
-    // The `rte_timer` instance shouldn't be moved around once created because
-    // the DPDK `rte_timer` functions store pointers to this instance and every-
-    // thing will fall apart, if the timer instance is copied/moved/etc - UB!
-    // I could have made the `event_handle` class non-copy-able/move-able but
-    // this would have been too limiting for its users.
-    // Thus the only other option is heap allocation of the `rte_timer`.
-    std::unique_ptr<rte_timer> tmr_;
+    // The event itself is kept by the scheduler and the handle refers to it
+    // by its index. Thus the handle can be freely moved around.
+    static constexpr uint32_t invalid_event_id = UINT32_MAX;
+
+    uint32_t event_id_          = invalid_event_id;
     event_scheduler* scheduler_ = nullptr;
 
 public:
-    using event_callback_type = void (*)(rte_timer*, void*);
+    using event_callback_type = void (*)(void*, std::span<const uint32_t>);
 
 public:
     event_handle() noexcept;
@@ -36,8 +34,60 @@ public:
 
     // These functions schedule or re-schedule the event depending on its
     // current state.
-    void schedule_single(put::cycles, event_callback_type, void*) noexcept;
-    void schedule_periodic(put::cycles, event_callback_type, void*) noexcept;
+    // The `_at` function takes absolute time while the others take time
+    // relative to the current moment.
+    // The tag is passed back to the callback together with the context.
+    void schedule_single(put::cycles,
+                         event_callback_type,
+                         void* ctx,
+                         uint32_t tag = 0) noexcept;
+    void schedule_single_at(put::cycles,
+                            event_callback_type,
+                            void* ctx,
+                            uint32_t tag = 0) noexcept;
+    void schedule_periodic(put::cycles,
+                           event_callback_type,
+                           void* ctx,
+                           uint32_t tag = 0) noexcept;
+    // The event stays with the handle and it can be scheduled again.
+    void cancel() noexcept;
+};
+
+// Holds a block of consecutive events from the scheduler.
+// It's used when every element of an array needs its own event. The event of
+// an element is found by the index of the element and thus the elements
+// don't need to keep event handles.
+class event_block
+{
+    static constexpr uint32_t invalid_event_id = UINT32_MAX;
+
+    uint32_t first_id_          = invalid_event_id;
+    uint32_t cnt_               = 0;
+    event_scheduler* scheduler_ = nullptr;
+
+public:
+    using event_callback_type = event_handle::event_callback_type;
+
+public:
+    event_block() noexcept;
+
+    event_block(event_scheduler*, uint32_t cnt) noexcept;
+    ~event_block() noexcept;
+
+    event_block(event_block&&) noexcept;
+    event_block& operator=(event_block&&) noexcept;
+
+    event_block(const event_block&)            = delete;
+    event_block& operator=(const event_block&) = delete;
+
+    uint32_t size() const noexcept { return cnt_; }
+
+    void schedule_single_at(uint32_t idx,
+                            put::cycles,
+                            event_callback_type,
+                            void* ctx,
+                            uint32_t tag) noexcept;
+    void cancel(uint32_t idx) noexcept;
 };
 
 }; // namespace gen::priv
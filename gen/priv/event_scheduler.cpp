@@ -0,0 +1,204 @@
+#include "gen/priv/event_scheduler.h"
+
+namespace gen::priv
+{
+
+// The arena grows at least with so many events at once if it's not reserved
+// upfront.
+static constexpr uint32_t min_arena_growth = 1024;
+
+event_scheduler::event_scheduler() noexcept
+: cur_tick_(current_tick())
+{
+    slots_.fill(invalid_event_id);
+}
+
+event_scheduler::event_id_type event_scheduler::get_event() noexcept
+{
+    event_id_type id = free_head_;
+    if (id != invalid_event_id) {
+        free_head_ = events_[id].next;
+    } else {
+        // The arena may get reallocated here but this is fine because the
+        // events are referred only by their indices.
+        if (cnt_used_ == capacity_) {
+            const auto cnt = std::max(capacity_, min_arena_growth);
+            const bool ok  = reserve_events(size_t(capacity_) + cnt);
+            TG_ENFORCE(ok);
+        }
+        id = cnt_used_++;
+    }
+    init_event(id);
+    return id;
+}
+
+void event_scheduler::ret_event(event_id_type id) noexcept
+{
+    if (releasing_all_) return;
+    cancel(id);
+    events_[id].next = free_head_;
+    free_head_       = id;
+    --cnt_events_;
+}
+
+event_scheduler::event_id_type
+event_scheduler::get_events(uint32_t cnt) noexcept
+{
+    // The free events are scattered through the arena and the block can't be
+    // made from them.
+    if ((size_t(cnt_used_) + cnt) > capacity_) {
+        const auto grow = std::max({capacity_, cnt, min_arena_growth});
+        const bool ok   = reserve_events(size_t(capacity_) + grow);
+        TG_ENFORCE(ok);
+    }
+    const event_id_type first = cnt_used_;
+    cnt_used_ += cnt;
+    for (uint32_t i = 0; i < cnt; ++i) init_event(first + i);
+    return first;
+}
+
+void event_scheduler::ret_events(event_id_type first, uint32_t cnt) noexcept
+{
+    if (releasing_all_) return;
+    for (uint32_t i = 0; i < cnt; ++i) ret_event(first + i);
+}
+
+bool event_scheduler::reserve_events(size_t cnt) noexcept
+{
+    if (cnt <= capacity_) return true;
+    if (cnt >= invalid_event_id) return false;
+    // The events are trivially copyable and thus the arena can be reallocated
+    // directly. The memory comes from the NUMA node of the calling core.
+    constexpr unsigned align = 64;
+    auto* p = static_cast<event*>(rte_realloc_socket(
+        events_.get(), cnt * sizeof(event), align, rte_socket_id()));
+    if (!p) return false;
+    // The old memory is either reused or freed by the reallocation.
+    std::ignore = events_.release();
+    events_.reset(p);
+    capacity_ = static_cast<uint32_t>(cnt);
+    return true;
+}
+
+void event_scheduler::init_event(event_id_type id) noexcept
+{
+    events_[id] = event{
+        .expire = 0,
+        .period = 0,
+        .cb     = nullptr,
+        .ctx    = nullptr,
+        .tag    = 0,
+        .next   = invalid_event_id,
+        .prev   = invalid_event_id,
+        .slot   = no_slot,
+    };
+    ++cnt_events_;
+}
+
+void event_scheduler::process_tick() noexcept
+{
+    const uint64_t tick = ++cur_tick_;
+    // The events from the higher levels need to be moved to the lower levels
+    // when the index of the lower level wraps around. The higher levels are
+    // cascaded first so that their events can flow down through the levels.
+    uint32_t level = 1;
+    while ((level < cnt_levels) &&
+           ((tick & ((1ull << (slot_bits * level)) - 1)) == 0)) {
+        ++level;
+    }
+    while (--level > 0) cascade(level);
+
+    // The events are unlinked before their callbacks are called and thus the
+    // callbacks are free to re-schedule or cancel them. The periodic events
+    // are re-scheduled before the callbacks for the same reason. However,
+    // a callback must not cancel other events expired in the same tick
+    // because their contexts are already collected.
+    // The wheel moves forward if a callback schedules an event when there are
+    // no other pending events. The slot is not processed further in this case
+    // because it may contain only events placed relative to the new position.
+    auto& head = slots_[tick & slot_mask];
+    while ((head != invalid_event_id) && (cur_tick_ == tick)) {
+        expired_cbs_.clear();
+        expired_ctxs_.clear();
+        expired_tags_.clear();
+        while (head != invalid_event_id) {
+            const auto id = head;
+            unlink(id);
+            auto& ev = events_[id];
+            if (ev.period != 0) {
+                ev.expire += ev.period;
+                link(id, tick + 1);
+            }
+            expired_cbs_.push_back(ev.cb);
+            expired_ctxs_.push_back(ev.ctx);
+            expired_tags_.push_back(ev.tag);
+        }
+        // The consecutive events with the same callback and context are
+        // passed together.
+        const std::span<const uint32_t> tags = expired_tags_;
+        for (size_t beg = 0, end = 0; beg < tags.size(); beg = end) {
+            const auto cb   = expired_cbs_[beg];
+            void* const ctx = expired_ctxs_[beg];
+            while ((end < tags.size()) && (expired_cbs_[end] == cb) &&
+                   (expired_ctxs_[end] == ctx)) {
+                ++end;
+            }
+            cb(ctx, tags.subspan(beg, end - beg));
+        }
+    }
+}
+
+void event_scheduler::cascade(uint32_t level) noexcept
+{
+    const auto idx = (cur_tick_ >> (slot_bits * level)) & slot_mask;
+    auto& head     = slots_[(level * cnt_slots) + idx];
+    event_id_type id = std::exchange(head, invalid_event_id);
+    while (id != invalid_event_id) {
+        const auto next = events_[id].next;
+        // The events which expire at the current tick go to the slot which
+        // is going to be processed right after the cascading.
+        events_[id].slot = no_slot;
+        --cnt_pending_;
+        link(id, cur_tick_);
+        id = next;
+    }
+}
+
+void event_scheduler::link(event_id_type id, uint64_t min_tick) noexcept
+{
+    auto& ev = events_[id];
+    // The events already in the past are fired as soon as possible.
+    // The events too far in the future are placed in the last level and
+    // they'll be placed again to the correct slot when cascaded.
+    const uint64_t expire = std::max(ev.expire, min_tick);
+    const uint64_t delta  = std::min(expire - cur_tick_, max_delta - 1);
+    uint32_t level        = 0;
+    while (delta >= (1ull << (slot_bits * (level + 1)))) ++level;
+    const auto idx =
+        ((cur_tick_ + delta) >> (slot_bits * level)) & slot_mask;
+    const uint32_t slot = (level * cnt_slots) + idx;
+
+    ev.slot = slot;
+    ev.prev = invalid_event_id;
+    ev.next = slots_[slot];
+    if (ev.next != invalid_event_id) events_[ev.next].prev = id;
+    slots_[slot] = id;
+    ++cnt_pending_;
+}
+
+void event_scheduler::unlink(event_id_type id) noexcept
+{
+    auto& ev = events_[id];
+    if (ev.prev != invalid_event_id) {
+        events_[ev.prev].next = ev.next;
+    } else {
+        slots_[ev.slot] = ev.next;
+    }
+    if (ev.next != invalid_event_id) events_[ev.next].prev = ev.prev;
+    ev.slot = no_slot;
+    ev.next = invalid_event_id;
+    ev.prev = invalid_event_id;
+    --cnt_pending_;
+}
+
+} // namespace gen::priv
@@ -8,42 +8,93 @@
 namespace gen::priv
 {
 
+// Hierarchical timing wheel.
+// The DPDK `rte_timer` keeps the timers in a skip-list and thus inserting and
+// expiring a timer costs O(log n). It also requires every timer to live at
+// fixed address which leads to heap allocation per timer.
+// This scheduler keeps all events in a single arena and the wheel slots are
+// intrusive doubly linked lists of event indices. Thus scheduling, canceling
+// and expiring of an event are O(1) operations. The events which are far in
+// the future are kept in the higher levels of the wheel with coarser
+// granularity and they are cascaded to the lower levels as the time passes.
+// The arena is allocated from the DPDK memory on the NUMA node of the core
+// which uses the scheduler. It's kept between the generation runs and all
+// events can be returned to it at once.
 class event_scheduler
 {
-    // Specific timer data instance could have been used with
-    // rte_timer_data_alloc/rte_timer_data_dealloc but currently this is the
-    // only `rte_timer` based functionality and that's why the functionality
-    // uses the default timer data.
+public:
+    using event_id_type = uint32_t;
+    // All events which expire in the same tick and have the same callback and
+    // context are passed to it at once with their tags. The tag lets a single
+    // context, e.g. a table, have many events, e.g. one per table row.
+    using event_callback_type = void (*)(void*, std::span<const uint32_t>);
+
+    static constexpr event_id_type invalid_event_id = UINT32_MAX;
 
+private:
     // We need precision of 1 microsecond because:
     // - this is the precision of the PCAP timestamps
     // - this is the precision that we allow for the inter packet gaps
-    const put::cycles usec_cycles_ =
-        put::cycles::from_duration(stdcr::microseconds{1});
-    put::cycles prev_cycles_ = {0};
+    // Every tick of the wheel is 1 microsecond.
+    // The wheel with 4 levels of 256 slots covers 2^32 microseconds, i.e. more
+    // than an hour. The events which are further in the future are kept in
+    // the last slot of the highest level until they come in range.
+    static constexpr uint32_t slot_bits  = 8;
+    static constexpr uint32_t cnt_slots  = 1u << slot_bits;
+    static constexpr uint32_t slot_mask  = cnt_slots - 1;
+    static constexpr uint32_t cnt_levels = 4;
+    static constexpr uint64_t max_delta  = 1ull << (slot_bits * cnt_levels);
+    static constexpr uint32_t no_slot    = UINT32_MAX;
 
-    uint32_t cnt_timers_ = 0;
+    struct event
+    {
+        uint64_t expire; // in ticks
+        uint64_t period; // in ticks, 0 for single shot events
+        event_callback_type cb;
+        void* ctx;
+        uint32_t tag;
+        // The links in the slot list for the allocated events and in the free
+        // list for the free ones.
+        event_id_type next;
+        event_id_type prev;
+        uint32_t slot; // `no_slot` if the event is not scheduled
+    };
+    static_assert(std::is_trivially_copyable_v<event>);
 
-    const uint32_t lcore_id_ = rte_lcore_id();
+    struct arena_free
+    {
+        void operator()(event* p) const noexcept { rte_free(p); }
+    };
+    std::unique_ptr<event[], arena_free> events_;
+    uint32_t capacity_ = 0;
+    uint32_t cnt_used_ = 0; // the events after this one have never been used
+    std::array<event_id_type, cnt_levels * cnt_slots> slots_;
+    event_id_type free_head_ = invalid_event_id;
+    bool releasing_all_      = false;
 
-public:
-    // It's unfortunate that the event scheduling system details leak here
-    // with the first argument of the event callback.
-    // I could have hidden it behind another callback layer but this would have
-    // created another call indirection on every callback and ... here we are.
-    using event_callback_type = void (*)(rte_timer*, void*);
-    using timer_ptr_type      = std::unique_ptr<rte_timer>;
+    // The callbacks, contexts and tags of the events expired in the current
+    // tick. They are members only to avoid allocations on every tick.
+    std::vector<event_callback_type> expired_cbs_;
+    std::vector<void*> expired_ctxs_;
+    std::vector<uint32_t> expired_tags_;
+
+    const put::cycles usec_cycles_ =
+        put::cycles::from_duration(stdcr::microseconds{1});
+    // The last tick which has been processed
+    uint64_t cur_tick_;
+
+    uint32_t cnt_events_  = 0;
+    uint32_t cnt_pending_ = 0;
 
 public:
-    event_scheduler() noexcept { rte_timer_subsystem_init(); }
+    event_scheduler() noexcept;
     ~event_scheduler() noexcept
     {
-        // All timers should have been returned to the scheduler.
+        // All events should have been returned to the scheduler.
         // Assertion here would mean that there is an event handle which still
-        // holds a timer and pointer to the scheduler instance.
-        // It'd be an UB if the handle tries to use the timer/scheduler.
-        TG_ENFORCE(cnt_timers_ == 0);
-        rte_timer_subsystem_finalize();
+        // holds an event and pointer to the scheduler instance.
+        // It'd be an UB if the handle tries to use the event/scheduler.
+        TG_ENFORCE(cnt_events_ == 0);
     }
 
     event_scheduler(event_scheduler&&)                 = delete;
@@ -53,56 +104,115 @@ public:
 
     void process_events() noexcept
     {
-        if (const auto cycles = put::cycles::current();
-            (cycles - prev_cycles_) >= usec_cycles_) {
-            prev_cycles_ = cycles;
-            rte_timer_manage();
+        const uint64_t now = current_tick();
+        if (cnt_pending_ == 0) {
+            // Nothing to expire. Just jump to the current time.
+            if (cur_tick_ < now) cur_tick_ = now;
+            return;
         }
+        while ((cur_tick_ < now) && (cnt_pending_ > 0)) process_tick();
+        if (cur_tick_ < now) cur_tick_ = now;
     }
 
-    timer_ptr_type get_timer() noexcept
-    {
-        auto ret = std::make_unique<rte_timer>();
-        rte_timer_init(ret.get());
-        ++cnt_timers_;
-        return ret;
-    }
-    void ret_timer(timer_ptr_type&& tmr) noexcept
+    event_id_type get_event() noexcept;
+    void ret_event(event_id_type) noexcept;
+    // Takes a block of consecutive events and returns the first one.
+    // The block is taken from the never used part of the arena.
+    event_id_type get_events(uint32_t cnt) noexcept;
+    void ret_events(event_id_type first, uint32_t cnt) noexcept;
+
+    // Makes sure that so many events can be taken without allocations.
+    // Returns false if the memory can't be allocated.
+    bool reserve_events(size_t cnt) noexcept;
+    // Returns all events to the scheduler at once. The given function must
+    // destroy all handles which hold events from this scheduler and their
+    // destruction doesn't touch the events then. This way the events don't
+    // need to be unlinked and freed one by one.
+    template <typename Fn>
+    void release_all(Fn&& destroy_handles) noexcept
     {
-        int r = rte_timer_stop(tmr.get());
-        // Assertion here would mean that the event handle is incorrectly used.
-        // More likely destroying an event from the callback of another one.
-        TG_ENFORCE(r == 0);
-        tmr.reset();
-        --cnt_timers_;
+        releasing_all_ = true;
+        std::forward<Fn>(destroy_handles)();
+        releasing_all_ = false;
+        slots_.fill(invalid_event_id);
+        free_head_   = invalid_event_id;
+        cnt_used_    = 0;
+        cnt_events_  = 0;
+        cnt_pending_ = 0;
     }
 
     // These functions schedule or re-schedule the event depending on its
     // current state.
-    void schedule_single(timer_ptr_type& tmr,
+    void schedule_single(event_id_type id,
                          put::cycles rel_time,
                          event_callback_type cb,
-                         void* ctx) noexcept
+                         void* ctx,
+                         uint32_t tag) noexcept
     {
-        int r = rte_timer_reset(tmr.get(), rel_time.num, rte_timer_type::SINGLE,
-                                lcore_id_, cb, ctx);
-        // Assertion here would mean that the event handle is incorrectly used.
-        // More likely scheduling an event from the callback of another one.
-        TG_ENFORCE(r == 0);
+        schedule(id, put::cycles::current() + rel_time, {0}, cb, ctx, tag);
     }
-    void schedule_periodic(timer_ptr_type& tmr,
+    void schedule_single_at(event_id_type id,
+                            put::cycles abs_time,
+                            event_callback_type cb,
+                            void* ctx,
+                            uint32_t tag) noexcept
+    {
+        schedule(id, abs_time, {0}, cb, ctx, tag);
+    }
+    void schedule_periodic(event_id_type id,
                            put::cycles rel_time,
                            event_callback_type cb,
-                           void* ctx) noexcept
+                           void* ctx,
+                           uint32_t tag) noexcept
+    {
+        schedule(id, put::cycles::current() + rel_time, rel_time, cb, ctx,
+                 tag);
+    }
+    void cancel(event_id_type id) noexcept
+    {
+        if (events_[id].slot != no_slot) unlink(id);
+    }
+
+    size_t count_events() const noexcept { return cnt_events_; }
+    size_t count_pending_events() const noexcept { return cnt_pending_; }
+
+private:
+    uint64_t current_tick() const noexcept
+    {
+        return put::cycles::current().num / usec_cycles_.num;
+    }
+    uint64_t to_ticks(put::cycles cyc) const noexcept
+    {
+        // Rounded up so that an event never expires before its time.
+        return (cyc.num + usec_cycles_.num - 1) / usec_cycles_.num;
+    }
+
+    void schedule(event_id_type id,
+                  put::cycles abs_time,
+                  put::cycles period,
+                  event_callback_type cb,
+                  void* ctx,
+                  uint32_t tag) noexcept
     {
-        int r = rte_timer_reset(tmr.get(), rel_time.num,
-                                rte_timer_type::PERIODICAL, lcore_id_, cb, ctx);
-        // Assertion here would mean that the event handle is incorrectly used.
-        // More likely scheduling an event from the callback of another one.
-        TG_ENFORCE(r == 0);
+        // The wheel can be moved freely when there are no pending events.
+        // This avoids processing of all ticks since the last pending event.
+        if (cnt_pending_ == 0) cur_tick_ = std::max(cur_tick_, current_tick());
+        auto& ev  = events_[id];
+        ev.expire = to_ticks(abs_time);
+        ev.period = to_ticks(period);
+        ev.cb     = cb;
+        ev.ctx    = ctx;
+        ev.tag    = tag;
+        if (ev.slot != no_slot) unlink(id);
+        // The events with time in the past are fired on the next tick.
+        link(id, cur_tick_ + 1);
     }
 
-    size_t count_events() const noexcept { return cnt_timers_; }
+    void init_event(event_id_type) noexcept;
+    void process_tick() noexcept;
+    void cascade(uint32_t level) noexcept;
+    void link(event_id_type, uint64_t min_tick) noexcept;
+    void unlink(event_id_type) noexcept;
 };
 
 } // namespace gen::priv
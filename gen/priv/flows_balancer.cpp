@@ -0,0 +1,56 @@
+#include "gen/priv/flows_balancer.h"
+
+#include "put/tg_assert.h"
+
+namespace gen::priv
+{
+
+flows_balancer::flows_balancer(uint32_t cnt_workers)
+: cnt_workers_(cnt_workers)
+, loads_(std::make_unique<worker_load[]>(cnt_workers))
+, rings_(std::make_unique<ring_type[]>(cnt_workers * cnt_workers))
+{
+}
+
+flows_balancer::~flows_balancer() noexcept = default;
+
+void flows_balancer::publish_load(uint32_t worker_idx,
+                                  uint32_t epoch,
+                                  put::cycles lag) noexcept
+{
+    TG_ASSERT(worker_idx < cnt_workers_);
+    auto& load = loads_[worker_idx];
+    load.lag.store(lag.num, std::memory_order_relaxed);
+    load.epoch.store(epoch, std::memory_order_release);
+}
+
+std::optional<uint32_t>
+flows_balancer::find_target(uint32_t worker_idx,
+                            uint32_t epoch,
+                            put::cycles max_lag) const noexcept
+{
+    std::optional<uint32_t> ret;
+    uint64_t min_lag = max_lag.num;
+    for (uint32_t idx = 0; idx < cnt_workers_; ++idx) {
+        if (idx == worker_idx) continue;
+        const auto& load = loads_[idx];
+        if (load.epoch.load(std::memory_order_acquire) != epoch) continue;
+        if (const auto lag = load.lag.load(std::memory_order_relaxed);
+            lag < min_lag) {
+            min_lag = lag;
+            ret     = idx;
+        }
+    }
+    return ret;
+}
+
+size_t flows_balancer::send(uint32_t from_idx,
+                            uint32_t to_idx,
+                            std::span<const handoff> hos) noexcept
+{
+    TG_ASSERT((from_idx < cnt_workers_) && (to_idx < cnt_workers_));
+    auto& ring = rings_[(from_idx * cnt_workers_) + to_idx];
+    return ring.try_push(hos.data(), hos.size(), ring_type::do_copy);
+}
+
+} // namespace gen::priv
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "gen/priv/flows_generator.h"
+#include "put/spsc_ring.h"
+#include "put/time_utils.h"
+
+namespace gen::priv
+{
+
+// Moves flows between the generation workers at runtime.
+// Every worker publishes its current lag, i.e. how late its packets are sent,
+// and a worker whose lag goes over the threshold hands over some of its flows
+// to the worker with the smallest lag. There is a SPSC ring for every ordered
+// pair of workers and thus the hand over is lock-free.
+// The hand overs carry the epoch of the generation in which the flows were
+// released so that a flow never gets to a worker running another generation.
+class flows_balancer
+{
+public:
+    struct handoff
+    {
+        uint32_t epoch;
+        uint32_t gen_idx;
+        flows_generator::flow_state flow;
+    };
+
+private:
+    static constexpr size_t cache_line_size = 64;
+    static constexpr size_t ring_size       = 1024;
+    using ring_type = put::spsc_ring<handoff, ring_size>;
+
+    // Written only by the worker itself and read by the others.
+    struct alignas(cache_line_size) worker_load
+    {
+        std::atomic<uint32_t> epoch{0}; // 0 when the worker doesn't generate
+        std::atomic<uint64_t> lag{0};   // in cycles
+    };
+
+    uint32_t cnt_workers_;
+    std::unique_ptr<worker_load[]> loads_;
+    // The ring from worker `f` to worker `t` is at `f * cnt_workers_ + t`.
+    std::unique_ptr<ring_type[]> rings_;
+
+public:
+    explicit flows_balancer(uint32_t cnt_workers);
+    ~flows_balancer() noexcept;
+
+    flows_balancer()                                 = delete;
+    flows_balancer(flows_balancer&&)                 = delete;
+    flows_balancer(const flows_balancer&)            = delete;
+    flows_balancer& operator=(flows_balancer&&)      = delete;
+    flows_balancer& operator=(const flows_balancer&) = delete;
+
+    void publish_load(uint32_t worker_idx,
+                      uint32_t epoch,
+                      put::cycles lag) noexcept;
+
+    // Returns the worker, from the same generation epoch, with the smallest
+    // lag if it's below the given one.
+    std::optional<uint32_t> find_target(uint32_t worker_idx,
+                                        uint32_t epoch,
+                                        put::cycles max_lag) const noexcept;
+
+    // Must be called only from the sending worker. The free space can only
+    // grow until the next call to `send`.
+    size_t count_free_slots(uint32_t from_idx, uint32_t to_idx) const noexcept
+    {
+        return rings_[(from_idx * cnt_workers_) + to_idx].count_push_slots();
+    }
+    // Returns the number of the hand overs which fitted in the ring.
+    size_t send(uint32_t from_idx,
+                uint32_t to_idx,
+                std::span<const handoff>) noexcept;
+
+    // The function is called for the hand overs to the given worker and it
+    // returns false to leave the current hand over, and the ones after it, in
+    // the ring for later.
+    template <typename Fn>
+    void receive(uint32_t to_idx, Fn&& fn) noexcept
+    {
+        for (uint32_t from = 0; from < cnt_workers_; ++from) {
+            if (from == to_idx) continue;
+            auto& ring = rings_[(from * cnt_workers_) + to_idx];
+            while (ring.try_consume(fn)) {}
+        }
+    }
+};
+
+} // namespace gen::priv
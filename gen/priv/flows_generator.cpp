@@ -1,14 +1,32 @@
 #include "gen/priv/flows_generator.h"
 #include "gen/priv/generation_ops.h"
-#include "gen/priv/tcap_loader.h"
+#include "gen/priv/mbuf_pool.h"
+#include "gen/priv/pkt_stream.h"
 
-#include "put/pkt_utils.h"
+#include "put/num_utils.h"
 #include "put/tg_assert.h"
 #include "put/throw.h"
 
 namespace gen::priv
 {
 
+// The fixed inter packet gap mode uses a slot per tick for the duration of
+// a single flow run. The generator falls back to an event per flow if the
+// slots would take too much memory.
+static constexpr uint64_t max_ring_slots = 4 * 1024 * 1024;
+// The same is valid for the precompiled schedule table. Every packet of every
+// flow takes an entry in it.
+static constexpr uint64_t max_table_entries = 16 * 1024 * 1024;
+// How many entries ahead of the cursor to prefetch the flow state.
+static constexpr size_t table_prefetch_dist = 8;
+// The packets are sent in batches of limited size so that all temporary data
+// needed for a batch fits on the stack.
+static constexpr size_t max_batch_size = 64;
+// The flows handed over from other cores get their events in blocks.
+static constexpr uint32_t adopted_block_size = 1024;
+// The stalled streamed flow checks for its next packet so often.
+static constexpr stdcr::microseconds stream_poll_period{10};
+
 template <typename T>
 static bool inc_reset(T& val, T beg, T end) noexcept
 {
@@ -19,290 +37,982 @@ static bool inc_reset(T& val, T beg, T end) noexcept
     return false;
 }
 
-static std::vector<flows_generator::pkt>
-load_pkts(const flows_generator::config& cfg)
-{
-    std::vector<flows_generator::pkt> ret;
-    // The gap between flows with the same index i.e. when the same flow is
-    // restarted because its duration is shorter than the duration of the whole
-    // test. This may come from the generation config, if/when needed.
-    constexpr stdcr::milliseconds if_gap(100);
-    /*
-     * Load the packets and set the time-stamps as needed
-     * Note that every time-stamp is relative to the time-stamp of the previous
-     * packet. The time-stamp of the first packet is 0 and is relative to the
-     * time-stamp of the particular flow the packet is part of at the moment.
-     */
-    const auto ipg = cfg.inter_pkts_gap;
-    std::optional<stdcr::microseconds> ipg_tstamp;
-    if (ipg) ipg_tstamp = stdcr::microseconds{0};
-    std::optional<stdcr::microseconds> prev_tstamp; // For the relative time
-    auto alloc_mbuf = [ops = cfg.gen_ops] { return ops->alloc_mbuf(); };
-    for (gen::priv::tcap_loader tcap(cfg.cap_fpath);;) {
-        auto res = tcap.load_pkt(alloc_mbuf);
-        if (!res) {
-            if (tcap.is_eof()) break;
-            put::throw_system_error(
-                res.error(), "Failed to load packet from {}", cfg.cap_fpath);
-        }
-        auto& pk = res.value();
-        if (ipg_tstamp) {
-            pk.tstamp   = *ipg_tstamp;
-            *ipg_tstamp = *ipg_tstamp + *ipg;
+static put::l2_tags_layout
+tags_layout_of(const flows_generator::config& cfg) noexcept
+{
+    return {
+        .cnt_vlans = static_cast<uint8_t>(cfg.vlans.has_value() +
+                                          cfg.inner_vlans.has_value()),
+        .hw_vlans  = cfg.hw_vlans,
+        .mpls      = cfg.mpls_labels.has_value(),
+    };
+}
+
+// The outer headers of the tunnel follow the L2 tags
+static put::tunnel_layout
+tunnel_layout_of(const flows_generator::config& cfg) noexcept
+{
+    const auto tags_len = tags_layout_of(cfg).sw_len();
+    return {
+        .type         = cfg.tunnel ? cfg.tunnel->type : put::tunnel_type::none,
+        .outer_l2_len = static_cast<uint16_t>(RTE_ETHER_HDR_LEN + tags_len),
+        .hw_cksum     = !cfg.sw_cksum,
+    };
+}
+
+static stdcr::microseconds flows_step(size_t cnt_flows)
+{
+    // The flows need to be evenly spread through out the second
+    const stdcr::microseconds step{1'000'000 / cnt_flows};
+    if (step == stdcr::microseconds{0}) {
+        put::throw_runtime_error(
+            "Can't work with so many ({}) flows per second", cnt_flows);
+    }
+    return step;
+}
+
+// The values of the range, ports or tags, as the first one and their count,
+// if present. The count is 0 if the values aren't changed.
+template <typename T>
+static std::pair<uint32_t, uint32_t>
+range_of(const std::optional<std::pair<T, T>>& rng)
+{
+    if (!rng) return {0, 0};
+    TG_ENFORCE(rng->first <= rng->second);
+    return {rng->first, (rng->second - rng->first) + 1u};
+}
+
+// The least common multiple which saturates instead of overflowing
+static uint64_t lcm_sat(uint64_t a, uint64_t b) noexcept
+{
+    const uint64_t m = a / std::gcd(a, b);
+    return (m <= (UINT64_MAX / b)) ? (m * b) : UINT64_MAX;
+}
+
+// The count of the distinct tuples of client and server addresses and ports.
+// The paired ports move together with the addresses and all other policies
+// walk all pairs of ports for every pair of addresses. The tags and the
+// tunnel headers always move together with the addresses.
+static uint64_t count_tuples(const flows_generator::config& cfg,
+                             uint64_t cnt_pairs)
+{
+    const uint64_t cnt_cln = std::max(range_of(cfg.cln_ports).second, 1u);
+    const uint64_t cnt_srv = std::max(range_of(cfg.srv_ports).second, 1u);
+    uint64_t ret           = 0;
+    if (cfg.ports_policy == flows_generator::port_policy::paired) {
+        ret = lcm_sat(lcm_sat(cnt_pairs, cnt_cln), cnt_srv);
+    } else {
+        const uint64_t cnt_ports = cnt_cln * cnt_srv;
+        ret = (cnt_pairs <= (UINT64_MAX / cnt_ports)) ? (cnt_pairs * cnt_ports)
+                                                      : UINT64_MAX;
+    }
+    for (const uint32_t cnt : {range_of(cfg.vlans).second,
+                               range_of(cfg.inner_vlans).second,
+                               range_of(cfg.mpls_labels).second}) {
+        ret = lcm_sat(ret, std::max(cnt, 1u));
+    }
+    if (const auto& tnl = cfg.tunnel; tnl) {
+        const uint64_t cnt_outer_pairs =
+            lcm_sat(addr_space(tnl->cln_addrs).size(),
+                    addr_space(tnl->srv_addrs).size());
+        ret = lcm_sat(lcm_sat(ret, cnt_outer_pairs),
+                      std::max(range_of(tnl->ids).second, 1u));
+    }
+    return ret;
+}
+
+// The value of the range, tag or tunnel id, for the given address group.
+// It's 0 if there is no range.
+static uint32_t range_value(const std::pair<uint32_t, uint32_t>& rng,
+                            uint32_t grp) noexcept
+{
+    return (rng.second > 0) ? (rng.first + (grp % rng.second)) : 0;
+}
+
+static uint64_t addr_seq_wrap(const flows_generator::config& cfg,
+                              uint64_t cnt_tuples)
+{
+    // The sequence repeats once all tuples of addresses and ports have been
+    // used by all flows of a burst. It wraps around at 2^32 if the tuples are
+    // too many and then some tuples are skipped once every 2^32 flows.
+    TG_ENFORCE(cfg.burst >= 1);
+    return (cnt_tuples <= (UINT32_MAX / cfg.burst)) ? (cnt_tuples * cfg.burst)
+                                                    : (1ull << 32);
+}
+
+static std::optional<put::feistel_permutation>
+ports_perm(const flows_generator::config& cfg)
+{
+    if (cfg.ports_policy != flows_generator::port_policy::random) return {};
+    const uint64_t cnt_cln = std::max(range_of(cfg.cln_ports).second, 1u);
+    const uint64_t cnt_srv = std::max(range_of(cfg.srv_ports).second, 1u);
+    // All shards of the capture must use the same permutation.
+    return put::feistel_permutation(cnt_cln * cnt_srv, cfg.idx);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+flows_generator::flows_generator(const config& cfg)
+: tmpls_(cfg.templates)
+, pkts_(tmpls_ ? tmpls_->pkts() : std::span<const pkt>{})
+, pkts_bytes_(tmpls_ ? tmpls_->pkts_bytes() : std::span<const uint64_t>{})
+, stream_(cfg.stream)
+, gen_ops_(cfg.gen_ops)
+, idx_(cfg.idx)
+, shard_idx_(cfg.shard_idx)
+, shard_cnt_(cfg.shard_cnt)
+, flows_per_sec_(cfg.flows_per_sec)
+, flow_tsc_step_(put::cycles::from_duration(flows_step(cfg.flows_per_sec)))
+, start_tsc_{0}
+, burst_cnt_(cfg.burst)
+, cln_addrs_(cfg.cln_addrs)
+, srv_addrs_(cfg.srv_addrs)
+, cnt_addr_pairs_(std::lcm(cln_addrs_.size(), srv_addrs_.size()))
+, cln_port_first_(range_of(cfg.cln_ports).first)
+, cnt_cln_ports_(range_of(cfg.cln_ports).second)
+, srv_port_first_(range_of(cfg.srv_ports).first)
+, cnt_srv_ports_(range_of(cfg.srv_ports).second)
+, ports_policy_(cfg.ports_policy)
+, ports_perm_(ports_perm(cfg))
+, tags_layout_(tags_layout_of(cfg))
+, vlan_rngs_{range_of(cfg.vlans), range_of(cfg.inner_vlans)}
+, mpls_rng_(range_of(cfg.mpls_labels))
+, tunnel_layout_(tunnel_layout_of(cfg))
+, cnt_tuples_(count_tuples(cfg, cnt_addr_pairs_))
+, addr_seq_wrap_(addr_seq_wrap(cfg, cnt_tuples_))
+, isn_offsets_(cfg.isn_offsets)
+{
+    if (cln_addrs_.is_ipv6() != srv_addrs_.is_ipv6()) {
+        put::throw_runtime_error("The client and server addresses of {} are "
+                                 "of different IP versions",
+                                 cfg.cap_fpath);
+    }
+    if (const auto& tnl = cfg.tunnel; tnl) {
+        if (tnl->cln_addrs.is_ipv6() || tnl->srv_addrs.is_ipv6()) {
+            put::throw_runtime_error("The outer addresses of {} must be IPv4 "
+                                     "ones",
+                                     cfg.cap_fpath);
         }
-        if (!prev_tstamp) prev_tstamp = pk.tstamp;
-        using put::cycles;
-        ret.push_back(flows_generator::pkt{
-            .rel_tsc = cycles::from_duration(if_gap + pk.tstamp - *prev_tstamp),
-            .mbuf    = flows_generator::mbuf_ptr_type(pk.mbuf),
-            .from_cln = false, // Will be set later to a correct value
+        tunnel_.emplace(tunnel_state{
+            .cln_addrs = addr_space(tnl->cln_addrs),
+            .srv_addrs = addr_space(tnl->srv_addrs),
+            .ids       = range_of(tnl->ids),
+        });
+    }
+    if (stream_ && ((flows_per_sec_ != 1) || (burst_cnt_ != 1))) {
+        put::throw_runtime_error("The streamed capture {} must have a single "
+                                 "flow",
+                                 cfg.cap_fpath);
+    }
+    setup_flows();
+    setup_variants(cfg);
+    // The streamed packets aren't known upfront and thus the streamed flow
+    // always has its own event.
+    const bool precomputed =
+        !stream_ && ((cfg.precompiled_schedule && setup_sched_table()) ||
+                     setup_slot_ring(cfg));
+    if (!precomputed) {
+        own_events_ = gen_ops_->create_scheduler_events(cnt_own_);
+    }
+    // The send times are relative to the start until everything is set up.
+    start_tsc_ = put::cycles::current();
+    for (auto& fl : hot_) fl.next_tsc += start_tsc_;
+    if (table_) {
+        table_->period_tsc = start_tsc_;
+    } else if (ring_) {
+        ring_->next_tsc = start_tsc_ + ring_->tick_tsc;
+        ring_->event.schedule_single_at(ring_->next_tsc, on_ring_event, this);
+    } else {
+        for (uint32_t slot = 0; slot < cnt_own_; ++slot) schedule_flow(slot);
+    }
+}
+
+bool flows_generator::can_prerender(const config& cfg) noexcept
+{
+    // The pre-rendered packets are shared by all flows and they can't have
+    // per flow sequence numbers. The streamed packets aren't kept at all.
+    // The VLAN tags inserted by the NIC are taken from the fields of the
+    // mbuf and not from its data. These fields can't be set per send on the
+    // shared mbufs.
+    const auto tags_layout = tags_layout_of(cfg);
+    return !cfg.isn_offsets && !cfg.streamed &&
+           !(tags_layout.hw_vlans && (tags_layout.cnt_vlans > 0));
+}
+
+pkt_templates::config flows_generator::templates_config(const config& cfg)
+{
+    return {
+        .cap_fpath      = cfg.cap_fpath,
+        .cln_ether_addr = cfg.cln_ether_addr,
+        .srv_ether_addr = cfg.srv_ether_addr,
+        .inter_pkts_gap = cfg.inter_pkts_gap,
+        .ipv6           = cfg.cln_addrs.is_ipv6(),
+        .tags_layout    = tags_layout_of(cfg),
+        .tunnel_layout  = tunnel_layout_of(cfg),
+        .sw_cksum       = cfg.sw_cksum,
+        .stream         = cfg.streamed,
+    };
+}
+
+flows_generator::~flows_generator() noexcept                 = default;
+flows_generator::flows_generator(flows_generator&&) noexcept = default;
+flows_generator&
+flows_generator::operator=(flows_generator&&) noexcept = default;
+
+void flows_generator::setup_flows()
+{
+    TG_ENFORCE(shard_idx_ < shard_cnt_);
+    // The generator gets every `shard_cnt`-th flow starting from `shard_idx`.
+    // The indices of the flows are the same as if they were in single
+    // generator and they are used to calculate the start times and the
+    // addresses of the flows.
+    // Note that a shard may be left without flows. Such generator may still
+    // get flows from the other shards during the generation.
+    cnt_own_ = (shard_idx_ < flows_per_sec_)
+                   ? ((flows_per_sec_ - shard_idx_ - 1) / shard_cnt_) + 1
+                   : 0;
+    cnt_owned_ = cnt_own_;
+    hot_.reserve(cnt_own_);
+    for (uint32_t slot = 0; slot < cnt_own_; ++slot) {
+        const auto idx = flow_idx_of(slot);
+        hot_.push_back(flow_hot{
+            .next_tsc = put::cycles{idx * flow_tsc_step_.num} +
+                        first_rel_tsc(),
+            .pkt_idx  = 0, // always start from the 1st packet
+            .addr_seq = static_cast<uint32_t>(idx % addr_seq_wrap_),
         });
     }
-    /*
-     * Verify that we can work with the packets and change the fields
-     * that don't change during the generation
-     * The assumption is that the first packet is always from client to server.
-     * We need to make sure that the headers that we are going to change now or
-     * later are in the first segment of the packet.
-     */
-    for (std::optional<rte_ether_addr> cln_ether_addr; auto& pkt : ret) {
-        size_t offs = 0;
-        auto* eh = put::read_hdr_advance<rte_ether_hdr>(pkt.mbuf.get(), offs);
-        if (!eh) {
-            put::throw_runtime_error(
-                "Detected too short/fragmented packet from {}", cfg.cap_fpath);
+    cnt_runs_.resize(cnt_own_, 0);
+}
+
+void flows_generator::setup_variants(const config& cfg)
+{
+    if ((cfg.prerender_budget == 0) || !can_prerender(cfg)) return;
+    // Every variant takes a copy of the header segment and an indirect mbuf
+    // for every segment of the payload.
+    constexpr size_t mbuf_size = sizeof(rte_mbuf) + RTE_PKTMBUF_HEADROOM +
+                                 mbuf_pool::hdr_mbuf_data_size;
+    uint64_t cnt_mbufs = 0;
+    for (const auto& pkt : pkts_) {
+        cnt_mbufs += 1 + (pkt.payload ? pkt.payload->nb_segs : 0);
+    }
+    if ((cnt_mbufs > ((cfg.prerender_budget / mbuf_size) / cnt_tuples_)) ||
+        (cnt_tuples_ > (cfg.max_variant_refs / shard_cnt_))) {
+        return;
+    }
+
+    std::vector<mbuf_ptr_type> variants;
+    variants.reserve(cnt_tuples_ * pkts_.size());
+    const bool ipv6 = is_ipv6();
+    for (uint64_t grp = 0; grp < cnt_tuples_; ++grp) {
+        for (const auto& pkt : pkts_) {
+            const pkt_segs segs{.hdr     = pkt.hdr.get(),
+                                .payload = pkt.payload.get()};
+            rte_mbuf* mbuf = nullptr;
+            gen_ops_->copy_pkts({&segs, 1}, &mbuf);
+            // The generator works without variants if the pool is short.
+            if (!mbuf) return;
+            variants.emplace_back(mbuf);
+            const uint8_t from_cln   = pkt.from_cln;
+            const put::tx_meta* meta = &pkt.tx_meta;
+            const uint32_t ports     = l4_ports_of(uint32_t(grp), pkt);
+            uint32_t l4_ports;
+            put::select_l4_ports({&l4_ports, 1}, &ports, &from_cln);
+            const uint32_t* l4_ports_ptr = rewrite_ports() ? &l4_ports
+                                                           : nullptr;
+            if (ipv6) {
+                const put::uint128 cln = cln_addrs_.addr6_at(grp);
+                const put::uint128 srv = srv_addrs_.addr6_at(grp);
+                put::ipv6_addrs addrs;
+                put::select_ipv6_addrs({&addrs, 1}, &cln, &srv, &from_cln);
+                put::write_ipv6_hdrs({&mbuf, 1}, &addrs, &meta, l4_ports_ptr);
+            } else {
+                const uint32_t cln = cln_addrs_.addr_at(grp);
+                const uint32_t srv = srv_addrs_.addr_at(grp);
+                put::ipv4_addrs addrs;
+                put::select_ipv4_addrs({&addrs, 1}, &cln, &srv, &from_cln);
+                put::write_ipv4_hdrs({&mbuf, 1}, &addrs, &meta, l4_ports_ptr);
+            }
+            if (!tags_layout_.empty()) {
+                const put::l2_tags tags = l2_tags_of(uint32_t(grp));
+                put::write_l2_tags({&mbuf, 1}, &tags, tags_layout_);
+            }
+            if (tunnel_) {
+                const uint32_t cln = tunnel_->cln_addrs.addr_at(grp);
+                const uint32_t srv = tunnel_->srv_addrs.addr_at(grp);
+                const uint32_t id  = range_value(tunnel_->ids, uint32_t(grp));
+                put::ipv4_addrs addrs;
+                put::select_ipv4_addrs({&addrs, 1}, &cln, &srv, &from_cln);
+                put::write_tunnel_hdrs({&mbuf, 1}, &addrs, &id,
+                                       tunnel_layout_);
+            }
+        }
+    }
+    variants_      = std::move(variants);
+    variants_size_ = cnt_tuples_ * cnt_mbufs * mbuf_size;
+}
+
+bool flows_generator::setup_slot_ring(const config& cfg)
+{
+    if (!cfg.inter_pkts_gap || (cnt_own_ == 0)) return false;
+
+    // All offsets are in microseconds and the tick is the longest duration
+    // which divides all of them.
+    const uint64_t step = flows_step(flows_per_sec_).count();
+    const uint64_t ipg  = cfg.inter_pkts_gap->count();
+    const uint64_t gap  = stdcr::microseconds(pkt_templates::if_gap).count();
+    const uint64_t tick = std::gcd(std::gcd(step, ipg), gap);
+    // The duration of a single flow run including the gap before it.
+    const uint64_t cnt_slots   = (gap + ((pkts_.size() - 1) * ipg)) / tick;
+    const uint64_t cnt_entries = uint64_t(cnt_own_) * pkts_.size();
+    if ((cnt_slots > max_ring_slots) || (cnt_entries > UINT32_MAX)) {
+        return false;
+    }
+
+    const uint64_t tick_hz = tick * put::cycles::frequency_hz();
+    slot_ring ring{
+        .slots     = {},
+        .entries   = {},
+        .event     = gen_ops_->create_scheduler_event(),
+        .tick      = 1, // the tick 0 is the start moment
+        .slot      = (cnt_slots > 1) ? 1u : 0u,
+        .flow_step = step / tick,
+        .flow_gap  = gap / tick,
+        .warm_tick = 0, // will be set below
+        .tick_tsc  = put::cycles{tick_hz / 1'000'000},
+        .tick_rem  = tick_hz % 1'000'000,
+        .tick_err  = 0,
+        .next_tsc  = {}, // will be set upon start
+    };
+    auto start_of = [&](uint32_t f) {
+        return (flow_idx_of(f) * ring.flow_step) + ring.flow_gap;
+    };
+    ring.warm_tick = start_of(cnt_own_ - 1);
+    // The flow with index `i` sends its packet `p` in the tick
+    // `i * flow_step + flow_gap + p * ipg / tick` and then again after every
+    // `cnt_slots` ticks.
+    auto slot_of = [&, ipg_ticks = ipg / tick](uint32_t f, uint32_t p) {
+        return (start_of(f) + (p * ipg_ticks)) % cnt_slots;
+    };
+    // Counting sort of the (flow, packet) pairs by slot. It's stable and thus
+    // the packets of a flow which fall in the same slot keep their order.
+    ring.slots.resize(cnt_slots + 1, 0);
+    for (uint32_t f = 0; f < cnt_own_; ++f) {
+        for (uint32_t p = 0; p < pkts_.size(); ++p) {
+            ring.slots[slot_of(f, p) + 1] += 1;
         }
-        if (const auto proto = ben::big_to_native(eh->ether_type);
-            proto != RTE_ETHER_TYPE_IPV4) {
-            put::throw_runtime_error(
-                "Detected non IPv4 packet (proto: {}) from {}", proto,
-                cfg.cap_fpath);
+    }
+    std::partial_sum(ring.slots.begin(), ring.slots.end(), ring.slots.begin());
+    ring.entries.resize(cnt_entries);
+    std::vector<uint32_t> pos(ring.slots.begin(), ring.slots.end() - 1);
+    for (uint32_t f = 0; f < cnt_own_; ++f) {
+        for (uint32_t p = 0; p < pkts_.size(); ++p) {
+            ring.entries[pos[slot_of(f, p)]++] = {.flow_slot = f, .pkt_idx = p};
         }
-        auto* ih = put::read_hdr_advance<rte_ipv4_hdr>(pkt.mbuf.get(), offs);
-        if (!ih) {
-            put::throw_runtime_error(
-                "Detected too short/fragmented packet from {}", cfg.cap_fpath);
+    }
+
+    ring_.emplace(std::move(ring));
+    return true;
+}
+
+bool flows_generator::setup_sched_table()
+{
+    const uint64_t cnt_entries = uint64_t(cnt_own_) * pkts_.size();
+    if ((cnt_own_ == 0) || (cnt_entries > max_table_entries)) return false;
+
+    sched_table tbl{
+        .entries     = {},
+        .pkt_offsets = {},
+        .flow_step   = flow_tsc_step_,
+        .period      = {0},
+        .period_tsc  = {}, // will be set upon start
+        .round       = 0,
+        .warm_rounds = 0,
+        .cursor      = 0,
+    };
+    tbl.pkt_offsets.reserve(pkts_.size());
+    for (const auto& pkt : pkts_) {
+        tbl.period += pkt.rel_tsc;
+        tbl.pkt_offsets.push_back(tbl.period);
+    }
+    // The packet `p` of the flow with index `i` is sent at
+    // `i * flow_step + offset(p)` from the start and then again after every
+    // period.
+    auto first_time = [&](uint32_t f, uint32_t p) {
+        return (flow_idx_of(f) * tbl.flow_step.num) + tbl.pkt_offsets[p].num;
+    };
+    tbl.entries.reserve(cnt_entries);
+    for (uint32_t f = 0; f < cnt_own_; ++f) {
+        for (uint32_t p = 0; p < pkts_.size(); ++p) {
+            tbl.entries.push_back({
+                .tsc_offset = first_time(f, p) % tbl.period.num,
+                .flow_slot  = f,
+                .pkt_idx    = p,
+            });
         }
-        if (!cln_ether_addr) cln_ether_addr = eh->src_addr;
-        pkt.from_cln =
-            rte_is_same_ether_addr(&(*cln_ether_addr), &eh->src_addr);
-        if (pkt.from_cln) {
-            eh->src_addr = cfg.cln_ether_addr;
-            eh->dst_addr = cfg.srv_ether_addr;
+    }
+    // The packets of a flow with the same offset must keep their order.
+    std::ranges::sort(tbl.entries, [](const auto& lhs, const auto& rhs) {
+        return std::tie(lhs.tsc_offset, lhs.flow_slot, lhs.pkt_idx) <
+               std::tie(rhs.tsc_offset, rhs.flow_slot, rhs.pkt_idx);
+    });
+    const auto last_pkt = static_cast<uint32_t>(pkts_.size() - 1);
+    tbl.warm_rounds = (first_time(cnt_own_ - 1, last_pkt) / tbl.period.num) + 1;
+
+    table_.emplace(std::move(tbl));
+    return true;
+}
+
+put::cycles flows_generator::tstamp_beg_of(uint32_t slot) const noexcept
+{
+    if (slot >= cnt_own_) return adopted_[slot - cnt_own_].tstamp_beg;
+    return start_tsc_ + put::cycles{flow_idx_of(slot) * flow_tsc_step_.num} +
+           first_rel_tsc();
+}
+
+// The first packet of every run of a streamed capture has the gap between the
+// flows as relative timestamp, the same as the first template.
+put::cycles flows_generator::first_rel_tsc() const noexcept
+{
+    return stream_ ? put::cycles::from_duration(pkt_templates::if_gap)
+                   : pkts_[0].rel_tsc;
+}
+
+uint32_t flows_generator::l4_ports_of(uint32_t grp,
+                                      const pkt& pkt) const noexcept
+{
+    // The paired ports move together with the addresses. Otherwise all pairs
+    // of addresses are walked with the same ports before the ports change,
+    // in order or in a random permutation.
+    uint64_t cln_seq = grp;
+    uint64_t srv_seq = grp;
+    if (ports_policy_ != port_policy::paired) {
+        // The tuples may repeat the pairs of ports when there are tags.
+        const uint64_t cnt_port_pairs = uint64_t(std::max(cnt_cln_ports_, 1u)) *
+                                        std::max(cnt_srv_ports_, 1u);
+        uint64_t seq = (grp / cnt_addr_pairs_) % cnt_port_pairs;
+        if (ports_perm_) seq = (*ports_perm_)(seq);
+        cln_seq = seq;
+        srv_seq = seq / std::max(cnt_cln_ports_, 1u);
+    }
+    const uint32_t cln = (cnt_cln_ports_ > 0)
+                             ? (cln_port_first_ + (cln_seq % cnt_cln_ports_))
+                             : (pkt.l4_ports >> 16);
+    const uint32_t srv = (cnt_srv_ports_ > 0)
+                             ? (srv_port_first_ + (srv_seq % cnt_srv_ports_))
+                             : (pkt.l4_ports & 0xFFFF);
+    return (cln << 16) | srv;
+}
+
+put::l2_tags flows_generator::l2_tags_of(uint32_t grp) const noexcept
+{
+    return {
+        .vlans      = {static_cast<uint16_t>(range_value(vlan_rngs_[0], grp)),
+                       static_cast<uint16_t>(range_value(vlan_rngs_[1], grp))},
+        .mpls_label = range_value(mpls_rng_, grp),
+    };
+}
+
+// The offsets are derived from the index of the flow and the number of its
+// run. Thus they don't need to be kept and they go together with the flow
+// when it's handed over to another core.
+put::tcp_seq_deltas flows_generator::seq_deltas_of(uint32_t slot,
+                                                   bool from_cln) const noexcept
+{
+    const uint64_t key  = (uint64_t(idx_) << 56) ^
+                          (uint64_t(flow_idx_of(slot)) << 32) ^ cnt_runs_[slot];
+    const uint64_t offs = put::mix64(key);
+    const auto cln_off  = static_cast<uint32_t>(offs);
+    const auto srv_off  = static_cast<uint32_t>(offs >> 32);
+    return from_cln ? put::tcp_seq_deltas{.seq = cln_off, .ack = srv_off}
+                    : put::tcp_seq_deltas{.seq = srv_off, .ack = cln_off};
+}
+
+auto flows_generator::flow_info_of(uint32_t slot) const noexcept -> flow_info
+{
+    const auto& fl      = hot_[slot];
+    const uint64_t runs = cnt_runs_[slot];
+    const uint64_t cnt  = stream_ ? stream_->count_pkts() : pkts_.size();
+    flow_info ret{
+        .idx        = flow_idx_of(slot),
+        .cnt_pkts   = (runs * cnt) + fl.pkt_idx,
+        .cnt_bytes  = stream_ ? stream_bytes_
+                              : ((runs * pkts_bytes_.back()) +
+                                 pkts_bytes_[fl.pkt_idx]),
+        .tstamp_beg = tstamp_beg_of(slot),
+        .tstamp_end = {}, // will be set below
+    };
+    // The last sent packet is the one before the next one.
+    if (ret.cnt_pkts == 0) {
+        ret.tstamp_end = ret.tstamp_beg;
+    } else if (stream_) {
+        ret.tstamp_end = stream_last_tsc_;
+    } else {
+        ret.tstamp_end = fl.next_tsc - pkts_[fl.pkt_idx].rel_tsc;
+    }
+    if (const auto it = failed_.find(ret.idx); it != failed_.end()) {
+        ret.cnt_pkts -= it->second.cnt_pkts;
+        ret.cnt_bytes -= it->second.cnt_bytes;
+    }
+    return ret;
+}
+
+void flows_generator::schedule_flow(uint32_t slot) noexcept
+{
+    // The stalled streamed flow polls for its next packet instead.
+    const auto tsc =
+        stream_stalled_
+            ? (put::cycles::current() +
+               put::cycles::from_duration(stream_poll_period))
+            : hot_[slot].next_tsc;
+    if (slot < cnt_own_) {
+        own_events_.schedule_single_at(slot, tsc, on_event, this, slot);
+    } else {
+        const auto pos = slot - cnt_own_;
+        adopted_events_[pos / adopted_block_size].schedule_single_at(
+            pos % adopted_block_size, tsc, on_event, this, slot);
+    }
+}
+
+void flows_generator::cancel_flow(uint32_t slot) noexcept
+{
+    if (slot < cnt_own_) {
+        own_events_.cancel(slot);
+    } else {
+        const auto pos = slot - cnt_own_;
+        adopted_events_[pos / adopted_block_size].cancel(
+            pos % adopted_block_size);
+    }
+}
+
+void flows_generator::account_sched_error(put::cycles tstamp,
+                                          put::cycles due) noexcept
+{
+    // The event is never fired before its time but it may be fired later
+    // due to the granularity of the scheduler, the transmission of the
+    // packets, the processing of the management messages, etc.
+    const auto sched_err = tstamp - std::min(tstamp, due);
+    sched_err_.total += sched_err;
+    sched_err_.max = std::max(sched_err_.max, sched_err);
+    sched_err_.cnt += 1;
+}
+
+void flows_generator::send_flow_pkts(std::span<const uint32_t> slots,
+                                     put::cycles tstamp) noexcept
+{
+    TG_ASSERT(slots.size() <= max_batch_size);
+    const size_t cnt = slots.size();
+    std::array<pkt_segs, max_batch_size> segs;
+    std::array<rte_mbuf*, max_batch_size> mbufs;
+    std::array<generation_report, max_batch_size> reports;
+    std::array<uint32_t, max_batch_size> variants;
+    // The inputs of the batch rewrite of the headers. Only the addresses of
+    // the IP version of the generator are used.
+    std::array<uint32_t, max_batch_size> cln_addrs;
+    std::array<uint32_t, max_batch_size> srv_addrs;
+    std::array<put::uint128, max_batch_size> cln_addrs6;
+    std::array<put::uint128, max_batch_size> srv_addrs6;
+    std::array<uint8_t, max_batch_size> from_cln;
+    std::array<const put::tx_meta*, max_batch_size> metas;
+    std::array<put::ipv4_addrs, max_batch_size> addrs;
+    std::array<put::ipv6_addrs, max_batch_size> addrs6;
+    const bool ipv6 = is_ipv6();
+    std::array<put::tcp_seq_deltas, max_batch_size> seq_deltas;
+    std::array<uint32_t, max_batch_size> ports;
+    std::array<uint32_t, max_batch_size> l4_ports;
+    std::array<put::l2_tags, max_batch_size> tags;
+    std::array<uint32_t, max_batch_size> tnl_cln_addrs;
+    std::array<uint32_t, max_batch_size> tnl_srv_addrs;
+    std::array<uint32_t, max_batch_size> tnl_ids;
+    std::array<put::ipv4_addrs, max_batch_size> tnl_addrs;
+    // The packet and the addresses are taken for every flow and the flow is
+    // moved to its next packet right away because the same flow may be
+    // present more than once in the batch.
+    for (size_t i = 0; i < cnt; ++i) {
+        const auto slot = slots[i];
+        const auto& fl  = hot_[slot];
+        const auto& pkt = stream_ ? *stream_->current() : pkts_[fl.pkt_idx];
+        // The addresses are derived on every packet. The few divisions are
+        // cheaper than keeping the addresses in the flow table.
+        const uint32_t grp = fl.addr_seq / burst_cnt_;
+        if (ipv6) {
+            cln_addrs6[i] = cln_addrs_.addr6_at(grp);
+            srv_addrs6[i] = srv_addrs_.addr6_at(grp);
         } else {
-            eh->src_addr = cfg.srv_ether_addr;
-            eh->dst_addr = cfg.cln_ether_addr;
+            cln_addrs[i] = cln_addrs_.addr_at(grp);
+            srv_addrs[i] = srv_addrs_.addr_at(grp);
         }
-        // No need need to check/load the next headers if we are not going to
-        // change the port.
-        if (!cfg.cln_port) continue;
-        auto set_cport = [fc = pkt.from_cln, po = *cfg.cln_port](auto* hdr) {
-            if (fc)
-                hdr->src_port = ben::native_to_big(po);
-            else
-                hdr->dst_port = ben::native_to_big(po);
+        from_cln[i]  = pkt.from_cln;
+        metas[i]     = &pkt.tx_meta;
+        segs[i]      = {.hdr = pkt.hdr.get(), .payload = pkt.payload.get()};
+        reports[i]   = {
+              .tstamp   = tstamp,
+              .gen_idx  = idx_,
+              .flow_idx = flow_idx_of(slot),
+              .pkt_idx  = fl.pkt_idx,
+              .pkt_len  = pkt.len,
+              .src_addr = {}, // will be set below
+              .dst_addr = {}, // will be set below
+              .from_cln = pkt.from_cln,
+              .ok       = true,
         };
-        switch (ih->next_proto_id) {
-        case IPPROTO_TCP: {
-            auto* th = put::read_hdr<rte_tcp_hdr>(pkt.mbuf.get(), offs);
-            if (!th) {
-                put::throw_runtime_error(
-                    "Detected too short/fragmented packet from {}",
-                    cfg.cap_fpath);
-            }
-            set_cport(th);
-            break;
+        variants[i] = static_cast<uint32_t>((grp * pkts_.size()) + fl.pkt_idx);
+        if (rewrite_ports()) ports[i] = l4_ports_of(grp, pkt);
+        if (!tags_layout_.empty()) tags[i] = l2_tags_of(grp);
+        if (tunnel_) {
+            tnl_cln_addrs[i] = tunnel_->cln_addrs.addr_at(grp);
+            tnl_srv_addrs[i] = tunnel_->srv_addrs.addr_at(grp);
+            tnl_ids[i]       = range_value(tunnel_->ids, grp);
+        }
+        if (isn_offsets_) seq_deltas[i] = seq_deltas_of(slot, pkt.from_cln);
+        advance_flow(slot);
+    }
+    if (ipv6) {
+        put::select_ipv6_addrs({addrs6.data(), cnt}, cln_addrs6.data(),
+                               srv_addrs6.data(), from_cln.data());
+    } else {
+        put::select_ipv4_addrs({addrs.data(), cnt}, cln_addrs.data(),
+                               srv_addrs.data(), from_cln.data());
+        for (size_t i = 0; i < cnt; ++i) {
+            reports[i].src_addr.s_addr = addrs[i].src;
+            reports[i].dst_addr.s_addr = addrs[i].dst;
         }
-        case IPPROTO_UDP: {
-            auto* uh = put::read_hdr<rte_udp_hdr>(pkt.mbuf.get(), offs);
-            if (!uh) {
-                put::throw_runtime_error(
-                    "Detected too short/fragmented packet from {}",
-                    cfg.cap_fpath);
+    }
+    if (!variants_.empty()) {
+        // The pre-rendered packets are sent as they are. They only get one
+        // more reference for every segment and the transmission releases it.
+        for (size_t i = 0; i < cnt; ++i) {
+            rte_mbuf* mbuf = variants_[variants[i]].get();
+            for (rte_mbuf* seg = mbuf; seg; seg = seg->next) {
+                rte_mbuf_refcnt_update(seg, 1);
             }
-            set_cport(uh);
-            break;
+            mbufs[i] = mbuf;
         }
+        gen_ops_->send_pkts({mbufs.data(), cnt});
+        report_pkts({reports.data(), cnt}, ipv6 ? addrs6.data() : nullptr);
+        return;
+    }
+    // Every flow needs to work on its own copy of the packet headers because
+    // we are going to change the client and server addresses in the IP header.
+    // Other flows may do the same while the packet is waiting in the queues to
+    // be transmitted and before the NIC actually do the transmission.
+    // The payload is never changed and it's shared by reference.
+    gen_ops_->copy_pkts({segs.data(), cnt}, mbufs.data());
+    if (rewrite_ports()) {
+        put::select_l4_ports({l4_ports.data(), cnt}, ports.data(),
+                             from_cln.data());
+    }
+    const uint32_t* l4_ports_ptr = rewrite_ports() ? l4_ports.data() : nullptr;
+    const put::tcp_seq_deltas* seq_deltas_ptr =
+        isn_offsets_ ? seq_deltas.data() : nullptr;
+    if (ipv6) {
+        put::write_ipv6_hdrs({mbufs.data(), cnt}, addrs6.data(), metas.data(),
+                             l4_ports_ptr, seq_deltas_ptr);
+    } else {
+        put::write_ipv4_hdrs({mbufs.data(), cnt}, addrs.data(), metas.data(),
+                             l4_ports_ptr, seq_deltas_ptr);
+    }
+    if (!tags_layout_.empty()) {
+        put::write_l2_tags({mbufs.data(), cnt}, tags.data(), tags_layout_);
+    }
+    if (tunnel_) {
+        put::select_ipv4_addrs({tnl_addrs.data(), cnt}, tnl_cln_addrs.data(),
+                               tnl_srv_addrs.data(), from_cln.data());
+        put::write_tunnel_hdrs({mbufs.data(), cnt}, tnl_addrs.data(),
+                               tnl_ids.data(), tunnel_layout_);
+    }
+    size_t cnt_ok = 0;
+    for (size_t i = 0; i < cnt; ++i) {
+        if (rte_mbuf* mbuf = mbufs[i]; mbuf) {
+            mbufs[cnt_ok++] = mbuf;
+            continue;
         }
+        auto& rep    = reports[i];
+        auto& failed = failed_[rep.flow_idx];
+        rep.ok       = false;
+        failed.cnt_pkts += 1;
+        failed.cnt_bytes += rep.pkt_len;
     }
-    if (ret.empty()) {
-        put::throw_runtime_error("Loaded no packets from {}", cfg.cap_fpath);
+
+    gen_ops_->send_pkts({mbufs.data(), cnt_ok});
+    report_pkts({reports.data(), cnt}, ipv6 ? addrs6.data() : nullptr);
+}
+
+void flows_generator::report_pkts(std::span<const generation_report> reports,
+                                  const put::ipv6_addrs* addrs6) noexcept
+{
+    if (!addrs6) {
+        gen_ops_->do_reports(reports);
+        return;
     }
-    return ret;
+    // The addresses of the IPv6 packets are taken from the rewrite input.
+    TG_ASSERT(reports.size() <= max_batch_size);
+    std::array<generation_report6, max_batch_size> reports6;
+    for (size_t i = 0; const auto& r : reports) {
+        reports6[i] = {
+            .tstamp   = r.tstamp,
+            .gen_idx  = r.gen_idx,
+            .flow_idx = r.flow_idx,
+            .pkt_idx  = r.pkt_idx,
+            .pkt_len  = r.pkt_len,
+            .addrs    = addrs6[i],
+            .from_cln = r.from_cln,
+            .ok       = r.ok,
+        };
+        ++i;
+    }
+    gen_ops_->do_reports({reports6.data(), reports.size()});
 }
 
-static auto setup_flows(baio_ip_addr4_rng cln_ip_addrs,
-                        baio_ip_addr4_rng srv_ip_addrs,
-                        uint32_t flows_per_sec,
-                        uint32_t burst_cnt,
-                        flows_generator* fgen) noexcept
-{
-    TG_ENFORCE(burst_cnt >= 1);
-
-    std::vector<flows_generator::flow> flows;
-    flows.reserve(flows_per_sec);
-
-    auto cln_ip_addr   = cln_ip_addrs.begin();
-    auto srv_ip_addr   = srv_ip_addrs.begin();
-    uint32_t burst_idx = 0;
-
-    for (auto i : boost::irange(flows_per_sec)) {
-        flows.push_back(flows_generator::flow{
-            .idx         = i,
-            .pkt_idx     = 0, // always start from the 1st packet
-            .cln_ip_addr = *cln_ip_addr,
-            .srv_ip_addr = *srv_ip_addr,
-            .event       = {}, // We'll be set later
-            .fgen        = fgen,
-            .cnt_pkts    = {},
-            .cnt_bytes   = {},
-            .tstamp_beg  = {},
-            .tstamp_end  = {},
-        });
-        // All streams from a given burst are with the same client and server
-        // addresses. The addresses change for the next burst.
-        if (inc_reset(burst_idx, 0u, burst_cnt)) {
-            inc_reset(cln_ip_addr, cln_ip_addrs.begin(), cln_ip_addrs.end());
-            inc_reset(srv_ip_addr, srv_ip_addrs.begin(), srv_ip_addrs.end());
-        }
+void flows_generator::advance_flow(uint32_t slot) noexcept
+{
+    auto& fl = hot_[slot];
+    if (stream_) {
+        // The stream doesn't keep the sent packets
+        stream_bytes_    += stream_->current()->len;
+        stream_last_tsc_  = fl.next_tsc;
+        stream_->advance();
+    }
+    if (++fl.pkt_idx == (stream_ ? stream_->count_pkts() : pkts_.size())) {
+        // All runs of the flows have the same duration and the flows restart
+        // in the order of their starts. Thus upon restart a flow takes the
+        // address sequence number after the one of the last started flow.
+        fl.pkt_idx  = 0;
+        fl.addr_seq = static_cast<uint32_t>(
+            (uint64_t(fl.addr_seq) + flows_per_sec_) % addr_seq_wrap_);
+        cnt_runs_[slot] += 1;
     }
+    if (!stream_) {
+        fl.next_tsc += pkts_[fl.pkt_idx].rel_tsc;
+    } else if (!resume_stream(fl)) {
+        cnt_stream_stalls_ += 1;
+    }
+}
 
-    return std::tuple(std::move(flows), cln_ip_addr, srv_ip_addr, burst_idx);
+// Takes the relative time of the next packet of the streamed flow, if it has
+// already come through the stream. Otherwise, the flow stays stalled.
+bool flows_generator::resume_stream(flow_hot& fl) noexcept
+{
+    const auto* next = stream_->current();
+    stream_stalled_  = !next;
+    if (next) fl.next_tsc += next->rel_tsc;
+    return !!next;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-// Note that we pass the `this`pointer to the `setup_flows` before the generator
-// is actually fully constructed. It's OK because we don't actually use the
-// pointer only store it in the flows.
-flows_generator::flows_generator(const config& cfg)
-: pkts_(load_pkts(cfg))
-, gen_ops_(cfg.gen_ops)
-, cln_ip_addrs_(cfg.cln_ip_addrs.hosts())
-, srv_ip_addrs_(cfg.srv_ip_addrs.hosts())
-, idx_(cfg.idx)
-, cln_ip_addr_(cln_ip_addrs_.begin())
-, srv_ip_addr_(srv_ip_addrs_.begin())
-, burst_idx_(0)
-, burst_cnt_(cfg.burst)
+size_t flows_generator::release_flows(std::span<flow_state> out) noexcept
 {
-    std::tie(flows_, cln_ip_addr_, srv_ip_addr_, burst_idx_) = setup_flows(
-        cln_ip_addrs_, srv_ip_addrs_, cfg.flows_per_sec, burst_cnt_, this);
-    // At this point the `flows_` vector is filled and it won't be reallocated
-    // from this point on. Thus it's safe to setup the flow events because the
-    // event callbacks will keep a pointer to the corresponding flow. This
-    // means that it's a MUST that the flow entries don't move in the memory.
-    setup_flow_events();
+    TG_ASSERT(can_release_flows());
+    // The flows are taken one after another from where the previous call
+    // stopped. This way the same flows aren't released every time.
+    const auto cnt_all = static_cast<uint32_t>(hot_.size());
+    size_t cnt         = 0;
+    for (uint32_t i = 0; (i < cnt_all) && (cnt < out.size()); ++i) {
+        if (release_cursor_ >= cnt_all) release_cursor_ = 0;
+        const uint32_t slot = release_cursor_++;
+        if (is_owned(slot)) out[cnt++] = release_flow(slot);
+    }
+    return cnt;
 }
 
-flows_generator::~flows_generator() noexcept                 = default;
-flows_generator::flows_generator(flows_generator&&) noexcept = default;
-flows_generator&
-flows_generator::operator=(flows_generator&&) noexcept = default;
+auto flows_generator::release_flow(uint32_t slot) noexcept -> flow_state
+{
+    // The event is canceled before the flow state leaves this core and thus
+    // the next packet of the flow can only be sent by the adopting core.
+    cancel_flow(slot);
+    auto& fl = hot_[slot];
+    flow_state ret{
+        .idx              = flow_idx_of(slot),
+        .pkt_idx          = fl.pkt_idx,
+        .addr_seq         = fl.addr_seq,
+        .cnt_runs         = cnt_runs_[slot],
+        .next_tsc         = fl.next_tsc,
+        .tstamp_beg       = tstamp_beg_of(slot),
+        .cnt_failed_pkts  = 0,
+        .cnt_failed_bytes = 0,
+    };
+    if (const auto it = failed_.find(ret.idx); it != failed_.end()) {
+        ret.cnt_failed_pkts  = it->second.cnt_pkts;
+        ret.cnt_failed_bytes = it->second.cnt_bytes;
+        failed_.erase(it);
+    }
+    fl.pkt_idx = released_pkt_idx;
+    if (slot >= cnt_own_) free_adopted_.push_back(slot - cnt_own_);
+    cnt_owned_ -= 1;
+    migr_stats_.cnt_flows_out += 1;
+    return ret;
+}
 
-void flows_generator::setup_flow_events()
+void flows_generator::adopt_flow(const flow_state& st) noexcept
 {
-    // The flows need to be evenly spread through out the second
-    using namespace std::chrono_literals;
-    const auto flow_tsc_step = put::cycles::from_duration(
-        stdcr::microseconds{1'000'000us / flows_.size()});
-    if (flow_tsc_step == put::cycles{0}) {
-        put::throw_runtime_error(
-            "Can't work with so many ({}) flows per second", flows_.size());
+    TG_ASSERT(st.pkt_idx < pkts_.size());
+    uint32_t pos = 0;
+    if (!free_adopted_.empty()) {
+        pos = free_adopted_.back();
+        free_adopted_.pop_back();
+    } else {
+        pos = static_cast<uint32_t>(adopted_.size());
+        if ((pos % adopted_block_size) == 0) {
+            adopted_events_.push_back(
+                gen_ops_->create_scheduler_events(adopted_block_size));
+        }
+        hot_.emplace_back();
+        cnt_runs_.emplace_back();
+        adopted_.emplace_back();
     }
+    const uint32_t slot = cnt_own_ + pos;
 
-    // TODO: Optimization
-    // For the case of working with predefined inter packet gaps we can
-    // schedule periodic event only once.
-    for (put::cycles flow_tsc{0}; auto& flow : flows_) {
-        const auto evtm = flow_tsc + pkts_[flow.pkt_idx].rel_tsc;
-        flow.event      = gen_ops_->create_scheduler_event();
-        flow.event.schedule_single(evtm, on_event, &flow);
-        flow_tsc += flow_tsc_step;
+    hot_[slot] = {
+        .next_tsc = st.next_tsc,
+        .pkt_idx  = st.pkt_idx,
+        .addr_seq = st.addr_seq,
+    };
+    cnt_runs_[slot] = st.cnt_runs;
+    adopted_[pos]   = {.idx = st.idx, .tstamp_beg = st.tstamp_beg};
+    if (st.cnt_failed_pkts > 0) {
+        failed_[st.idx] = {
+            .cnt_pkts  = st.cnt_failed_pkts,
+            .cnt_bytes = st.cnt_failed_bytes,
+        };
     }
+    cnt_owned_ += 1;
+    migr_stats_.cnt_flows_in += 1;
+    // The intended send time is kept. The packet is sent right away if it's
+    // already late and the lateness is accounted here.
+    schedule_flow(slot);
 }
 
-void flows_generator::on_flow_event(flow& fl) noexcept
+void flows_generator::on_flow_events(std::span<const uint32_t> slots) noexcept
 {
-    if (++fl.pkt_idx == pkts_.size()) {
-        // Upon restarting the stream we need to change it's client and server
-        // addresses according to the burst counter logic.
-        fl.pkt_idx     = 0;
-        fl.cln_ip_addr = *cln_ip_addr_;
-        fl.srv_ip_addr = *srv_ip_addr_;
-        if (inc_reset(burst_idx_, 0u, burst_cnt_)) {
-            inc_reset(cln_ip_addr_, cln_ip_addrs_.begin(), cln_ip_addrs_.end());
-            inc_reset(srv_ip_addr_, srv_ip_addrs_.begin(), srv_ip_addrs_.end());
+    TG_ASSERT(slots.size() <= max_batch_size);
+    const auto tstamp = put::cycles::current();
+    // The next packet of the stalled streamed flow may not be due yet once
+    // it comes. The flow keeps polling until then.
+    if (stream_stalled_) {
+        auto& fl = hot_[slots[0]];
+        if (!resume_stream(fl) || (fl.next_tsc > tstamp)) {
+            schedule_flow(slots[0]);
+            return;
         }
     }
-    const auto& pkt                 = pkts_[fl.pkt_idx];
-    const auto [src_addr, dst_addr] = [&] {
-        return pkt.from_cln
-                   ? std::pair(ben::native_to_big(fl.cln_ip_addr.to_uint()),
-                               ben::native_to_big(fl.srv_ip_addr.to_uint()))
-                   : std::pair(ben::native_to_big(fl.srv_ip_addr.to_uint()),
-                               ben::native_to_big(fl.cln_ip_addr.to_uint()));
-    }();
-    const auto tstamp = put::cycles::current();
-    fl.cnt_pkts += 1;
-    fl.cnt_bytes += pkt.mbuf->pkt_len;
-    fl.tstamp_end = tstamp;
-    // Note that the first packet marks the beginning of the flow.
-    // If a flow contains only single packet and burst is equal to 1 then the
-    // duration of this flow will be report as 0 which is a bit weird but
-    // it shouldn't happen in practice ... or we can change the logic here.
-    if (fl.cnt_pkts == 1) fl.tstamp_beg = tstamp;
-    generation_report report = {
-        .tstamp   = tstamp,
-        .gen_idx  = idx_,
-        .flow_idx = fl.idx,
-        .pkt_idx  = fl.pkt_idx,
-        .pkt_len  = pkt.mbuf->pkt_len,
-        .src_addr = in_addr{src_addr},
-        .dst_addr = in_addr{dst_addr},
-        .from_cln = pkt.from_cln,
-        .ok       = true,
-    };
-    // TODO: Optimization
-    // The copy of the whole packet here is really unfortunate.
-    // It's needed because we are going to change the client and server
-    // addresses in the IP header. Other flows may do the same while the packet
-    // is waiting in the queues to be transmitted and before the NIC actually
-    // do the transmission. Thus every single flow need to work on its own copy
-    // of the packet.
-    // A possible optimization here is to segment the packets upon loading so
-    // that the packet headers are in the first and smaller segment while the
-    // payload is in a separate packet and thus only the first segment will need
-    // to be copied here.
-    rte_mbuf* mbuf = gen_ops_->copy_pkt(pkt.mbuf.get());
-    if (!mbuf) {
-        report.ok = false;
-        gen_ops_->do_report(report);
-        return;
+    for (const auto slot : slots) {
+        account_sched_error(tstamp, hot_[slot].next_tsc);
     }
-    // All packets have been checked upon loading and thus we may jump right
-    // to the IP header.
-    auto* ih     = put::read_hdr<rte_ipv4_hdr>(mbuf, RTE_ETHER_HDR_LEN);
-    ih->src_addr = src_addr;
-    ih->dst_addr = dst_addr;
-    // The hardware needs to (re)calculate the checksums of the packet.
-    // For this we need to set the appropriate flags,
-    constexpr auto flags = RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM |
-                           RTE_MBUF_F_TX_TCP_CKSUM | RTE_MBUF_F_TX_UDP_CKSUM;
-    mbuf->ol_flags |= flags;
-    mbuf->l2_len = RTE_ETHER_HDR_LEN;
-    mbuf->l3_len = put::hdr_len(ih);
+    send_flow_pkts(slots, tstamp);
+    // The next packet is scheduled relative to the intended time of the
+    // current one and not relative to the current time. This way the lateness
+    // doesn't accumulate through the flow and the late flows catch up.
+    for (const auto slot : slots) schedule_flow(slot);
+}
 
-    gen_ops_->send_pkt(mbuf);
+void flows_generator::on_ring_event() noexcept
+{
+    auto& ring           = *ring_;
+    const auto tstamp    = put::cycles::current();
+    const auto cnt_slots = static_cast<uint32_t>(ring.slots.size() - 1);
+    std::array<uint32_t, max_batch_size> batch;
+    size_t cnt = 0;
+    // All ticks which are due are processed at once, if we are late.
+    do {
+        const auto beg = ring.entries.begin() + ring.slots[ring.slot];
+        const auto end = ring.entries.begin() + ring.slots[ring.slot + 1];
+        for (const auto& ent : std::span(beg, end)) {
+            // The flows start one after another and the slots of the flows
+            // which haven't started yet are skipped.
+            const auto slot = ent.flow_slot;
+            if ((ring.tick < ring.warm_tick) &&
+                (ring.tick <
+                 ((flow_idx_of(slot) * ring.flow_step) + ring.flow_gap))) {
+                continue;
+            }
+            account_sched_error(tstamp, ring.next_tsc);
+            hot_[slot].next_tsc = ring.next_tsc;
+            batch[cnt++]        = slot;
+            if (cnt == batch.size()) {
+                send_flow_pkts(batch, tstamp);
+                cnt = 0;
+            }
+        }
+        ring.tick += 1;
+        inc_reset(ring.slot, 0u, cnt_slots);
+        // The tick duration is rarely whole number of cycles and the
+        // remainders are accumulated so that the ticks don't drift.
+        ring.next_tsc += ring.tick_tsc;
+        ring.tick_err += ring.tick_rem;
+        if (ring.tick_err >= 1'000'000) {
+            ring.tick_err -= 1'000'000;
+            ring.next_tsc += put::cycles{1};
+        }
+    } while (ring.next_tsc <= tstamp);
+    if (cnt > 0) send_flow_pkts({batch.data(), cnt}, tstamp);
+    // The single event is re-armed at absolute time for the same reason as
+    // the flow events.
+    ring.event.schedule_single_at(ring.next_tsc, on_ring_event, this);
+}
 
-    gen_ops_->do_report(report);
+void flows_generator::process_table() noexcept
+{
+    auto& tbl         = *table_;
+    const auto tstamp = put::cycles::current();
+    const auto cnt    = tbl.entries.size();
+    std::array<uint32_t, max_batch_size> batch;
+    size_t cnt_batch = 0;
+    for (;;) {
+        const auto& ent = tbl.entries[tbl.cursor];
+        const auto due  = tbl.period_tsc + put::cycles{ent.tsc_offset};
+        if (due > tstamp) break;
+        // The entries are consumed sequentially and the hardware prefetcher
+        // handles them well but the flows they refer to are spread around.
+        if (const auto ahead = tbl.cursor + table_prefetch_dist; ahead < cnt) {
+            rte_prefetch0(&hot_[tbl.entries[ahead].flow_slot]);
+        }
+        // The flows start one after another and their entries are skipped
+        // during the first periods until they actually start.
+        const auto slot    = ent.flow_slot;
+        const bool started = (tbl.round >= tbl.warm_rounds) ||
+                             (tbl.round >=
+                              (((flow_idx_of(slot) * tbl.flow_step.num) +
+                                tbl.pkt_offsets[ent.pkt_idx].num) /
+                               tbl.period.num));
+        if (started) {
+            account_sched_error(tstamp, due);
+            hot_[slot].next_tsc = due;
+            batch[cnt_batch++]  = slot;
+            if (cnt_batch == batch.size()) {
+                send_flow_pkts(batch, tstamp);
+                cnt_batch = 0;
+            }
+        }
+        if (++tbl.cursor == cnt) {
+            tbl.cursor = 0;
+            tbl.round += 1;
+            tbl.period_tsc += tbl.period;
+        }
+    }
+    if (cnt_batch > 0) send_flow_pkts({batch.data(), cnt_batch}, tstamp);
+}
+
+std::optional<std::string_view> flows_generator::stream_error() const noexcept
+{
+    return stream_ ? stream_->error() : std::nullopt;
+}
 
-    fl.event.schedule_single(pkt.rel_tsc, on_event, &fl);
+void flows_generator::on_event(void* ctx,
+                               std::span<const uint32_t> slots) noexcept
+{
+    // The expired events of the generator are passed to it in batches with
+    // limited size.
+    auto* fgen = static_cast<flows_generator*>(ctx);
+    while (!slots.empty()) {
+        const auto cnt = std::min(slots.size(), max_batch_size);
+        fgen->on_flow_events(slots.first(cnt));
+        slots = slots.subspan(cnt);
+    }
 }
 
-void flows_generator::on_event(rte_timer*, void* ctx) noexcept
+void flows_generator::on_ring_event(void* ctx,
+                                    std::span<const uint32_t>) noexcept
 {
-    auto fl = static_cast<flow*>(ctx);
-    fl->fgen->on_flow_event(*fl);
+    static_cast<flows_generator*>(ctx)->on_ring_event();
 }
 
 } // namespace gen::priv
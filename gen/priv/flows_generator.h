@@ -1,46 +1,92 @@
 #pragma once
 
+#include "gen/priv/addr_space.h"
 #include "gen/priv/event_handle.h"
+#include "gen/priv/pkt_templates.h"
+#include "put/permutation.h"
+#include "put/pkt_rewrite.h"
 #include "put/time_utils.h"
 
 namespace gen::priv
 {
 class generation_ops;
+struct generation_report;
+class pkt_stream;
 
 class flows_generator
 {
 public:
-    struct mbuf_free
+    using mbuf_ptr_type = pkt_templates::mbuf_ptr_type;
+    using pkt           = pkt_templates::pkt;
+    using templates_ptr = std::shared_ptr<const pkt_templates>;
+    // The flows are kept in a table with struct-of-arrays layout. Every flow
+    // takes a slot in it and the slot is passed as a tag to the flow events.
+    // Only the state which is touched on every packet is kept together and it
+    // fits in 16 bytes. Thus four flows share a cache line and the cache
+    // doesn't get polluted with data needed only for the reports.
+    // The addresses of a flow are derived from its address sequence number.
+    // The flows take consecutive sequence numbers in the order of their
+    // starts and restarts and the flows from the same burst share the same
+    // addresses.
+    struct flow_hot
     {
-        void operator()(rte_mbuf* p) const noexcept { rte_pktmbuf_free(p); }
+        put::cycles next_tsc; // the intended send time of the `pkt_idx` packet
+        uint32_t pkt_idx;     // `released_pkt_idx` if not owned anymore
+        uint32_t addr_seq;
     };
-    using mbuf_ptr_type = std::unique_ptr<rte_mbuf, mbuf_free>;
-    struct pkt
+    static_assert(sizeof(flow_hot) == 16);
+    // The statistics of a flow aren't counted per packet. They are derived
+    // when needed from the completed runs and the current packet of the flow,
+    // minus the packets which couldn't be sent. The times are the intended
+    // send times of the first and the last packets.
+    struct flow_info
     {
-        put::cycles rel_tsc; // relative timestamp
-        mbuf_ptr_type mbuf;
-        bool from_cln; // true - client to server, false - server to client
-    };
-    // The scheduler event notifications are fired for given flow instance and
-    // upon receiving such notification we need to do some things in the
-    // flows generator intself and thus we need to keep a pointer to it in every
-    // flow entry.
-    struct flow
-    {
-        // Member variables needed for the generation
         uint32_t idx;
-        uint32_t pkt_idx;
-        baio_ip_addr4 cln_ip_addr;
-        baio_ip_addr4 srv_ip_addr;
-        event_handle event;
-        flows_generator* fgen;
-
-        // Member variables needed for the stats
         uint64_t cnt_pkts;
         uint64_t cnt_bytes;
         put::cycles tstamp_beg;
         put::cycles tstamp_end;
     };
+    // The difference between the intended and the actual send time of the
+    // packets. It's tracked for all flows of the generator.
+    struct sched_error
+    {
+        put::cycles total;
+        put::cycles max;
+        uint64_t cnt; // the count of the scheduled packets
+    };
+    // The state of a flow which is handed over to the generator of the same
+    // capture on another CPU core. The packet `pkt_idx` is the next one to be
+    // sent at `next_tsc`. The statistics go together with the flow so that
+    // every flow is reported only once at the end.
+    struct flow_state
+    {
+        uint32_t idx;
+        uint32_t pkt_idx;
+        uint32_t addr_seq;
+        uint32_t cnt_runs;
+        put::cycles next_tsc;
+        put::cycles tstamp_beg;
+        uint64_t cnt_failed_pkts;
+        uint64_t cnt_failed_bytes;
+    };
+    struct migration_stats
+    {
+        uint64_t cnt_flows_in;
+        uint64_t cnt_flows_out;
+    };
+    // How the ports of the flows are chosen from the configured ranges
+    // - sequential: all pairs of addresses are used with the first ports,
+    //   then with the next ones, etc.
+    // - random: the same as sequential but the ports are taken in a random
+    //   permutation of all pairs of client and server ports
+    // - paired: the ports change together with the addresses
+    enum class port_policy : uint8_t
+    {
+        sequential,
+        random,
+        paired,
+    };
 
 private:
     // Most of the members are never changed once set upon construction.
@@ -49,38 +95,216 @@ private:
     // I could have workaround this but the code will get messier.
     // So, I decided to stick to comments only.
 
-    // The packets vector and its content is never changed once created.
-    std::vector<pkt> pkts_;
-    // The flows vector is never changed once created.
-    // However, the member of each flow are modified to track the flow state
-    std::vector<flow> flows_;
+    // The template packets are shared with the generators of the same
+    // capture on the other cores and they are never changed.
+    templates_ptr tmpls_;
+    std::span<const pkt> pkts_;
+    // The total length of the packets before every packet and of all packets
+    std::span<const uint64_t> pkts_bytes_;
+    // The packets of a streamed capture are taken one by one from the stream
+    // instead of the templates. Such capture has a single flow whose bytes
+    // and last send time are accounted on every packet. The flow stalls and
+    // polls the stream when its next packet isn't there yet.
+    std::shared_ptr<pkt_stream> stream_;
+    uint64_t stream_bytes_       = 0;
+    put::cycles stream_last_tsc_ = {0};
+    bool stream_stalled_         = false;
+    uint64_t cnt_stream_stalls_  = 0;
+
+    // The flow table. The first `cnt_own_` slots are for the flows of the
+    // shard of the generator. The slots after them are for the flows handed
+    // over from other cores and the slots of the flows which have been handed
+    // over again are reused.
+    std::vector<flow_hot> hot_;
+    std::vector<uint32_t> cnt_runs_;
+    // Only the flows handed over from other cores keep their index and
+    // beginning. They are calculated for the own flows.
+    struct adopted_info
+    {
+        uint32_t idx;
+        put::cycles tstamp_beg;
+    };
+    std::vector<adopted_info> adopted_;
+    std::vector<uint32_t> free_adopted_;
+    // The packets which couldn't be sent, per flow index. They are rare.
+    struct failed_stats
+    {
+        uint64_t cnt_pkts;
+        uint64_t cnt_bytes;
+    };
+    std::unordered_map<uint32_t, failed_stats> failed_;
+    // The own flows have their events only in the event per flow mode. The
+    // adopted flows always have events and they are taken in blocks.
+    event_block own_events_;
+    std::vector<event_block> adopted_events_;
+    uint32_t cnt_own_           = 0;
+    uint32_t cnt_owned_         = 0;
+    uint32_t release_cursor_    = 0;
+    migration_stats migr_stats_ = {};
 
     // These members are never changed once set upon construction
     gen::priv::generation_ops* gen_ops_;
-    baio_ip_addr4_rng cln_ip_addrs_;
-    baio_ip_addr4_rng srv_ip_addrs_;
     uint32_t idx_;
-
-    // These members are used to handle the burst functionality and they
-    // are changed during runtime, except the burst count.
-    baio_ip_addr4_rng::iterator cln_ip_addr_;
-    baio_ip_addr4_rng::iterator srv_ip_addr_;
-    uint32_t burst_idx_;
+    uint32_t shard_idx_;
+    uint32_t shard_cnt_;
+    uint32_t flows_per_sec_; // for all shards
+    put::cycles flow_tsc_step_;
+    put::cycles start_tsc_;
+    // All flows from a burst have the same addresses. The address sequence
+    // numbers wrap around when all tuples of addresses and ports have been
+    // used. The client and the server addresses are taken independently from
+    // their spaces for the same sequence number.
     uint32_t burst_cnt_;
+    addr_space cln_addrs_;
+    addr_space srv_addrs_;
+    uint64_t cnt_addr_pairs_;
+    // The ports are taken from the ranges depending on the policy. The ports
+    // of the templates are kept if there is no range.
+    uint32_t cln_port_first_;
+    uint32_t cnt_cln_ports_; // 0 - the ports aren't changed
+    uint32_t srv_port_first_;
+    uint32_t cnt_srv_ports_; // 0 - the ports aren't changed
+    port_policy ports_policy_;
+    std::optional<put::feistel_permutation> ports_perm_;
+    // The VLAN and MPLS tags, if any, are taken from their ranges together
+    // with the addresses.
+    // The first tag and the count of the tags, 0 - no such tags
+    using tag_range = std::pair<uint32_t, uint32_t>;
+    put::l2_tags_layout tags_layout_;
+    std::array<tag_range, 2> vlan_rngs_; // the outer one is first
+    tag_range mpls_rng_;
+    // The outer addresses and the id of the tunnel, if any, are taken
+    // together with the addresses as well.
+    struct tunnel_state
+    {
+        addr_space cln_addrs;
+        addr_space srv_addrs;
+        tag_range ids;
+    };
+    put::tunnel_layout tunnel_layout_;
+    std::optional<tunnel_state> tunnel_;
+    uint64_t cnt_tuples_; // of addresses, ports, tags and tunnel headers
+    uint64_t addr_seq_wrap_;
+    // Every run of every flow gets its own offsets of the TCP sequence numbers
+    // of both sides, if enabled.
+    bool isn_offsets_;
+
+    // When the address and port ranges are small every packet can be rendered
+    // upfront for every tuple of addresses and ports. The variant of packet
+    // `p` for the tuple `t` is at `t * pkts_.size() + p`. These mbufs are
+    // never changed and they are transmitted by reference, without copying
+    // the headers. The vector is empty if the variants didn't fit in the
+    // memory budget.
+    std::vector<mbuf_ptr_type> variants_;
+    size_t variants_size_ = 0; // in bytes
+
+    // In the fixed inter packet gap mode all packets of all flows are sent on
+    // a grid with a step of one tick and the whole pattern repeats after
+    // the duration of a single flow run. Thus it's enough to precompute the
+    // packets due in every tick of one run and walk these slots with a single
+    // periodic event instead of having an event per flow.
+    struct slot_entry
+    {
+        uint32_t flow_slot;
+        uint32_t pkt_idx;
+    };
+    struct slot_ring
+    {
+        // The entries of slot `i` are in the range [slots[i], slots[i + 1]).
+        std::vector<uint32_t> slots;
+        std::vector<slot_entry> entries;
+        event_handle event;
+        uint64_t tick;        // the number of the next tick since the start
+        uint32_t slot;        // the slot of the next tick
+        uint64_t flow_step;   // the start offset between the flows in ticks
+        uint64_t flow_gap;    // the start offset of the first flow in ticks
+        uint64_t warm_tick;   // all flows have started at this tick
+        put::cycles tick_tsc; // the duration of a single tick, rounded down
+        uint64_t tick_rem;    // the remainder of the above in cycles * 10^6
+        uint64_t tick_err;    // the accumulated remainders
+        put::cycles next_tsc; // the intended time of the next tick
+    };
+    std::optional<slot_ring> ring_;
+
+    // In the precompiled schedule mode one period of the whole send pattern
+    // is compiled into an array of entries sorted by their offset from the
+    // beginning of the period. The period is the duration of a single flow
+    // run. The array is consumed with a cursor from the main loop and there is
+    // no timer involved at all.
+    struct table_entry
+    {
+        uint64_t tsc_offset; // from the beginning of the period
+        uint32_t flow_slot;
+        uint32_t pkt_idx;
+    };
+    struct sched_table
+    {
+        std::vector<table_entry> entries;
+        // The offset of every packet from the start of the flow run
+        std::vector<put::cycles> pkt_offsets;
+        put::cycles flow_step;  // the start offset between the flows
+        put::cycles period;     // the duration of a single flow run
+        put::cycles period_tsc; // the beginning of the current period
+        uint64_t round;         // the number of the current period
+        uint64_t warm_rounds;   // all flows have started after so many periods
+        size_t cursor;
+    };
+    std::optional<sched_table> table_;
+
+    sched_error sched_err_ = {};
 
 public:
+    // The outer addresses of the tunnel are IPv4 ones. The tunnel id range is
+    // [first, last] and the id is 0 without a range.
+    struct tunnel_config
+    {
+        put::tunnel_type type;
+        addr_space::config cln_addrs;
+        addr_space::config srv_addrs;
+        std::optional<std::pair<uint32_t, uint32_t>> ids;
+    };
+    // The flows of a capture may be split between several generators, shards,
+    // each one running on different CPU core. The `flows_per_sec` is for all
+    // shards together.
     struct config
     {
         uint32_t idx;
+        uint32_t shard_idx;
+        uint32_t shard_cnt;
         stdfs::path cap_fpath;
+        templates_ptr templates; // loaded with `templates_config`
+        // The packets of the capture are streamed instead of loaded as
+        // templates. The capture must have a single flow then.
+        bool streamed;
+        std::shared_ptr<pkt_stream> stream; // set instead of `templates`
         rte_ether_addr cln_ether_addr;
         rte_ether_addr srv_ether_addr;
         uint32_t burst;
         uint32_t flows_per_sec;
         std::optional<stdcr::microseconds> inter_pkts_gap;
-        baio_ip_net4 cln_ip_addrs;
-        baio_ip_net4 srv_ip_addrs;
-        std::optional<uint16_t> cln_port;
+        addr_space::config cln_addrs;
+        addr_space::config srv_addrs;
+        // The port ranges are [first, last]. The ports of the packets aren't
+        // changed for a side without a range.
+        std::optional<std::pair<uint16_t, uint16_t>> cln_ports;
+        std::optional<std::pair<uint16_t, uint16_t>> srv_ports;
+        port_policy ports_policy;
+        // The tag ranges are [first, last]. The packets get no tags of a kind
+        // without a range.
+        std::optional<std::pair<uint16_t, uint16_t>> vlans;
+        std::optional<std::pair<uint16_t, uint16_t>> inner_vlans;
+        std::optional<std::pair<uint32_t, uint32_t>> mpls_labels;
+        bool hw_vlans; // the VLAN tags are inserted by the NIC
+        std::optional<tunnel_config> tunnel;
+        bool precompiled_schedule;
+        size_t prerender_budget; // in bytes, 0 - no pre-rendered variants
+        // Every pre-rendered packet holds a reference to the payload of its
+        // template and the templates are shared by all workers. These are
+        // the references which the pre-rendered packets of all workers may
+        // take, besides the references of the packets in flight.
+        uint32_t max_variant_refs;
+        bool sw_cksum; // the checksums are updated in software, not by the NIC
+        bool isn_offsets;
         gen::priv::generation_ops* gen_ops;
     };
 
@@ -95,13 +319,102 @@ public:
     flows_generator(const flows_generator&)            = delete;
     flows_generator& operator=(const flows_generator&) = delete;
 
-    std::span<const flow> flows() const noexcept { return flows_; }
+    // The configuration of the template packets for the given generator
+    // configuration. The templates are loaded separately because the loading
+    // involves file I/O which must be kept away from the generation cores.
+    static pkt_templates::config templates_config(const config&);
+    // Whether the generator with the given configuration may use pre-rendered
+    // packets, if they fit in its budget.
+    static bool can_prerender(const config&) noexcept;
+
+    template <typename Fn>
+    void visit_owned_flows(Fn&& fn) const noexcept
+    {
+        for (uint32_t slot = 0; slot < hot_.size(); ++slot) {
+            if (is_owned(slot)) fn(flow_info_of(slot));
+        }
+    }
     uint32_t idx() const noexcept { return idx_; }
+    uint32_t count_owned_flows() const noexcept { return cnt_owned_; }
+    const sched_error& schedule_error() const noexcept { return sched_err_; }
+    const migration_stats& migration() const noexcept { return migr_stats_; }
+    // The memory taken by the pre-rendered packets, 0 if there are none.
+    size_t prerendered_size() const noexcept { return variants_size_; }
+    // The times the streamed flow waited for its next packet and the error
+    // of the stream, if any.
+    uint64_t count_stream_stalls() const noexcept { return cnt_stream_stalls_; }
+    std::optional<std::string_view> stream_error() const noexcept;
+    std::string_view schedule_mode() const noexcept
+    {
+        if (table_) return "precompiled table";
+        if (ring_) return "slot ring";
+        return "event per flow";
+    }
+
+    // Needs to be called from the main loop. It does nothing unless the
+    // generator works with precompiled schedule.
+    void process_schedule() noexcept
+    {
+        if (table_) process_table();
+    }
+
+    // The flows can be handed over to other cores only if every flow has its
+    // own event. The flows of the other modes are bound to the precomputed
+    // slots and the streamed flow is bound to its stream. However, flows can
+    // be adopted in all modes.
+    bool can_release_flows() const noexcept
+    {
+        return !ring_ && !table_ && !stream_;
+    }
+    // Stops up to `out.size()` owned flows and returns their state.
+    // Must be called from the main loop and not from an event callback.
+    size_t release_flows(std::span<flow_state> out) noexcept;
+    // Continues the given flow from where it was stopped by `release_flows`.
+    void adopt_flow(const flow_state&) noexcept;
 
 private:
-    void setup_flow_events();
-    void on_flow_event(flow&) noexcept;
-    static void on_event(rte_timer*, void*) noexcept;
+    static constexpr uint32_t released_pkt_idx = UINT32_MAX;
+
+    void setup_flows();
+    void setup_variants(const config&);
+    bool setup_slot_ring(const config&);
+    bool setup_sched_table();
+    bool is_owned(uint32_t slot) const noexcept
+    {
+        return hot_[slot].pkt_idx != released_pkt_idx;
+    }
+    uint32_t flow_idx_of(uint32_t slot) const noexcept
+    {
+        return (slot < cnt_own_) ? (shard_idx_ + (slot * shard_cnt_))
+                                 : adopted_[slot - cnt_own_].idx;
+    }
+    put::cycles tstamp_beg_of(uint32_t slot) const noexcept;
+    put::cycles first_rel_tsc() const noexcept;
+    bool is_ipv6() const noexcept { return cln_addrs_.is_ipv6(); }
+    bool rewrite_ports() const noexcept
+    {
+        return (cnt_cln_ports_ > 0) || (cnt_srv_ports_ > 0);
+    }
+    uint32_t l4_ports_of(uint32_t grp, const pkt&) const noexcept;
+    put::l2_tags l2_tags_of(uint32_t grp) const noexcept;
+    put::tcp_seq_deltas seq_deltas_of(uint32_t slot,
+                                      bool from_cln) const noexcept;
+    flow_info flow_info_of(uint32_t slot) const noexcept;
+    void schedule_flow(uint32_t slot) noexcept;
+    void cancel_flow(uint32_t slot) noexcept;
+    void account_sched_error(put::cycles tstamp, put::cycles due) noexcept;
+    void send_flow_pkts(std::span<const uint32_t>, put::cycles tstamp) noexcept;
+    // The IPv6 packets are reported with their addresses, if given.
+    void report_pkts(std::span<const generation_report>,
+                     const put::ipv6_addrs* addrs6) noexcept;
+    void advance_flow(uint32_t slot) noexcept;
+    bool resume_stream(flow_hot&) noexcept;
+    flow_state release_flow(uint32_t slot) noexcept;
+    void on_flow_events(std::span<const uint32_t>) noexcept;
+    void on_ring_event() noexcept;
+    void process_table() noexcept;
+    static void on_event(void*, std::span<const uint32_t>) noexcept;
+    static void on_ring_event(void*, std::span<const uint32_t>) noexcept;
 };
 
 } // namespace gen::priv
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "put/pkt_rewrite.h"
 #include "put/time_utils.h"
 
 namespace gen::priv
 {
+class event_block;
 class event_handle;
 
+// The reports of the IPv4 packets. The IPv6 packets are reported with
+// `generation_report6` so that the reports of the IPv4 packets don't get
+// bigger.
 struct generation_report
 {
     put::cycles tstamp;
@@ -19,6 +24,27 @@ struct generation_report
     uint32_t ok : 1; // true - generated successfully, false - generation missed
 };
 
+// The reports of the IPv6 packets, used only by the generators of IPv6
+// captures.
+struct generation_report6
+{
+    put::cycles tstamp;
+    uint32_t gen_idx;
+    uint32_t flow_idx;
+    uint32_t pkt_idx;
+    uint32_t pkt_len;
+    put::ipv6_addrs addrs;
+    uint32_t from_cln : 1; // true - from client, false - from server
+    uint32_t ok : 1; // true - generated successfully, false - generation missed
+};
+
+// The segments of a packet which need to be copied for its transmission
+struct pkt_segs
+{
+    const rte_mbuf* hdr;
+    rte_mbuf* payload; // null, if the packet has no payload
+};
+
 // These operations are used during the generation from the flows generator
 // functionality. As a general rule virtual calls are slow and should be avoided
 // if possible. However, I think we won't see performance impact for our usage
@@ -32,11 +58,16 @@ class generation_ops
 public:
     virtual ~generation_ops() noexcept = default;
 
-    virtual rte_mbuf* alloc_mbuf() noexcept                   = 0;
-    virtual rte_mbuf* copy_pkt(const rte_mbuf*) noexcept      = 0;
-    virtual void send_pkt(rte_mbuf*) noexcept                 = 0;
-    virtual event_handle create_scheduler_event() noexcept    = 0;
-    virtual void do_report(const generation_report&) noexcept = 0;
+    // Copies the given header segments and attaches to every copy the
+    // corresponding payload segment, if any, by reference. The copies are
+    // stored at the same positions in the output array. A position is set to
+    // null if the copy of the corresponding packet failed.
+    virtual void copy_pkts(std::span<const pkt_segs>, rte_mbuf**) noexcept = 0;
+    virtual void send_pkts(std::span<rte_mbuf* const>) noexcept            = 0;
+    virtual event_handle create_scheduler_event() noexcept                 = 0;
+    virtual event_block create_scheduler_events(uint32_t cnt) noexcept     = 0;
+    virtual void do_reports(std::span<const generation_report>) noexcept   = 0;
+    virtual void do_reports(std::span<const generation_report6>) noexcept  = 0;
 };
 
 } // namespace gen::priv
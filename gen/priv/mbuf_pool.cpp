@@ -15,11 +15,14 @@ mbuf_pool::mbuf_pool(config cfg)
     constexpr size_t huge_page_size = 2 * 1024 * 1024; // assume 2MB huge pages
     constexpr size_t other_fds      = 1024;
     constexpr size_t mbuf_size      = RTE_MBUF_DEFAULT_BUF_SIZE;
+    constexpr size_t hdr_mbuf_size  = RTE_PKTMBUF_HEADROOM + hdr_mbuf_data_size;
     constexpr size_t cache_size     = RTE_MEMPOOL_CACHE_MAX_SIZE;
     constexpr size_t priv_size      = 0;
     constexpr const char* name      = "tgn_mbuf_pool";
+    constexpr const char* hdr_name  = "tgn_hdr_mbuf_pool";
+    const size_t pools_size = cfg.cnt_mbufs * (mbuf_size + 2 * hdr_mbuf_size);
     const size_t cnt_fds =
-        other_fds + std::max(1uz, (cfg.cnt_mbufs * mbuf_size) / huge_page_size);
+        other_fds + std::max(1uz, pools_size / huge_page_size);
     if (auto res = put::set_max_count_fds(cnt_fds); !res) {
         put::throw_system_error(
             res.error(),
@@ -35,6 +38,21 @@ mbuf_pool::mbuf_pool(config cfg)
             cfg.cnt_mbufs);
     }
     pool_.reset(mp);
+
+    // Every transmitted packet needs one header mbuf and, if it has payload,
+    // one indirect mbuf for the attached payload. These mbufs are small and
+    // that's why their count is not separately configurable but it's twice
+    // the count of the main mbufs.
+    const uint32_t cnt_hdr_mbufs = cfg.cnt_mbufs * 2;
+    mp = rte_pktmbuf_pool_create(hdr_name, cnt_hdr_mbufs, cache_size, priv_size,
+                                 hdr_mbuf_size, cfg.socket_id);
+    if (!mp) {
+        put::throw_dpdk_error(
+            rte_errno,
+            "Failed to create mbufs memory pool with name:{} and size:{}",
+            hdr_name, cnt_hdr_mbufs);
+    }
+    hdr_pool_.reset(mp);
 }
 
 mbuf_pool::~mbuf_pool() noexcept                      = default;
@@ -3,15 +3,29 @@
 namespace gen::priv
 {
 
+// Two memory pools are kept:
+// - the main one with mbufs big enough to hold a whole MTU sized packet. These
+// mbufs are used for the RX packets and for the payload of the loaded packets.
+// - the header one with small mbufs which hold only the packet headers. These
+// mbufs are used for the per packet copy of the headers on transmission and
+// for the indirect mbufs which attach the shared payload to the headers.
 class mbuf_pool
 {
     struct mempool_free
     {
         void operator()(rte_mempool* p) const noexcept { rte_mempool_free(p); }
     };
-    std::unique_ptr<rte_mempool, mempool_free> pool_;
+    using mempool_ptr_type = std::unique_ptr<rte_mempool, mempool_free>;
+
+    mempool_ptr_type pool_;
+    mempool_ptr_type hdr_pool_;
 
 public:
+    // The data room of the header mbufs, excluding the headroom.
+    // It's enough for the Ethernet, the IPv4 and the TCP headers with options
+    // together with the L2 tags and the tunnel headers.
+    static constexpr size_t hdr_mbuf_data_size = 256;
+
     struct config
     {
         uint32_t cnt_mbufs;
@@ -31,6 +45,7 @@ public:
     mbuf_pool& operator=(const mbuf_pool&) = delete;
 
     rte_mempool* pool() noexcept { return pool_.get(); }
+    rte_mempool* hdr_pool() noexcept { return hdr_pool_.get(); }
     bool is_valid() const noexcept { return !!pool_; }
 };
 
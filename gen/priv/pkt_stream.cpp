@@ -0,0 +1,83 @@
+#include "gen/priv/pkt_stream.h"
+
+#include "put/throw.h"
+
+namespace gen::priv
+{
+
+// The helper thread pauses for a while when the ring is full or there are no
+// free mbufs. The window should last much longer than that.
+static constexpr uint32_t fill_pause_us = 100;
+
+pkt_stream::pkt_stream(const pkt_templates::config& cfg, mbuf_pool& pool)
+: reader_(cfg, pool), cnt_pkts_(reader_.count_pkts())
+{
+    if (cnt_pkts_ == 0) {
+        put::throw_runtime_error("Loaded no packets from {}", cfg.cap_fpath);
+    }
+    while (!reader_.is_eof()) {
+        pending_.clear();
+        if (!reader_.read(pending_)) {
+            put::throw_system_error(ENOMEM, "Failed to load packets from {}",
+                                    cfg.cap_fpath);
+        }
+    }
+    pending_.clear();
+    reader_.rewind();
+    if (!fill()) {
+        put::throw_system_error(ENOMEM, "Failed to load packets from {}",
+                                cfg.cap_fpath);
+    }
+    if (const int err = rte_ctrl_thread_create(&thread_, "tgn-stream", nullptr,
+                                               thread_main, this);
+        err != 0) {
+        put::throw_system_error(-err, "Failed to create stream thread for {}",
+                                cfg.cap_fpath);
+    }
+}
+
+pkt_stream::~pkt_stream() noexcept
+{
+    stop_.store(true, std::memory_order_relaxed);
+    ::pthread_join(thread_, nullptr);
+}
+
+// Returns true if any packets have been pushed in the ring
+bool pkt_stream::fill()
+{
+    bool ret = false;
+    for (;;) {
+        if (pending_pos_ == pending_.size()) {
+            pending_.clear();
+            pending_pos_ = 0;
+            if (reader_.is_eof()) reader_.rewind();
+            if (!reader_.read(pending_)) return ret;
+        }
+        const size_t cnt = pending_.size() - pending_pos_;
+        const size_t pushed =
+            ring_.try_push(pending_.data() + pending_pos_, cnt);
+        pending_pos_ += pushed;
+        ret          |= (pushed > 0);
+        if (pushed < cnt) return ret;
+    }
+}
+
+void pkt_stream::run() noexcept
+{
+    try {
+        while (!stop_.load(std::memory_order_relaxed)) {
+            if (!fill()) ::usleep(fill_pause_us);
+        }
+    } catch (const std::exception& ex) {
+        error_ = ex.what();
+        failed_.store(true, std::memory_order_release);
+    }
+}
+
+void* pkt_stream::thread_main(void* arg) noexcept
+{
+    static_cast<pkt_stream*>(arg)->run();
+    return nullptr;
+}
+
+} // namespace gen::priv
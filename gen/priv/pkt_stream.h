@@ -0,0 +1,90 @@
+#pragma once
+
+#include "gen/priv/pkt_templates.h"
+#include "put/spsc_ring.h"
+
+namespace gen::priv
+{
+class mbuf_pool;
+
+// Replays the packets of a capture which is too big to be loaded whole as
+// templates. Only a window of prepared packets, ahead of the generation, is
+// kept in mbufs. A helper thread reads the packets from the mapped capture,
+// prepares them the same way as the templates and pushes them through a
+// lock-free ring. The generation takes them from the other end of the ring.
+// The capture is read again from its beginning after its end. Thus the mbufs
+// taken by the stream don't depend on the size of the capture.
+// The helper thread is a DPDK control thread. The packets must be taken by a
+// single generation core.
+class pkt_stream
+{
+public:
+    using pkt = pkt_templates::pkt;
+    // The count of the packets kept ahead of the generation
+    static constexpr size_t window_size = 8192;
+
+private:
+    using ring_type = put::spsc_ring<pkt, window_size>;
+
+    // These members are used only by the helper thread, once started.
+    // The packets are read in batches and the rest of the batch which didn't
+    // fit in the ring waits for the next fill.
+    templates_reader reader_;
+    std::vector<pkt> pending_;
+    size_t pending_pos_ = 0;
+
+    const size_t cnt_pkts_;
+    ring_type ring_;
+    std::atomic<bool> stop_   = false;
+    std::atomic<bool> failed_ = false;
+    std::string error_; // set before `failed_`
+    pthread_t thread_;
+
+    // These members are used only by the generation core. The previous packet
+    // is kept until the next one is taken because its header and payload may
+    // still be referred to.
+    std::optional<pkt> cur_;
+    std::optional<pkt> prev_;
+
+public:
+    // Prepares all packets of the capture once, a batch at a time, so that
+    // bad packets fail the construction. Then fills the first window and
+    // starts the helper thread.
+    pkt_stream(const pkt_templates::config&, mbuf_pool&);
+    ~pkt_stream() noexcept;
+
+    pkt_stream()                             = delete;
+    pkt_stream(pkt_stream&&)                 = delete;
+    pkt_stream(const pkt_stream&)            = delete;
+    pkt_stream& operator=(pkt_stream&&)      = delete;
+    pkt_stream& operator=(const pkt_stream&) = delete;
+
+    // Returns null if the next packet hasn't been prepared yet.
+    const pkt* current() noexcept
+    {
+        if (!cur_) ring_.try_pop(cur_);
+        return cur_ ? &(*cur_) : nullptr;
+    }
+    // Moves to the next packet. The current packet must be present.
+    void advance() noexcept
+    {
+        prev_ = std::move(cur_);
+        cur_.reset();
+    }
+
+    // The count of the packets of a single run of the capture
+    size_t count_pkts() const noexcept { return cnt_pkts_; }
+    // The error which stopped the helper thread, if any
+    std::optional<std::string_view> error() const noexcept
+    {
+        if (!failed_.load(std::memory_order_acquire)) return std::nullopt;
+        return error_;
+    }
+
+private:
+    bool fill();
+    void run() noexcept;
+    static void* thread_main(void*) noexcept;
+};
+
+} // namespace gen::priv
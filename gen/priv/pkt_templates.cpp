@@ -0,0 +1,269 @@
+#include "gen/priv/pkt_templates.h"
+#include "gen/priv/mbuf_pool.h"
+
+#include "put/pkt_utils.h"
+#include "put/system_error.h"
+#include "put/throw.h"
+
+namespace gen::priv
+{
+
+// The packets are loaded from the capture file in batches of limited size
+static constexpr size_t max_load_batch = 64;
+
+// Moves the first `hdr_len` bytes of the packet to the given header mbuf.
+// The rest of the packet is left as payload, if anything is left.
+static void split_pkt(pkt_templates::pkt& pkt, size_t hdr_len) noexcept
+{
+    // The max length of the IPv4 header and of the TCP header is 60 bytes.
+    // The IPv6 header, without extension headers, is 40 bytes.
+    static_assert(mbuf_pool::hdr_mbuf_data_size >=
+                  (RTE_ETHER_HDR_LEN + put::max_l2_tags_len +
+                   put::max_tunnel_hdrs_len + 120));
+    // The header length is always less than the header mbuf data room.
+    char* data = rte_pktmbuf_append(pkt.hdr.get(), hdr_len);
+    ::memcpy(data, rte_pktmbuf_mtod(pkt.payload.get(), const char*), hdr_len);
+    rte_pktmbuf_adj(pkt.payload.get(), hdr_len);
+    if (rte_pktmbuf_pkt_len(pkt.payload.get()) == 0) pkt.payload.reset();
+}
+
+static std::vector<pkt_templates::pkt>
+load_pkts(const pkt_templates::config& cfg, mbuf_pool& pool)
+{
+    templates_reader reader(cfg, pool);
+    std::vector<pkt_templates::pkt> ret;
+    ret.reserve(reader.count_pkts());
+    while (!reader.is_eof()) {
+        if (!reader.read(ret)) {
+            put::throw_system_error(ENOMEM, "Failed to load packets from {}",
+                                    cfg.cap_fpath);
+        }
+    }
+    if (ret.empty()) {
+        put::throw_runtime_error("Loaded no packets from {}", cfg.cap_fpath);
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+pkt_templates::pkt_templates(const config& cfg, mbuf_pool& pool)
+: pkt_templates(load_pkts(cfg, pool))
+{
+}
+
+pkt_templates::pkt_templates(std::vector<pkt>&& pkts) : pkts_(std::move(pkts))
+{
+    // The flows generators rely on having at least one packet
+    if (pkts_.empty()) put::throw_runtime_error("No template packets");
+    pkts_bytes_.reserve(pkts_.size() + 1);
+    pkts_bytes_.push_back(0);
+    for (const auto& pkt : pkts_) {
+        pkts_bytes_.push_back(pkts_bytes_.back() + pkt.len);
+        cnt_mbufs_ += 1 + (pkt.payload ? pkt.payload->nb_segs : 0);
+    }
+}
+
+pkt_templates::~pkt_templates() noexcept                          = default;
+pkt_templates::pkt_templates(pkt_templates&&) noexcept            = default;
+pkt_templates& pkt_templates::operator=(pkt_templates&&) noexcept = default;
+
+////////////////////////////////////////////////////////////////////////////////
+
+templates_reader::templates_reader(const pkt_templates::config& cfg,
+                                   mbuf_pool& pool)
+: cfg_(cfg), pool_(&pool), tcap_(cfg.cap_fpath)
+{
+    rewind();
+}
+
+templates_reader::~templates_reader() noexcept                  = default;
+templates_reader::templates_reader(templates_reader&&) noexcept = default;
+templates_reader&
+templates_reader::operator=(templates_reader&&) noexcept = default;
+
+bool templates_reader::read(std::vector<pkt_templates::pkt>& out)
+{
+    // The header mbufs of the whole batch are taken at once as well.
+    std::array<rte_mbuf*, max_load_batch> hdrs;
+    std::array<tcap_loader::pkt, max_load_batch> pks;
+    const size_t cnt = std::min(max_load_batch, tcap_.count_left_pkts());
+    if (rte_pktmbuf_alloc_bulk(pool_->hdr_pool(), hdrs.data(), cnt) != 0) {
+        return false;
+    }
+    auto alloc_mbufs = [this](std::span<rte_mbuf*> mbufs) {
+        return rte_pktmbuf_alloc_bulk(pool_->pool(), mbufs.data(),
+                                      mbufs.size()) == 0;
+    };
+    auto res = tcap_.load_pkts({pks.data(), cnt}, alloc_mbufs);
+    if (!res) {
+        rte_pktmbuf_free_bulk(hdrs.data(), cnt);
+        if (res.error() == put::system_error_code(ENOMEM)) return false;
+        put::throw_system_error(res.error(), "Failed to load packets from {}",
+                                cfg_.cap_fpath);
+    }
+    // The loader may load less packets than asked for
+    const size_t loaded = res.value();
+    rte_pktmbuf_free_bulk(hdrs.data() + loaded, cnt - loaded);
+    const auto beg = out.size();
+    for (size_t i = 0; i < loaded; ++i) {
+        auto& pk = pks[i];
+        if (ipg_tstamp_) {
+            pk.tstamp    = *ipg_tstamp_;
+            *ipg_tstamp_ = *ipg_tstamp_ + *cfg_.inter_pkts_gap;
+        }
+        const auto rel_tstamp = prev_tstamp_ ? (pk.tstamp - *prev_tstamp_)
+                                             : pkt_templates::if_gap;
+        prev_tstamp_          = pk.tstamp;
+        out.push_back(pkt_templates::pkt{
+            .rel_tsc  = put::cycles::from_duration(rel_tstamp),
+            .hdr      = pkt_templates::mbuf_ptr_type(hdrs[i]),
+            .payload  = pkt_templates::mbuf_ptr_type(pk.mbuf),
+            .len      = pk.mbuf->pkt_len,
+            .from_cln = false, // Will be set later to a correct value
+            .l4_ports = 0,     // Will be set later, if TCP/UDP
+            .tx_meta  = {},    // Will be set later
+        });
+    }
+    for (auto& pkt : std::span(out).subspan(beg)) prepare_pkt(pkt);
+    return true;
+}
+
+void templates_reader::rewind() noexcept
+{
+    tcap_.rewind();
+    ipg_tstamp_.reset();
+    if (cfg_.inter_pkts_gap) ipg_tstamp_ = stdcr::microseconds{0};
+    prev_tstamp_.reset();
+}
+
+/*
+ * Verify that we can work with the packet and change the fields that don't
+ * change during the generation.
+ * The assumption is that the first packet is always from client to server.
+ * We need to make sure that the headers that we are going to change now or
+ * later are in the first segment of the packet. After that the packet is
+ * split to header and payload segments.
+ */
+void templates_reader::prepare_pkt(pkt_templates::pkt& pkt)
+{
+    // All packets of a capture are of the IP version of its address ranges.
+    // The IPv6 packets with extension headers are sent with the extension
+    // headers as they are and their ports aren't changed.
+    const bool ipv6 = cfg_.ipv6;
+    const uint16_t ether_type =
+        ipv6 ? RTE_ETHER_TYPE_IPV6 : RTE_ETHER_TYPE_IPV4;
+    // The L2 length is the offset of the inner IP header when there are
+    // tags or tunnel headers.
+    const auto& tags_layout   = cfg_.tags_layout;
+    const auto& tunnel_layout = cfg_.tunnel_layout;
+    const auto l2_len         = static_cast<uint16_t>(
+        tunnel_layout.outer_l2_len + tunnel_layout.hdrs_len());
+    rte_mbuf* mbuf = pkt.payload.get();
+    size_t offs    = 0;
+    auto* eh       = put::read_hdr_advance<rte_ether_hdr>(mbuf, offs);
+    if (!eh) {
+        put::throw_runtime_error(
+            "Detected too short/fragmented packet from {}", cfg_.cap_fpath);
+    }
+    if (const auto proto = ben::big_to_native(eh->ether_type);
+        proto != ether_type) {
+        put::throw_runtime_error(
+            "Detected non {} packet (proto: {}) from {}",
+            ipv6 ? "IPv6" : "IPv4", proto, cfg_.cap_fpath);
+    }
+    uint8_t l4_proto = 0;
+    size_t l3_len    = 0;
+    if (ipv6) {
+        const auto* ih = put::read_hdr_advance<rte_ipv6_hdr>(mbuf, offs);
+        if (ih) {
+            l4_proto = ih->proto;
+            l3_len   = sizeof(rte_ipv6_hdr);
+        }
+    } else if (const auto* ih =
+                   put::read_hdr_advance<rte_ipv4_hdr>(mbuf, offs);
+               ih) {
+        l4_proto = ih->next_proto_id;
+        l3_len   = put::hdr_len(ih);
+    }
+    if ((l3_len == 0) || (offs > rte_pktmbuf_data_len(mbuf))) {
+        put::throw_runtime_error(
+            "Detected too short/fragmented packet from {}", cfg_.cap_fpath);
+    }
+    if (!cln_ether_addr_) cln_ether_addr_ = eh->src_addr;
+    pkt.from_cln =
+        rte_is_same_ether_addr(&(*cln_ether_addr_), &eh->src_addr);
+    if (pkt.from_cln) {
+        eh->src_addr = cfg_.cln_ether_addr;
+        eh->dst_addr = cfg_.srv_ether_addr;
+    } else {
+        eh->src_addr = cfg_.srv_ether_addr;
+        eh->dst_addr = cfg_.cln_ether_addr;
+    }
+    // The TCP and UDP headers are always loaded because they are part of
+    // the header segment, even if we are not going to change the ports.
+    uint64_t l4_cksum_flag = 0;
+    auto set_ports         = [&pkt](const auto* hdr) {
+        const uint32_t src = ben::big_to_native(hdr->src_port);
+        const uint32_t dst = ben::big_to_native(hdr->dst_port);
+        pkt.l4_ports       = pkt.from_cln ? ((src << 16) | dst)
+                                          : ((dst << 16) | src);
+    };
+    switch (l4_proto) {
+    case IPPROTO_TCP: {
+        auto* th = put::read_hdr_advance<rte_tcp_hdr>(mbuf, offs);
+        if (!th || (offs > rte_pktmbuf_data_len(mbuf))) {
+            put::throw_runtime_error(
+                "Detected too short/fragmented packet from {}",
+                cfg_.cap_fpath);
+        }
+        set_ports(th);
+        l4_cksum_flag = RTE_MBUF_F_TX_TCP_CKSUM;
+        break;
+    }
+    case IPPROTO_UDP: {
+        auto* uh = put::read_hdr_advance<rte_udp_hdr>(mbuf, offs);
+        if (!uh) {
+            put::throw_runtime_error(
+                "Detected too short/fragmented packet from {}",
+                cfg_.cap_fpath);
+        }
+        set_ports(uh);
+        l4_cksum_flag = RTE_MBUF_F_TX_UDP_CKSUM;
+        break;
+    }
+    }
+    if (!put::insert_tunnel_hdrs(mbuf, tunnel_layout) ||
+        !put::insert_l2_tags(mbuf, tags_layout)) {
+        put::throw_runtime_error(
+            "No room for the tags/tunnel headers of packet from {}",
+            cfg_.cap_fpath);
+    }
+    offs   += l2_len - RTE_ETHER_HDR_LEN;
+    pkt.len = rte_pktmbuf_pkt_len(mbuf);
+    // The checksums of the packet need to be (re)calculated after the
+    // changes. Either the hardware does it, for which we need to set the
+    // appropriate flags, or the checksums of the template are calculated
+    // now and only updated for the changed addresses later.
+    // Note that the L4 checksum flags are values of a field and not bits.
+    // The IPv6 header has no checksum.
+    if (cfg_.sw_cksum) {
+        pkt.tx_meta = ipv6 ? put::make_ipv6_sw_tx_meta(mbuf, l2_len)
+                           : put::make_ipv4_sw_tx_meta(mbuf, l2_len);
+    } else {
+        const auto flags =
+            (ipv6 ? RTE_MBUF_F_TX_IPV6
+                  : (RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM)) |
+            l4_cksum_flag;
+        const auto l3_len16 = static_cast<uint16_t>(l3_len);
+        pkt.tx_meta =
+            tunnel_layout.empty()
+                ? put::make_hw_tx_meta(flags, l2_len, l3_len16)
+                : put::make_tunnel_hw_tx_meta(flags, tunnel_layout,
+                                              l3_len16);
+        put::init_l4_tx_meta(pkt.tx_meta, mbuf);
+    }
+    split_pkt(pkt, offs);
+}
+
+} // namespace gen::priv
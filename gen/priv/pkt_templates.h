@@ -0,0 +1,137 @@
+#pragma once
+
+#include "gen/priv/tcap_loader.h"
+#include "put/pkt_rewrite.h"
+#include "put/time_utils.h"
+
+namespace gen::priv
+{
+class mbuf_pool;
+
+// The template packets of a capture, loaded and prepared for the generation.
+// They are built off the generation cores and are never changed afterwards.
+// Thus they are shared by the generators of the capture on all workers.
+// The payload segments are attached by reference to the copies sent by all
+// workers and their reference counters are updated atomically. The counters
+// are 16 bits and the generation manager limits the packets in flight of all
+// workers so that they can't wrap around.
+class pkt_templates
+{
+public:
+    // The gap between flows with the same index i.e. when the same flow is
+    // restarted because its duration is shorter than the duration of the whole
+    // test. It's the relative timestamp of the first packet.
+    static constexpr stdcr::milliseconds if_gap{100};
+
+    struct mbuf_free
+    {
+        void operator()(rte_mbuf* p) const noexcept { rte_pktmbuf_free(p); }
+    };
+    using mbuf_ptr_type = std::unique_ptr<rte_mbuf, mbuf_free>;
+    // Every packet is split upon loading into two segments. The first one
+    // contains only the packet headers and it's copied for every transmission
+    // because some of the header fields change per flow. The second one
+    // contains the packet payload, if any, and it's never changed. It's
+    // attached by reference to the copy of the header segment.
+    struct pkt
+    {
+        put::cycles rel_tsc; // relative timestamp
+        mbuf_ptr_type hdr;
+        mbuf_ptr_type payload; // null, if the packet has no payload
+        uint32_t len;          // the length of the whole packet
+        bool from_cln; // true - client to server, false - server to client
+        // The client port in the high half and the server port in the low
+        // half, in host byte order. Zero if the packet isn't TCP/UDP.
+        uint32_t l4_ports;
+        put::tx_meta tx_meta;
+    };
+
+private:
+    std::vector<pkt> pkts_;
+    // The total length of the packets before every packet and of all packets
+    std::vector<uint64_t> pkts_bytes_;
+    // The count of the header and the payload mbufs of all packets
+    size_t cnt_mbufs_ = 0;
+
+public:
+    // The VLAN and MPLS tags and the tunnel headers are inserted in the
+    // templates and only their values are written for every sent packet.
+    struct config
+    {
+        stdfs::path cap_fpath;
+        rte_ether_addr cln_ether_addr;
+        rte_ether_addr srv_ether_addr;
+        std::optional<stdcr::microseconds> inter_pkts_gap;
+        bool ipv6; // all packets must be of this IP version
+        put::l2_tags_layout tags_layout;
+        put::tunnel_layout tunnel_layout;
+        bool sw_cksum; // the checksums are updated in software, not by the NIC
+        bool stream;   // streamed by `pkt_stream` instead of loaded whole
+    };
+
+public:
+    // Loads the packets from the capture file. Can be called from any thread,
+    // EAL or not. Both constructors throw if there are no packets.
+    pkt_templates(const config&, mbuf_pool&);
+    // Takes packets which have already been prepared
+    explicit pkt_templates(std::vector<pkt>&&);
+    ~pkt_templates() noexcept;
+
+    pkt_templates(pkt_templates&&) noexcept;
+    pkt_templates& operator=(pkt_templates&&) noexcept;
+
+    pkt_templates()                                = delete;
+    pkt_templates(const pkt_templates&)            = delete;
+    pkt_templates& operator=(const pkt_templates&) = delete;
+
+    std::span<const pkt> pkts() const noexcept { return pkts_; }
+    std::span<const uint64_t> pkts_bytes() const noexcept
+    {
+        return pkts_bytes_;
+    }
+    size_t cnt_mbufs() const noexcept { return cnt_mbufs_; }
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+// Reads the packets of a capture and prepares them as templates, a batch at a
+// time. The capture is validated and indexed upon construction. Every read of
+// the capture after a rewind gives the same packets.
+class templates_reader
+{
+    pkt_templates::config cfg_;
+    mbuf_pool* pool_;
+    tcap_loader tcap_;
+    // Every time-stamp is relative to the time-stamp of the previous packet.
+    // The time-stamp of the first packet is the gap between the flows and
+    // it's relative to the last packet of the previous run of the flow.
+    std::optional<stdcr::microseconds> ipg_tstamp_;
+    std::optional<stdcr::nanoseconds> prev_tstamp_;
+    // The source address of the first packet is the client one
+    std::optional<rte_ether_addr> cln_ether_addr_;
+
+public:
+    templates_reader(const pkt_templates::config&, mbuf_pool&);
+    ~templates_reader() noexcept;
+
+    templates_reader(templates_reader&&) noexcept;
+    templates_reader& operator=(templates_reader&&) noexcept;
+
+    templates_reader()                                   = delete;
+    templates_reader(const templates_reader&)            = delete;
+    templates_reader& operator=(const templates_reader&) = delete;
+
+    // Reads the next packets, up to a batch, and appends them to `out`.
+    // Returns false, without reading anything, if there are no mbufs for
+    // them. Throws if a packet can't be used as a template.
+    bool read(std::vector<pkt_templates::pkt>& out);
+    void rewind() noexcept;
+
+    size_t count_pkts() const noexcept { return tcap_.count_pkts(); }
+    bool is_eof() const noexcept { return tcap_.is_eof(); }
+
+private:
+    void prepare_pkt(pkt_templates::pkt&);
+};
+
+} // namespace gen::priv
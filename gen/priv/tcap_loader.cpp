@@ -1,34 +1,273 @@
 #include "gen/priv/tcap_loader.h"
 
+#include "put/num_utils.h"
 #include "put/system_error.h"
 #include "put/throw.h"
 
 namespace gen::priv
 {
 
-tcap_loader::tcap_loader(const stdfs::path& pcap_path)
+// The magic numbers of the classic PCAP as read in the byte order of the file
+static constexpr uint32_t pcap_usec_magic = 0xA1B2C3D4;
+static constexpr uint32_t pcap_nsec_magic = 0xA1B23C4D;
+static constexpr size_t pcap_file_hdr_len = 24;
+static constexpr size_t pcap_pkt_hdr_len  = 16;
+// The PCAPNG block types. The type of the section header block reads the same
+// in both byte orders.
+static constexpr uint32_t pcapng_shb_type   = 0x0A0D0D0A;
+static constexpr uint32_t pcapng_idb_type   = 0x00000001;
+static constexpr uint32_t pcapng_spb_type   = 0x00000003;
+static constexpr uint32_t pcapng_epb_type   = 0x00000006;
+static constexpr uint32_t pcapng_bom_magic  = 0x1A2B3C4D;
+static constexpr uint16_t pcapng_opt_end    = 0;
+static constexpr uint16_t pcapng_opt_tsres  = 9;
+static constexpr uint32_t linktype_ethernet = 1;
+// The packets are copied in batches of up to so many packets
+static constexpr size_t max_bulk_size = 64;
+
+namespace
+{
+
+// The fields of the file are read in the byte order of the file and every read
+// is checked against the end of the file.
+class file_view
+{
+    std::span<const uint8_t> data_;
+    const stdfs::path* fpath_;
+    bool swapped_ = false;
+
+public:
+    file_view(std::span<const uint8_t> data, const stdfs::path& fpath) noexcept
+    : data_(data), fpath_(&fpath)
+    {
+    }
+
+    size_t size() const noexcept { return data_.size(); }
+    void set_swapped(bool swapped) noexcept { swapped_ = swapped; }
+
+    template <typename T>
+    T read(size_t off) const
+    {
+        check(off, sizeof(T));
+        T ret;
+        ::memcpy(&ret, data_.data() + off, sizeof(T));
+        return swapped_ ? ben::endian_reverse(ret) : ret;
+    }
+
+    void check(size_t off, size_t len) const
+    {
+        if ((off > data_.size()) || (len > (data_.size() - off))) {
+            fail(off, "truncated file");
+        }
+    }
+
+    [[noreturn]] void fail(size_t off, std::string_view what) const
+    {
+        put::throw_runtime_error("Invalid capture file {} at offset {}: {}",
+                                 *fpath_, off, what);
+    }
+};
+
+// The timestamps are converted to nanoseconds as `ts * mul / div`
+struct ts_unit
+{
+    uint64_t mul;
+    uint64_t div;
+
+    uint64_t to_nsec(uint64_t ts) const noexcept
+    {
+        return static_cast<uint64_t>((put::uint128(ts) * mul) / div);
+    }
+};
+
+} // namespace
+
+static std::vector<tcap_loader::pkt_rec> index_pcap(file_view& fv)
+{
+    const uint32_t magic = fv.read<uint32_t>(0);
+    fv.set_swapped((magic != pcap_usec_magic) && (magic != pcap_nsec_magic));
+    const uint32_t file_magic = fv.read<uint32_t>(0);
+    if ((file_magic != pcap_usec_magic) && (file_magic != pcap_nsec_magic)) {
+        fv.fail(0, "unknown file format");
+    }
+    const bool nsec = (file_magic == pcap_nsec_magic);
+    if (fv.read<uint16_t>(4) != PCAP_VERSION_MAJOR) {
+        fv.fail(4, "unsupported version");
+    }
+    // The upper bits of the link type may carry the FCS length.
+    if ((fv.read<uint32_t>(20) & 0xFFFF) != linktype_ethernet) {
+        fv.fail(20, "non Ethernet link type");
+    }
+    const uint64_t frac_mul = nsec ? 1 : 1'000;
+    std::vector<tcap_loader::pkt_rec> ret;
+    for (size_t off = pcap_file_hdr_len; off < fv.size();) {
+        const uint64_t sec    = fv.read<uint32_t>(off);
+        const uint64_t frac   = fv.read<uint32_t>(off + 4);
+        const uint32_t caplen = fv.read<uint32_t>(off + 8);
+        const uint32_t len    = fv.read<uint32_t>(off + 12);
+        const size_t data_off = off + pcap_pkt_hdr_len;
+        // We can't work with partially captured packets
+        if (caplen != len) fv.fail(off, "partially captured packet");
+        fv.check(data_off, caplen);
+        ret.push_back({
+            .off    = data_off,
+            .len    = caplen,
+            .tstamp = (sec * 1'000'000'000) + (frac * frac_mul),
+        });
+        off = data_off + caplen;
+    }
+    return ret;
+}
+
+static uint64_t pow10(uint32_t exp) noexcept
+{
+    uint64_t ret = 1;
+    while (exp-- > 0) ret *= 10;
+    return ret;
+}
+
+// The default resolution is microseconds. Otherwise it's a negative power of
+// 10 or, if the high bit is set, of 2.
+static ts_unit
+read_pcapng_ts_unit(const file_view& fv, size_t beg, size_t end)
+{
+    ts_unit ret{.mul = 1'000, .div = 1};
+    for (size_t off = beg; (off + 4) <= end;) {
+        const uint16_t code = fv.read<uint16_t>(off);
+        const uint16_t len  = fv.read<uint16_t>(off + 2);
+        if (code == pcapng_opt_end) break;
+        if ((code == pcapng_opt_tsres) && (len >= 1)) {
+            const uint8_t res = fv.read<uint8_t>(off + 4);
+            const uint8_t exp = res & 0x7F;
+            if (res & 0x80) {
+                if (exp > 63) fv.fail(off, "invalid timestamp resolution");
+                ret = {.mul = 1'000'000'000, .div = 1ull << exp};
+            } else {
+                if (exp > 19) fv.fail(off, "invalid timestamp resolution");
+                ret = (exp > 9) ? ts_unit{.mul = 1, .div = pow10(exp - 9)}
+                                : ts_unit{.mul = pow10(9 - exp), .div = 1};
+            }
+        }
+        // The option values are padded to 32 bits
+        off += 4 + ((len + 3u) & ~3u);
+    }
+    return ret;
+}
+
+static std::vector<tcap_loader::pkt_rec> index_pcapng(file_view& fv)
+{
+    // The byte order, and the interfaces, may change with every section.
+    std::vector<ts_unit> ifaces;
+    uint64_t prev_tstamp = 0;
+    std::vector<tcap_loader::pkt_rec> ret;
+    for (size_t off = 0; off < fv.size();) {
+        const uint32_t type = fv.read<uint32_t>(off);
+        if (type == pcapng_shb_type) {
+            fv.set_swapped(false);
+            const uint32_t bom = fv.read<uint32_t>(off + 8);
+            if (bom != pcapng_bom_magic) {
+                if (ben::endian_reverse(bom) != pcapng_bom_magic) {
+                    fv.fail(off, "invalid byte order magic");
+                }
+                fv.set_swapped(true);
+            }
+            if (fv.read<uint16_t>(off + 12) != 1) {
+                fv.fail(off, "unsupported version");
+            }
+            ifaces.clear();
+        }
+        const uint32_t blk_len = fv.read<uint32_t>(off + 4);
+        if ((blk_len < 12) || ((blk_len % 4) != 0)) {
+            fv.fail(off, "invalid block length");
+        }
+        fv.check(off, blk_len);
+        if (fv.read<uint32_t>(off + blk_len - 4) != blk_len) {
+            fv.fail(off, "mismatched block lengths");
+        }
+        const size_t body     = off + 8;
+        const size_t body_end = off + blk_len - 4;
+        switch (type) {
+        case pcapng_idb_type:
+            if (fv.read<uint16_t>(body) != linktype_ethernet) {
+                fv.fail(off, "non Ethernet link type");
+            }
+            ifaces.push_back(read_pcapng_ts_unit(fv, body + 8, body_end));
+            break;
+        case pcapng_epb_type: {
+            const uint32_t iface  = fv.read<uint32_t>(body);
+            const uint64_t ts_hi  = fv.read<uint32_t>(body + 4);
+            const uint64_t ts_lo  = fv.read<uint32_t>(body + 8);
+            const uint32_t caplen = fv.read<uint32_t>(body + 12);
+            const uint32_t len    = fv.read<uint32_t>(body + 16);
+            if (iface >= ifaces.size()) fv.fail(off, "unknown interface");
+            if (caplen != len) fv.fail(off, "partially captured packet");
+            if ((body + 20 + caplen) > body_end) {
+                fv.fail(off, "invalid packet length");
+            }
+            prev_tstamp = ifaces[iface].to_nsec((ts_hi << 32) | ts_lo);
+            ret.push_back({
+                .off    = body + 20,
+                .len    = caplen,
+                .tstamp = prev_tstamp,
+            });
+            break;
+        }
+        case pcapng_spb_type: {
+            // The simple packets have no captured length. They are whole
+            // only if they fill the block.
+            const uint32_t len = fv.read<uint32_t>(body);
+            if (ifaces.empty()) fv.fail(off, "unknown interface");
+            if ((body + 4 + len) > body_end) {
+                fv.fail(off, "partially captured packet");
+            }
+            ret.push_back({
+                .off    = body + 4,
+                .len    = len,
+                .tstamp = prev_tstamp,
+            });
+            break;
+        }
+        }
+        off += blk_len;
+    }
+    return ret;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+tcap_loader::tcap_loader(const stdfs::path& fpath)
 {
-    decltype(file_) file(::fopen(pcap_path.c_str(), "r"));
-    if (!file) {
-        put::throw_system_error(errno, "Failed to open PCAP file: {}",
-                                pcap_path);
+    const int fd = ::open(fpath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        put::throw_system_error(errno, "Failed to open capture file: {}",
+                                fpath);
     }
+    stdex::scope_exit close_fd([fd] { ::close(fd); });
 
-    pcap_file_header hdr = {};
-    if (::fread(&hdr, sizeof(hdr), 1, file.get()) != 1u) {
-        put::throw_system_error(
-            errno, "Failed to read PCAP file header from: {}", pcap_path);
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0) {
+        put::throw_system_error(errno, "Failed to get the size of: {}", fpath);
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(uint32_t)) {
+        put::throw_runtime_error("Invalid capture file: {}", fpath);
     }
 
-    constexpr uint32_t pcap_magic = 0xA1B2C3D4;
-    if ((hdr.magic != pcap_magic) ||
-        (hdr.version_major != PCAP_VERSION_MAJOR) ||
-        (hdr.version_minor != PCAP_VERSION_MINOR)) {
-        put::throw_runtime_error("Read invalid PCAP file header from: {}",
-                                 pcap_path);
+    // The whole file is read sequentially, first while indexing the packets
+    // and then while loading them. Thus it's populated upfront.
+    void* addr =
+        ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        put::throw_system_error(errno, "Failed to map capture file: {}",
+                                fpath);
     }
+    decltype(data_) data(static_cast<const uint8_t*>(addr), unmapper{size});
+    ::madvise(addr, size, MADV_SEQUENTIAL);
 
-    file_ = std::move(file);
+    file_view fv({data.get(), size}, fpath);
+    recs_ = (fv.read<uint32_t>(0) == pcapng_shb_type) ? index_pcapng(fv)
+                                                      : index_pcap(fv);
+    data_ = std::move(data);
 }
 
 tcap_loader::tcap_loader() noexcept                         = default;
@@ -36,57 +275,46 @@ tcap_loader::~tcap_loader() noexcept                        = default;
 tcap_loader::tcap_loader(tcap_loader&&) noexcept            = default;
 tcap_loader& tcap_loader::operator=(tcap_loader&&) noexcept = default;
 
-bout::result<tcap_loader::pkt>
-tcap_loader::load_pkt(put::fun_ref<rte_mbuf*()> alloc_mbuf) noexcept
+bout::result<size_t> tcap_loader::load_pkts(std::span<pkt> out,
+                                            alloc_fn_type alloc_mbufs) noexcept
 {
-    // Can't use the original `pcap_pkthdr` because the timestamp field
-    // written to the disk is expected to contain two 32 bit values but
-    // `struct timeval` contains two 64 bit values on 64 bit Linux.
-    /*
-    struct pcap_pkthdr {
-        timeval ts;
-        uint32_t caplen;
-        uint32_t len;
-    };
-    */
-    struct
-    {
-        uint32_t sec;
-        uint32_t usec;
-        uint32_t caplen;
-        uint32_t len;
-    } hdr = {};
-    if (::fread(&hdr, sizeof(hdr), 1, file_.get()) != 1) {
-        return put::system_error_code(errno);
-    }
-    // We can't work with partially captured packets
-    if (hdr.caplen != hdr.len) return put::system_error_code(EINVAL);
-    rte_mbuf* head = alloc_mbuf();
-    rte_mbuf* curr = head;
-    rte_mbuf* prev = nullptr;
-    if (!head) return put::system_error_code(ENOMEM);
-    stdex::scope_exit exit_guard([head] { rte_pktmbuf_free(head); });
-    for (uint32_t rdlen = 0; rdlen < hdr.caplen; prev = curr) {
-        if (prev) {
-            curr = alloc_mbuf();
-            if (!curr) return put::system_error_code(ENOMEM);
-            prev->next = curr;
+    const size_t cnt =
+        std::min({out.size(), recs_.size() - next_, max_bulk_size});
+    if (cnt == 0) return 0;
+    // The first segments of all packets are taken at once. The packets which
+    // don't fit in a single mbuf are rare and their next segments are taken
+    // one by one.
+    std::array<rte_mbuf*, max_bulk_size> mbufs;
+    if (!alloc_mbufs({mbufs.data(), cnt})) {
+        return put::system_error_code(ENOMEM);
+    }
+    for (size_t i = 0; i < cnt; ++i) {
+        const auto& rec    = recs_[next_ + i];
+        const uint8_t* src = data_.get() + rec.off;
+        rte_mbuf* head     = mbufs[i];
+        rte_mbuf* seg      = head;
+        for (uint32_t left = rec.len;;) {
+            const auto len =
+                std::min<uint32_t>(left, rte_pktmbuf_tailroom(seg));
+            ::memcpy(rte_pktmbuf_mtod(seg, uint8_t*), src, len);
+            seg->data_len  = len;
+            head->pkt_len += len;
+            src           += len;
+            left          -= len;
+            if (left == 0) break;
+            rte_mbuf* next = nullptr;
+            if (!alloc_mbufs({&next, 1})) {
+                rte_pktmbuf_free_bulk(mbufs.data(), cnt);
+                return put::system_error_code(ENOMEM);
+            }
+            seg->next = next;
+            seg       = next;
             head->nb_segs++;
         }
-        const auto len =
-            std::min<uint32_t>(hdr.caplen - rdlen, rte_pktmbuf_tailroom(curr));
-        if (::fread(rte_pktmbuf_mtod(curr, char*), len, 1, file_.get()) != 1) {
-            return put::system_error_code(errno);
-        }
-        curr->data_len = len;
-        head->pkt_len += len;
-        rdlen += len;
-    }
-    exit_guard.release();
-    return pkt{
-        .tstamp = stdcr::microseconds((hdr.sec * 1'000'000ull) + hdr.usec),
-        .mbuf   = head,
-    };
+        out[i] = {.tstamp = stdcr::nanoseconds(rec.tstamp), .mbuf = head};
+    }
+    next_ += cnt;
+    return cnt;
 }
 
 } // namespace gen::priv
@@ -5,13 +5,40 @@
 namespace gen::priv
 {
 
+// Loads the packets of a capture file. The supported formats are:
+// - the classic PCAP with microsecond or nanosecond timestamps in both byte
+// orders.
+// - the PCAPNG with any number of sections and interfaces. Only the enhanced
+// and the simple packet blocks carry packets and all other blocks are
+// skipped. The simple packets get the timestamp of the previous packet.
+// All packets must be Ethernet ones and must be captured whole.
+// The file is mapped in the memory and all its records are validated upon
+// opening in a single pass which also indexes the packets. The packets are
+// then copied straight from the mapped file to mbufs taken in bulk.
 class tcap_loader
 {
-    struct fcloser
+    struct unmapper
     {
-        void operator()(FILE* f) const noexcept { ::fclose(f); }
+        size_t size;
+        void operator()(const uint8_t* p) const noexcept
+        {
+            ::munmap(const_cast<uint8_t*>(p), size);
+        }
     };
-    std::unique_ptr<FILE, fcloser> file_;
+
+public:
+    // The position of the data of every packet in the file
+    struct pkt_rec
+    {
+        uint64_t off;
+        uint32_t len;
+        uint64_t tstamp; // in nanoseconds
+    };
+
+private:
+    std::unique_ptr<const uint8_t, unmapper> data_;
+    std::vector<pkt_rec> recs_;
+    size_t next_ = 0;
 
 public:
     explicit tcap_loader(const stdfs::path&);
@@ -26,14 +53,22 @@ public:
 
     struct pkt
     {
-        stdcr::microseconds tstamp;
+        stdcr::nanoseconds tstamp;
         rte_mbuf* mbuf;
     };
-    bout::result<pkt> load_pkt(put::fun_ref<rte_mbuf*()>) noexcept;
+    // The function must allocate either all given mbufs or none of them
+    using alloc_fn_type = put::fun_ref<bool(std::span<rte_mbuf*>)>;
+    // Loads the next packets, up to `out.size()`, and returns their count.
+    // Nothing is loaded if an error is returned.
+    bout::result<size_t> load_pkts(std::span<pkt> out, alloc_fn_type) noexcept;
 
-    bool is_eof() const noexcept { return ::feof(file_.get()); }
+    size_t count_pkts() const noexcept { return recs_.size(); }
+    size_t count_left_pkts() const noexcept { return recs_.size() - next_; }
+    bool is_eof() const noexcept { return next_ == recs_.size(); }
+    // The next load starts from the first packet again
+    void rewind() noexcept { next_ = 0; }
 
-    bool is_valid() const noexcept { return !!file_; }
+    bool is_valid() const noexcept { return !!data_; }
 };
 
 } // namespace gen::priv
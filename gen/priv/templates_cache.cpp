@@ -0,0 +1,405 @@
+#include "gen/priv/templates_cache.h"
+#include "gen/priv/mbuf_pool.h"
+
+#include "put/throw.h"
+
+namespace gen::priv
+{
+
+// Changed on every change of the layout of the file or of the meaning of
+// the stored data.
+static constexpr uint64_t file_magic   = 0x314C504D544E4754; // "TGNTMPL1"
+static constexpr uint32_t file_version = 1;
+// The packets are copied in batches of up to so many packets
+static constexpr size_t max_bulk_size = 64;
+// The data is written through a buffer of this size
+static constexpr size_t write_buf_size = 1024 * 1024;
+
+namespace
+{
+
+struct file_hdr
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t rec_size;
+    uint64_t cap_size;
+    int64_t cap_mtime;
+    uint64_t key_len;
+    uint64_t cnt_pkts;
+    uint64_t data_size;
+};
+static_assert((sizeof(file_hdr) % 8) == 0);
+
+// The header segment of the packet is followed by its payload, if any, in the
+// packet data. The relative timestamps are kept in nanoseconds because the
+// TSC frequency is measured anew on every start.
+struct pkt_rec
+{
+    int64_t rel_nsec;
+    uint64_t data_off; // from the beginning of the packet data
+    uint32_t len;      // of the whole packet
+    uint16_t hdr_len;
+    uint8_t from_cln;
+    uint32_t l4_ports;
+    put::tx_meta tx_meta;
+};
+static_assert(std::is_trivially_copyable_v<pkt_rec>);
+static_assert((sizeof(pkt_rec) % 8) == 0);
+
+// The offsets of the parts of the file
+struct file_layout
+{
+    size_t recs_off;
+    size_t data_off;
+    size_t size;
+
+    file_layout(const file_hdr& hdr) noexcept
+    : recs_off(RTE_ALIGN_CEIL(sizeof(file_hdr) + hdr.key_len, 8))
+    , data_off(recs_off + (hdr.cnt_pkts * sizeof(pkt_rec)))
+    , size(data_off + hdr.data_size)
+    {
+    }
+};
+
+class fd_writer
+{
+    int fd_;
+    std::vector<uint8_t> buf_;
+
+public:
+    explicit fd_writer(int fd) : fd_(fd) { buf_.reserve(write_buf_size); }
+
+    void write(const void* data, size_t len)
+    {
+        if ((buf_.size() + len) > write_buf_size) flush();
+        if (len >= write_buf_size) {
+            write_all(data, len);
+        } else {
+            const auto* p = static_cast<const uint8_t*>(data);
+            buf_.insert(buf_.end(), p, p + len);
+        }
+    }
+
+    void flush()
+    {
+        write_all(buf_.data(), buf_.size());
+        buf_.clear();
+    }
+
+private:
+    void write_all(const void* data, size_t len)
+    {
+        for (const auto* p = static_cast<const uint8_t*>(data); len > 0;) {
+            const ssize_t ret = ::write(fd_, p, len);
+            if (ret < 0) {
+                if (errno == EINTR) continue;
+                put::throw_system_error(errno, "Failed to write cache file");
+            }
+            p   += ret;
+            len -= ret;
+        }
+    }
+};
+
+} // namespace
+
+static stdfs::path file_path(const stdfs::path& dir, std::string_view key)
+{
+    return dir / fmt::format("{:016x}.tgc", std::hash<std::string_view>{}(key));
+}
+
+static int64_t to_nsec(put::cycles cyc) noexcept
+{
+    const uint64_t hz = put::cycles::frequency_hz();
+    return static_cast<int64_t>(((cyc.num / hz) * 1'000'000'000) +
+                                (((cyc.num % hz) * 1'000'000'000) / hz));
+}
+
+// The records are written to the file as they are and thus all of their
+// bytes, including the padding ones, must be defined. Otherwise the same
+// capture would give different cache files. The record is zeroed first and
+// then every field, including the ones of the TX metadata, is set one by one
+// because a copy of a whole struct may copy its padding as well.
+static void fill_pkt_rec(pkt_rec& rec,
+                         const pkt_templates::pkt& pkt,
+                         uint64_t data_off) noexcept
+{
+    ::memset(&rec, 0, sizeof(rec));
+    rec.rel_nsec = to_nsec(pkt.rel_tsc);
+    rec.data_off = data_off;
+    rec.len      = pkt.len;
+    rec.hdr_len  = rte_pktmbuf_data_len(pkt.hdr.get());
+    rec.from_cln = pkt.from_cln;
+    rec.l4_ports = pkt.l4_ports;
+
+    // A new field of the TX metadata needs to be copied here as well.
+    static_assert(sizeof(put::tx_meta) == 48);
+    auto& dst         = rec.tx_meta;
+    const auto& src   = pkt.tx_meta;
+    dst.ol_flags      = src.ol_flags;
+    dst.tx_offload    = src.tx_offload;
+    dst.l2_len        = src.l2_len;
+    dst.sw_cksum      = src.sw_cksum;
+    dst.l4_cksum_off  = src.l4_cksum_off;
+    dst.ip_cksum_base = src.ip_cksum_base;
+    dst.l4_cksum_base = src.l4_cksum_base;
+    dst.l4_off        = src.l4_off;
+    dst.l4_ports      = src.l4_ports;
+    dst.tcp_seq_off   = src.tcp_seq_off;
+    dst.tcp_has_ack   = src.tcp_has_ack;
+    dst.tcp_seq       = src.tcp_seq;
+    dst.tcp_ack       = src.tcp_ack;
+}
+
+// Copies the data to the segments of the given mbuf. The next segments are
+// taken one by one from the pool.
+static bool copy_to_mbuf(rte_mbuf* head,
+                         const uint8_t* src,
+                         size_t left,
+                         rte_mempool* pool) noexcept
+{
+    for (rte_mbuf* seg = head;;) {
+        const auto len = std::min<size_t>(left, rte_pktmbuf_tailroom(seg));
+        ::memcpy(rte_pktmbuf_mtod(seg, uint8_t*), src, len);
+        seg->data_len  = len;
+        head->pkt_len += len;
+        src           += len;
+        left          -= len;
+        if (left == 0) return true;
+        rte_mbuf* next = rte_pktmbuf_alloc(pool);
+        if (!next) return false;
+        seg->next = next;
+        seg       = next;
+        head->nb_segs++;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+templates_cache::templates_cache(const stdfs::path& dir) : dir_(dir)
+{
+    std::error_code ec;
+    stdfs::create_directories(dir_, ec);
+    if (ec) {
+        put::throw_system_error(ec.value(),
+                                "Failed to create the templates cache dir: {}",
+                                dir_);
+    }
+}
+
+templates_cache::~templates_cache() noexcept                  = default;
+templates_cache::templates_cache(templates_cache&&) noexcept = default;
+templates_cache&
+templates_cache::operator=(templates_cache&&) noexcept = default;
+
+std::optional<templates_cache::file_stamp>
+templates_cache::stamp_of(const stdfs::path& fpath) noexcept
+{
+    struct stat st = {};
+    if (::stat(fpath.c_str(), &st) != 0) return std::nullopt;
+    return file_stamp{
+        .size  = static_cast<uint64_t>(st.st_size),
+        .mtime = (int64_t(st.st_mtim.tv_sec) * 1'000'000'000) +
+                 st.st_mtim.tv_nsec,
+    };
+}
+
+// The fields are added one by one so that there is no padding.
+std::string templates_cache::key_of(const pkt_templates::config& cfg)
+{
+    std::string ret;
+    auto add = [&ret](const auto& val) {
+        static_assert(std::is_trivially_copyable_v<
+                      std::remove_cvref_t<decltype(val)>>);
+        ret.append(reinterpret_cast<const char*>(&val), sizeof(val));
+    };
+    const auto& tags   = cfg.tags_layout;
+    const auto& tunnel = cfg.tunnel_layout;
+    add(cfg.cln_ether_addr.addr_bytes);
+    add(cfg.srv_ether_addr.addr_bytes);
+    add(cfg.inter_pkts_gap ? cfg.inter_pkts_gap->count() : int64_t(-1));
+    add(cfg.ipv6);
+    add(tags.cnt_vlans);
+    add(tags.hw_vlans);
+    add(tags.mpls);
+    add(tunnel.type);
+    add(tunnel.outer_l2_len);
+    add(tunnel.hw_cksum);
+    add(cfg.sw_cksum);
+    ret += stdfs::weakly_canonical(cfg.cap_fpath).native();
+    return ret;
+}
+
+std::optional<pkt_templates>
+templates_cache::load(const pkt_templates::config& cfg,
+                      const file_stamp& stamp,
+                      mbuf_pool& pool) const
+{
+    const auto key   = key_of(cfg);
+    const auto fpath = file_path(dir_, key);
+    const int fd     = ::open(fpath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::nullopt;
+    stdex::scope_exit close_fd([fd] { ::close(fd); });
+
+    struct stat st = {};
+    if ((::fstat(fd, &st) != 0) || (size_t(st.st_size) < sizeof(file_hdr))) {
+        return std::nullopt;
+    }
+    const auto size = static_cast<size_t>(st.st_size);
+    void* addr =
+        ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    if (addr == MAP_FAILED) return std::nullopt;
+    stdex::scope_exit unmap([addr, size] { ::munmap(addr, size); });
+    ::madvise(addr, size, MADV_SEQUENTIAL);
+    const auto* data = static_cast<const uint8_t*>(addr);
+
+    file_hdr hdr;
+    ::memcpy(&hdr, data, sizeof(hdr));
+    if ((hdr.magic != file_magic) || (hdr.version != file_version) ||
+        (hdr.rec_size != sizeof(pkt_rec)) || (hdr.cap_size != stamp.size) ||
+        (hdr.cap_mtime != stamp.mtime) || (hdr.key_len != key.size()) ||
+        (hdr.cnt_pkts == 0) ||
+        (hdr.cnt_pkts > ((size - sizeof(hdr)) / sizeof(pkt_rec))) ||
+        (file_layout(hdr).size != size) ||
+        (::memcmp(data + sizeof(hdr), key.data(), key.size()) != 0)) {
+        return std::nullopt;
+    }
+    const file_layout lay(hdr);
+
+    // The header segments and the first segments of the payloads of all
+    // packets of a batch are taken at once. The payloads which don't fit in
+    // a single mbuf are rare and their next segments are taken one by one.
+    std::vector<pkt_templates::pkt> pkts;
+    pkts.reserve(hdr.cnt_pkts);
+    auto fail = [&](std::string_view what) {
+        put::throw_runtime_error("Failed to allocate {} for the templates of "
+                                 "{} from cache file {}",
+                                 what, cfg.cap_fpath, fpath);
+    };
+    std::array<rte_mbuf*, max_bulk_size> hdrs;
+    std::array<rte_mbuf*, max_bulk_size> payloads;
+    for (size_t beg = 0; beg < hdr.cnt_pkts; beg += max_bulk_size) {
+        const size_t cnt = std::min(hdr.cnt_pkts - beg, max_bulk_size);
+        std::array<pkt_rec, max_bulk_size> recs;
+        size_t cnt_payloads = 0;
+        for (size_t i = 0; i < cnt; ++i) {
+            ::memcpy(&recs[i],
+                     data + lay.recs_off + ((beg + i) * sizeof(pkt_rec)),
+                     sizeof(pkt_rec));
+            const auto& rec = recs[i];
+            if ((rec.hdr_len > rec.len) ||
+                (rec.hdr_len > mbuf_pool::hdr_mbuf_data_size) ||
+                (rec.data_off > hdr.data_size) ||
+                (rec.len > (hdr.data_size - rec.data_off))) {
+                return std::nullopt;
+            }
+            cnt_payloads += (rec.len > rec.hdr_len);
+        }
+        if (rte_pktmbuf_alloc_bulk(pool.hdr_pool(), hdrs.data(), cnt) != 0) {
+            fail("header mbufs");
+        }
+        if ((cnt_payloads > 0) &&
+            (rte_pktmbuf_alloc_bulk(pool.pool(), payloads.data(),
+                                    cnt_payloads) != 0)) {
+            rte_pktmbuf_free_bulk(hdrs.data(), cnt);
+            fail("payload mbufs");
+        }
+        for (size_t i = 0, p = 0; i < cnt; ++i) {
+            const auto& rec     = recs[i];
+            const uint8_t* src  = data + lay.data_off + rec.data_off;
+            const auto rel_nsec = stdcr::nanoseconds(rec.rel_nsec);
+            pkts.push_back(pkt_templates::pkt{
+                .rel_tsc  = put::cycles::from_duration(rel_nsec),
+                .hdr      = pkt_templates::mbuf_ptr_type(hdrs[i]),
+                .payload  = {},
+                .len      = rec.len,
+                .from_cln = !!rec.from_cln,
+                .l4_ports = rec.l4_ports,
+                .tx_meta  = rec.tx_meta,
+            });
+            auto& pkt = pkts.back();
+            ::memcpy(rte_pktmbuf_append(hdrs[i], rec.hdr_len), src,
+                     rec.hdr_len);
+            if (rec.len == rec.hdr_len) continue;
+            pkt.payload.reset(payloads[p++]);
+            if (!copy_to_mbuf(pkt.payload.get(), src + rec.hdr_len,
+                              rec.len - rec.hdr_len, pool.pool())) {
+                // The mbufs of the rest of the batch aren't owned yet
+                for (size_t j = i + 1; j < cnt; ++j) rte_pktmbuf_free(hdrs[j]);
+                if (p < cnt_payloads) {
+                    rte_pktmbuf_free_bulk(&payloads[p], cnt_payloads - p);
+                }
+                fail("payload mbufs");
+            }
+        }
+    }
+    return pkt_templates(std::move(pkts));
+}
+
+void templates_cache::store(const pkt_templates::config& cfg,
+                            const file_stamp& stamp,
+                            const pkt_templates& tmpls) const
+{
+    const auto key   = key_of(cfg);
+    const auto fpath = file_path(dir_, key);
+    // Every thread writes to its own temporary file which replaces the old
+    // file at once when it's complete. Thus the readers never see a partial
+    // file.
+    auto tmp_fpath = fpath;
+    tmp_fpath += fmt::format(".{}.tmp", ::gettid());
+    const int fd = ::open(tmp_fpath.c_str(),
+                          O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        put::throw_system_error(errno, "Failed to create cache file: {}",
+                                tmp_fpath);
+    }
+    bool done = false;
+    stdex::scope_exit cleanup([&] {
+        ::close(fd);
+        if (!done) ::unlink(tmp_fpath.c_str());
+    });
+
+    const auto pkts = tmpls.pkts();
+    std::vector<pkt_rec> recs(pkts.size());
+    uint64_t data_size = 0;
+    for (size_t i = 0; i < pkts.size(); ++i) {
+        fill_pkt_rec(recs[i], pkts[i], data_size);
+        data_size += pkts[i].len;
+    }
+    const file_hdr hdr{
+        .magic     = file_magic,
+        .version   = file_version,
+        .rec_size  = sizeof(pkt_rec),
+        .cap_size  = stamp.size,
+        .cap_mtime = stamp.mtime,
+        .key_len   = key.size(),
+        .cnt_pkts  = pkts.size(),
+        .data_size = data_size,
+    };
+    const file_layout lay(hdr);
+    const std::array<uint8_t, 8> pad = {};
+
+    fd_writer wr(fd);
+    wr.write(&hdr, sizeof(hdr));
+    wr.write(key.data(), key.size());
+    wr.write(pad.data(), lay.recs_off - (sizeof(hdr) + key.size()));
+    wr.write(recs.data(), recs.size() * sizeof(pkt_rec));
+    for (const auto& pkt : pkts) {
+        wr.write(rte_pktmbuf_mtod(pkt.hdr.get(), const uint8_t*),
+                 rte_pktmbuf_data_len(pkt.hdr.get()));
+        for (const rte_mbuf* seg = pkt.payload.get(); seg; seg = seg->next) {
+            wr.write(rte_pktmbuf_mtod(seg, const uint8_t*),
+                     rte_pktmbuf_data_len(seg));
+        }
+    }
+    wr.flush();
+
+    if (::rename(tmp_fpath.c_str(), fpath.c_str()) != 0) {
+        put::throw_system_error(errno, "Failed to rename cache file: {}",
+                                tmp_fpath);
+    }
+    done = true;
+}
+
+} // namespace gen::priv
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "gen/priv/pkt_templates.h"
+
+namespace gen::priv
+{
+class mbuf_pool;
+
+// Keeps the prepared template packets of the captures in files so that the
+// next loads of the same captures skip the parsing, the validation and the
+// rewrite of the packets. There is a file per capture path and template
+// parameters. It's valid only for the size and the modification time of the
+// capture which it was made from and a stale file is overwritten on the next
+// load of the capture.
+// The file is mapped in the memory and the packets are copied straight from it
+// to mbufs taken in bulk. Its layout is:
+// - the file header
+// - the key i.e. the capture path and the template parameters
+// - the packet records, 8 bytes aligned
+// - the packet data i.e. the header segment and the payload of every packet
+// The files are valid only for the build and the machine which made them.
+// All functions can be called from several threads at once.
+class templates_cache
+{
+    stdfs::path dir_;
+
+public:
+    // The identity of the content of a capture file
+    struct file_stamp
+    {
+        uint64_t size;
+        int64_t mtime; // in nanoseconds
+    };
+
+public:
+    // Creates the directory if it doesn't exist
+    explicit templates_cache(const stdfs::path& dir);
+    ~templates_cache() noexcept;
+
+    templates_cache(templates_cache&&) noexcept;
+    templates_cache& operator=(templates_cache&&) noexcept;
+
+    templates_cache()                                  = delete;
+    templates_cache(const templates_cache&)            = delete;
+    templates_cache& operator=(const templates_cache&) = delete;
+
+    // Returns nothing if the file doesn't exist or can't be accessed.
+    static std::optional<file_stamp> stamp_of(const stdfs::path&) noexcept;
+    // The identity of the templates of a capture i.e. the absolute path of
+    // the capture and all parameters which affect the prepared packets.
+    static std::string key_of(const pkt_templates::config&);
+
+    // Returns nothing if there is no valid file for the capture with the given
+    // stamp. Throws if the mbufs for the packets can't be allocated.
+    std::optional<pkt_templates>
+    load(const pkt_templates::config&, const file_stamp&, mbuf_pool&) const;
+    // Stores the templates made from the capture with the given stamp.
+    // Throws on failure and then the file is left as it was.
+    void store(const pkt_templates::config&,
+               const file_stamp&,
+               const pkt_templates&) const;
+};
+
+} // namespace gen::priv
@@ -0,0 +1,75 @@
+#include "gen/priv/templates_library.h"
+
+namespace gen::priv
+{
+
+templates_library::templates_library(uint64_t max_cnt_mbufs)
+: max_cnt_mbufs_(max_cnt_mbufs)
+{
+}
+
+templates_library::~templates_library() noexcept = default;
+
+templates_library::templates_ptr
+templates_library::find(const std::string& key,
+                        const templates_cache::file_stamp& stamp)
+{
+    std::lock_guard lock(mtx_);
+    const auto it = index_.find(key);
+    if (it == index_.end()) {
+        ++stats_.cnt_misses;
+        return {};
+    }
+    const auto ent = it->second;
+    if ((ent->stamp.size != stamp.size) || (ent->stamp.mtime != stamp.mtime)) {
+        erase(ent);
+        ++stats_.cnt_misses;
+        return {};
+    }
+    lru_.splice(lru_.begin(), lru_, ent);
+    ++stats_.cnt_hits;
+    return ent->tmpls;
+}
+
+void templates_library::insert(std::string&& key,
+                               const templates_cache::file_stamp& stamp,
+                               templates_ptr tmpls)
+{
+    const uint64_t cnt_mbufs = tmpls->cnt_mbufs();
+    std::lock_guard lock(mtx_);
+    if (const auto it = index_.find(key); it != index_.end()) {
+        erase(it->second);
+    }
+    if (cnt_mbufs > max_cnt_mbufs_) return;
+    while ((stats_.cnt_mbufs + cnt_mbufs) > max_cnt_mbufs_) {
+        erase(std::prev(lru_.end()));
+        ++stats_.cnt_evictions;
+    }
+    lru_.push_front(entry{
+        .key   = std::move(key),
+        .stamp = stamp,
+        .tmpls = std::move(tmpls),
+    });
+    const auto ent = lru_.begin();
+    index_.emplace(ent->key, ent);
+    stats_.cnt_entries += 1;
+    stats_.cnt_mbufs   += cnt_mbufs;
+    stats_.cnt_bytes   += ent->tmpls->pkts_bytes().back();
+}
+
+templates_library::stats templates_library::get_stats() const noexcept
+{
+    std::lock_guard lock(mtx_);
+    return stats_;
+}
+
+void templates_library::erase(entries_type::iterator ent) noexcept
+{
+    stats_.cnt_entries -= 1;
+    stats_.cnt_mbufs   -= ent->tmpls->cnt_mbufs();
+    stats_.cnt_bytes   -= ent->tmpls->pkts_bytes().back();
+    index_.erase(ent->key);
+    lru_.erase(ent);
+}
+
+} // namespace gen::priv
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "gen/priv/templates_cache.h"
+
+namespace gen::priv
+{
+
+// Keeps the templates of the recently used captures in the memory after the
+// end of the generation so that the next starts with the same captures don't
+// load them at all. The templates are shared with the generators and they are
+// released when neither the library nor any generator uses them.
+// The library holds at most the given count of mbufs and the least recently
+// used templates are dropped when a new one doesn't fit. Templates which don't
+// fit alone are not kept at all.
+// All functions can be called from several threads at once.
+class templates_library
+{
+public:
+    using templates_ptr = std::shared_ptr<const pkt_templates>;
+
+    struct stats
+    {
+        uint64_t cnt_hits;
+        uint64_t cnt_misses;
+        uint64_t cnt_evictions;
+        uint64_t cnt_entries;
+        uint64_t cnt_mbufs;
+        uint64_t cnt_bytes; // of the packets data
+    };
+
+private:
+    struct entry
+    {
+        std::string key;
+        templates_cache::file_stamp stamp;
+        templates_ptr tmpls;
+    };
+    using entries_type = std::list<entry>;
+
+    const uint64_t max_cnt_mbufs_;
+
+    mutable std::mutex mtx_;
+    // These members are guarded by the mutex.
+    // The most recently used entry is at the front of the list.
+    entries_type lru_;
+    std::unordered_map<std::string_view, entries_type::iterator> index_;
+    stats stats_ = {};
+
+public:
+    // Zero count of mbufs disables the library
+    explicit templates_library(uint64_t max_cnt_mbufs);
+    ~templates_library() noexcept;
+
+    templates_library()                                    = delete;
+    templates_library(templates_library&&)                 = delete;
+    templates_library(const templates_library&)            = delete;
+    templates_library& operator=(templates_library&&)      = delete;
+    templates_library& operator=(const templates_library&) = delete;
+
+    // Returns null if there are no templates for the given key made from the
+    // capture with the given stamp. Stale templates are dropped.
+    templates_ptr find(const std::string& key,
+                       const templates_cache::file_stamp&);
+    // Replaces the templates with the same key, if any.
+    void insert(std::string&& key,
+                const templates_cache::file_stamp&,
+                templates_ptr);
+
+    stats get_stats() const noexcept;
+
+private:
+    void erase(entries_type::iterator) noexcept;
+};
+
+} // namespace gen::priv
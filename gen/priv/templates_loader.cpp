@@ -0,0 +1,177 @@
+#include "gen/priv/templates_loader.h"
+#include "gen/priv/mbuf_pool.h"
+#include "gen/priv/pkt_stream.h"
+#include "gen/priv/templates_cache.h"
+#include "gen/priv/templates_library.h"
+
+#include "put/tg_assert.h"
+#include "put/throw.h"
+
+namespace gen::priv
+{
+
+templates_loader::batch::batch(uint32_t epoch,
+                               std::vector<pkt_templates::config>&& cfgs)
+: epoch_(epoch)
+, cfgs_(std::move(cfgs))
+, tmpls_(cfgs_.size())
+, streams_(cfgs_.size())
+, errors_(cfgs_.size())
+, sources_(cfgs_.size(), source::capture)
+, cache_errors_(cfgs_.size())
+, cnt_left_(cfgs_.size())
+{
+}
+
+templates_loader::batch::~batch() noexcept = default;
+
+std::optional<std::string_view>
+templates_loader::batch::error() const noexcept
+{
+    TG_ASSERT(is_done());
+    for (const auto& err : errors_) {
+        if (!err.empty()) return err;
+    }
+    return std::nullopt;
+}
+
+size_t templates_loader::batch::cnt_from(source src) const noexcept
+{
+    TG_ASSERT(is_done());
+    return std::ranges::count(sources_, src);
+}
+
+std::optional<std::string_view>
+templates_loader::batch::cache_error() const noexcept
+{
+    TG_ASSERT(is_done());
+    for (const auto& err : cache_errors_) {
+        if (!err.empty()) return err;
+    }
+    return std::nullopt;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+templates_loader::templates_loader(const config& cfg)
+: mbuf_pool_(cfg.mbuf_pool), cache_(cfg.cache), library_(cfg.library)
+{
+    // The count of the threads is validated with the application config
+    TG_ENFORCE(cfg.cnt_threads > 0);
+    threads_.reserve(cfg.cnt_threads);
+    for (uint32_t i = 0; i < cfg.cnt_threads; ++i) {
+        std::array<char, RTE_MAX_THREAD_NAME_LEN> name;
+        const auto res = fmt::format_to_n(name.data(), name.size() - 1,
+                                          "tgn-loader-{}", i);
+        *res.out       = '\0';
+        pthread_t tid;
+        if (const int err = rte_ctrl_thread_create(&tid, name.data(), nullptr,
+                                                   thread_main, this);
+            err != 0) {
+            stop_threads();
+            put::throw_system_error(-err, "Failed to create loader thread {}",
+                                    i);
+        }
+        threads_.push_back(tid);
+    }
+}
+
+templates_loader::~templates_loader() noexcept
+{
+    stop_threads();
+}
+
+templates_loader::batch_ptr
+templates_loader::load(uint32_t epoch,
+                       std::vector<pkt_templates::config>&& cfgs)
+{
+    std::lock_guard lock(mtx_);
+    if (auto bat = last_.lock(); bat && (bat->epoch_ == epoch)) return bat;
+    auto bat = std::make_shared<batch>(epoch, std::move(cfgs));
+    for (size_t idx = 0; idx < bat->cfgs_.size(); ++idx) {
+        jobs_.push_back(job{.bat = bat, .idx = idx});
+    }
+    last_ = bat;
+    cv_.notify_all();
+    return bat;
+}
+
+void templates_loader::stop_threads() noexcept
+{
+    {
+        std::lock_guard lock(mtx_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (const pthread_t tid : threads_) ::pthread_join(tid, nullptr);
+    threads_.clear();
+}
+
+void templates_loader::run() noexcept
+{
+    for (;;) {
+        std::shared_ptr<batch> bat;
+        size_t idx = 0;
+        {
+            std::unique_lock lock(mtx_);
+            cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (stop_) return;
+            bat = jobs_.front().bat.lock();
+            idx = jobs_.front().idx;
+            jobs_.pop_front();
+        }
+        if (!bat) continue;
+        try {
+            load_templates(*bat, idx);
+        } catch (const std::exception& ex) {
+            bat->errors_[idx] = ex.what();
+        }
+        bat->cnt_left_.fetch_sub(1, std::memory_order_acq_rel);
+    }
+}
+
+void templates_loader::load_templates(batch& bat, size_t idx) const
+{
+    const auto& cfg = bat.cfgs_[idx];
+    auto& tmpls     = bat.tmpls_[idx];
+    // The streams are never shared between the starts
+    if (cfg.stream) {
+        bat.streams_[idx] = std::make_shared<pkt_stream>(cfg, *mbuf_pool_);
+        return;
+    }
+    // The templates are built from the capture if it can't be stat-ed here.
+    // The capture loading reports the actual problem then.
+    const auto stamp = templates_cache::stamp_of(cfg.cap_fpath);
+    if (!stamp) {
+        tmpls = std::make_shared<const pkt_templates>(cfg, *mbuf_pool_);
+        return;
+    }
+    auto key = templates_cache::key_of(cfg);
+    if ((tmpls = library_->find(key, *stamp))) {
+        bat.sources_[idx] = source::library;
+        return;
+    }
+    if (auto loaded = cache_ ? cache_->load(cfg, *stamp, *mbuf_pool_)
+                             : std::nullopt) {
+        tmpls = std::make_shared<const pkt_templates>(std::move(*loaded));
+        bat.sources_[idx] = source::cache;
+    } else {
+        tmpls = std::make_shared<const pkt_templates>(cfg, *mbuf_pool_);
+        if (cache_) {
+            try {
+                cache_->store(cfg, *stamp, *tmpls);
+            } catch (const std::exception& ex) {
+                bat.cache_errors_[idx] = ex.what();
+            }
+        }
+    }
+    library_->insert(std::move(key), *stamp, tmpls);
+}
+
+void* templates_loader::thread_main(void* arg) noexcept
+{
+    static_cast<templates_loader*>(arg)->run();
+    return nullptr;
+}
+
+} // namespace gen::priv
@@ -0,0 +1,138 @@
+#pragma once
+
+#include "gen/priv/pkt_templates.h"
+
+namespace gen::priv
+{
+class mbuf_pool;
+class pkt_stream;
+class templates_cache;
+class templates_library;
+
+// Loads the template packets of the captures on a pool of threads. The threads
+// are DPDK control threads and thus they run on the CPU cores which are not
+// used by the EAL. The generation workers never block on the loading. They
+// only poll for its completion.
+// All workers get the same start requests and the templates for a start are
+// loaded only once and then shared by all workers.
+// The templates are taken from the library or from the cache, if there is
+// one, and the templates loaded from the captures are stored in both.
+// The streamed captures get their stream instead and they bypass both.
+class templates_loader
+{
+public:
+    using templates_ptr = std::shared_ptr<const pkt_templates>;
+
+    enum class source : uint8_t
+    {
+        capture,
+        cache,
+        library,
+    };
+
+    // The templates of all captures of a single start of the generation.
+    // The result of every capture is set by one of the threads. Their
+    // completion is published with the count of the remaining captures and
+    // the results must not be accessed before it drops to zero.
+    class batch
+    {
+        friend class templates_loader;
+
+        const uint32_t epoch_;
+        const std::vector<pkt_templates::config> cfgs_;
+        std::vector<templates_ptr> tmpls_;
+        std::vector<std::shared_ptr<pkt_stream>> streams_;
+        std::vector<std::string> errors_; // empty if loaded successfully
+        std::vector<source> sources_;
+        std::vector<std::string> cache_errors_; // empty if stored successfully
+        std::atomic<size_t> cnt_left_;
+
+    public:
+        batch(uint32_t epoch, std::vector<pkt_templates::config>&&);
+        ~batch() noexcept;
+
+        batch()                        = delete;
+        batch(batch&&)                 = delete;
+        batch(const batch&)            = delete;
+        batch& operator=(batch&&)      = delete;
+        batch& operator=(const batch&) = delete;
+
+        bool is_done() const noexcept
+        {
+            return cnt_left_.load(std::memory_order_acquire) == 0;
+        }
+        // The first error of the loading, if any. Valid only when done.
+        std::optional<std::string_view> error() const noexcept;
+        // The count of the captures whose templates were taken from the given
+        // source and the first error of the storing in the cache, if any.
+        // Valid only when done. The cache errors don't fail the loading.
+        size_t cnt_from(source) const noexcept;
+        std::optional<std::string_view> cache_error() const noexcept;
+        // The templates of the capture `idx`. Valid only when done and
+        // without errors.
+        const templates_ptr& templates(size_t idx) const noexcept
+        {
+            return tmpls_[idx];
+        }
+        // The stream of the capture `idx`, if streamed. Valid only when done
+        // and without errors.
+        const std::shared_ptr<pkt_stream>& stream(size_t idx) const noexcept
+        {
+            return streams_[idx];
+        }
+    };
+    using batch_ptr = std::shared_ptr<const batch>;
+
+private:
+    // The jobs don't keep their batch alive. The jobs of a batch which has
+    // been abandoned by all workers are skipped.
+    struct job
+    {
+        std::weak_ptr<batch> bat;
+        size_t idx;
+    };
+
+    mbuf_pool* mbuf_pool_;
+    const templates_cache* cache_;
+    templates_library* library_;
+    std::vector<pthread_t> threads_;
+
+    std::mutex mtx_;
+    std::condition_variable cv_;
+    // These members are guarded by the mutex
+    std::deque<job> jobs_;
+    std::weak_ptr<batch> last_;
+    bool stop_ = false;
+
+public:
+    struct config
+    {
+        uint32_t cnt_threads;
+        gen::priv::mbuf_pool* mbuf_pool;
+        const templates_cache* cache; // null if there is no cache
+        templates_library* library;
+    };
+
+public:
+    explicit templates_loader(const config&);
+    ~templates_loader() noexcept;
+
+    templates_loader()                                   = delete;
+    templates_loader(templates_loader&&)                 = delete;
+    templates_loader(const templates_loader&)            = delete;
+    templates_loader& operator=(templates_loader&&)      = delete;
+    templates_loader& operator=(const templates_loader&) = delete;
+
+    // Returns the batch for the given epoch. The first call for an epoch
+    // starts the loading and the other calls get the same batch, regardless
+    // of the passed configurations. Doesn't wait for the loading.
+    batch_ptr load(uint32_t epoch, std::vector<pkt_templates::config>&&);
+
+private:
+    void load_templates(batch&, size_t idx) const;
+    void stop_threads() noexcept;
+    void run() noexcept;
+    static void* thread_main(void*) noexcept;
+};
+
+} // namespace gen::priv
@@ -0,0 +1,76 @@
+#include "gen/priv/tx_stage.h"
+#include "gen/priv/eth_dev.h"
+
+namespace gen::priv
+{
+
+tx_stage::tx_stage(const config& cfg) noexcept
+: eth_dev_(cfg.dev), queue_id_(cfg.queue_id)
+{
+}
+
+tx_stage::~tx_stage() noexcept
+{
+    // The stage is destroyed after all cores have stopped and the packets
+    // which are still in the ring or pending are just freed.
+    rte_pktmbuf_free_bulk(pending_.data(), cnt_pending_);
+    while (const auto cnt = ring_.try_pop(pending_.data(), pending_.size())) {
+        rte_pktmbuf_free_bulk(pending_.data(), cnt);
+    }
+}
+
+tx_stage::stats tx_stage::take_stats() noexcept
+{
+    constexpr auto order = std::memory_order_relaxed;
+    return {
+        .cnt_samples     = cnt_samples_.load(order),
+        .total_occupancy = total_occupancy_.load(order),
+        .max_occupancy   = max_occupancy_.exchange(0, order),
+        .cnt_tx_busy     = cnt_tx_busy_.load(order),
+    };
+}
+
+void tx_stage::process_events() noexcept
+{
+    // There is only one writer of the counters and they don't need atomic
+    // read-modify-write operations.
+    auto add = [](std::atomic<uint64_t>& cnt, uint64_t val) {
+        cnt.store(cnt.load(std::memory_order_relaxed) + val,
+                  std::memory_order_relaxed);
+    };
+    const uint64_t occupancy = ring_.count_pop_slots();
+    add(cnt_samples_, 1);
+    add(total_occupancy_, occupancy);
+    if (occupancy > max_occupancy_.load(std::memory_order_relaxed)) {
+        max_occupancy_.store(occupancy, std::memory_order_relaxed);
+    }
+
+    // The packets which the NIC didn't take the previous time are sent first
+    // so that the order of the packets is kept.
+    cnt_pending_ += ring_.try_pop(pending_.data() + cnt_pending_,
+                                  pending_.size() - cnt_pending_);
+    if (cnt_pending_ > 0) {
+        const auto cnt =
+            eth_dev_->transmit_pkts(queue_id_, {pending_.data(), cnt_pending_});
+        if (cnt < cnt_pending_) {
+            add(cnt_tx_busy_, 1);
+            std::copy(pending_.begin() + cnt,
+                      pending_.begin() + cnt_pending_, pending_.begin());
+        }
+        cnt_pending_ -= cnt;
+    }
+
+    // The stage owns the NIC queue pair and it needs to keep the RX queue
+    // empty as well.
+    receive_rx_pkts();
+}
+
+void tx_stage::receive_rx_pkts() noexcept
+{
+    rte_mbuf* pkts[cnt_burst_pkts];
+    if (const auto cnt = eth_dev_->receive_pkts(queue_id_, pkts); cnt > 0) {
+        rte_pktmbuf_free_bulk(pkts, cnt);
+    }
+}
+
+} // namespace gen::priv
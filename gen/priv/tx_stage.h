@@ -0,0 +1,85 @@
+#pragma once
+
+#include "put/spsc_ring.h"
+
+namespace gen::priv
+{
+class eth_dev;
+
+// The transmission stage of the pipeline mode.
+// The generation worker puts the ready packets in a ring and this stage,
+// running on its own CPU core, sends them through the NIC queue pair of the
+// worker. Thus the NIC backpressure and the stalls on the TX descriptors don't
+// delay the scheduling of the packets. The packets which the NIC doesn't take
+// are kept and retried in order and meanwhile the ring fills up. The worker
+// drops packets only when the ring is full.
+class tx_stage
+{
+public:
+    static constexpr size_t ring_size      = 8 * 1024;
+    static constexpr size_t cnt_burst_pkts = 64;
+
+    // The ring occupancy is sampled on every run of the stage. High
+    // occupancy means that the transmission is the bottleneck and low
+    // occupancy means that the scheduling is.
+    struct stats
+    {
+        uint64_t cnt_samples;
+        uint64_t total_occupancy;
+        uint64_t max_occupancy;
+        uint64_t cnt_tx_busy; // the runs in which the NIC didn't take all
+    };
+
+private:
+    using ring_type = put::spsc_ring<rte_mbuf*, ring_size>;
+
+    ring_type ring_;
+
+    // These members are used only from the CPU core of the stage.
+    eth_dev* eth_dev_;
+    uint16_t queue_id_;
+    std::array<rte_mbuf*, cnt_burst_pkts> pending_;
+    size_t cnt_pending_ = 0;
+
+    // Written only from the CPU core of the stage and read from the core of
+    // the worker. The max occupancy is reset by the reader.
+    alignas(64) std::atomic<uint64_t> cnt_samples_{0};
+    std::atomic<uint64_t> total_occupancy_{0};
+    std::atomic<uint64_t> max_occupancy_{0};
+    std::atomic<uint64_t> cnt_tx_busy_{0};
+
+public:
+    struct config
+    {
+        eth_dev* dev;
+        uint16_t queue_id;
+    };
+
+public:
+    explicit tx_stage(const config&) noexcept;
+    ~tx_stage() noexcept;
+
+    tx_stage()                           = delete;
+    tx_stage(tx_stage&&)                 = delete;
+    tx_stage(const tx_stage&)            = delete;
+    tx_stage& operator=(tx_stage&&)      = delete;
+    tx_stage& operator=(const tx_stage&) = delete;
+
+    // Must be called only from the CPU core of the worker.
+    // Returns the count of the packets which fitted in the ring.
+    size_t enqueue_pkts(std::span<rte_mbuf* const> pkts) noexcept
+    {
+        return ring_.try_push(pkts.data(), pkts.size(), ring_type::do_copy);
+    }
+    // The counters are cumulative and the worker needs to keep the values
+    // from the start of the generation. Only the max occupancy is reset here.
+    stats take_stats() noexcept;
+
+    // Must be called only from the CPU core of the stage.
+    void process_events() noexcept;
+
+private:
+    void receive_rx_pkts() noexcept;
+};
+
+} // namespace gen::priv
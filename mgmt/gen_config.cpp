@@ -2,12 +2,23 @@
 
 #include "put/ether_addr.h"
 #include "put/num_utils.h"
+#include "put/string_utils.h"
 #include "put/throw.h"
 
 /*
  * The expected format of the given string data is the following.
  * `duration_secs` - is the duration of the whole generation test, in seconds
  * `dut_ether_addr` - is the Ethernet address of the Device Under Test (DUT)
+ * `rebalance_lag_usec` - optional, if present the flows are moved at runtime
+ * from the generation workers which send their packets later than this, on
+ * average, to the other workers. Works only for the captures without `ipg`
+ * and `precompiled` settings.
+ * `prerender_budget_mb` - optional, if present every packet of a capture is
+ * rendered upfront for every pair of client and server addresses and the
+ * packets are sent without copying and changing their headers. The budget is
+ * the memory, in MB, which every generation worker may use for this. The
+ * captures whose packets don't fit in the rest of the budget, e.g. due to big
+ * address ranges, work as usual.
  * `captures` - is an array of different captures which will be used for
  * generating streams of packets.
  * `name` - a path to the capture file. The path is relative to the working
@@ -17,22 +28,94 @@
  * `fps` - started/generated flows per second. Should be 1 or more
  * `ipg` - inter packet gaps in micro-seconds. If not present the time-
  * stamps from the capture file will be used
- * `cln_ips` - range of IPv4 addresses to be used for the "client" packets
- * `srv_ips` - range of IPv4 addresses to be used for the "server" packets
- * `cln_port` = client port to be set to the TCP/UDP packets, If not present the
- * port won't be replaced.
+ * `cln_ips` - network of IPv4 or IPv6 addresses, e.g. "16.0.0.0/8" or
+ * "2001:db8::/64", or an array of disjoint networks to be used for the
+ * "client" packets. All networks of a capture must be of the IP version of
+ * its packets. Only the first 2^32 addresses of an IPv6 network are used.
+ * `srv_ips` - the same as `cln_ips` but for the "server" packets
+ * `cln_ips_stride` - optional, 1 by default. The client addresses are taken
+ * with this step over all client networks, wrapping around at their end. It
+ * must be coprime with the count of the client addresses.
+ * `srv_ips_stride` - optional, the same as `cln_ips_stride` but for the
+ * server addresses.
+ * `ips_order` - optional, how the addresses are taken from the networks:
+ *   - "sequential" - the default, one after another with the given strides.
+ *   - "random" - in a pseudo random permutation of the addresses of every
+ *     side. The strides are not used then.
+ * `ips_seed` - optional, 0 by default, the seed of the "random" order. The
+ * same seed gives the same order of the addresses on every run.
+ * `cln_ports` - optional, client port or range of ports, e.g. "1024-65535",
+ * to be set to the TCP/UDP packets. If not present the client ports won't be
+ * replaced. The old `cln_port` name is accepted as well.
+ * `srv_ports` - optional, the same as `cln_ports` but for the server ports.
+ * `ports_policy` - optional, how the ports are chosen from the ranges:
+ *   - "sequential" - the default, all pairs of addresses are used with the
+ *     first client and server ports, then with the next ones and so on.
+ *   - "random" - the same as "sequential" but the pairs of client and server
+ *     ports are taken in a random permutation.
+ *   - "paired" - the ports change together with the addresses.
+ * Thus the flows get `addresses pairs * client ports * server ports` unique
+ * tuples, or the least common multiple of these counts for "paired".
+ * `vlans` - optional, VLAN ID or range of VLAN IDs, e.g. "100-4000", between
+ * 1 and 4094. Every packet gets a VLAN tag with ID taken from the range
+ * together with the addresses, i.e. like "paired" ports.
+ * `inner_vlans` - optional, the same as `vlans` but for the inner, 802.1Q,
+ * tag of QinQ. The `vlans` are the outer, 802.1ad, tags then.
+ * `mpls_labels` - optional, MPLS label or range of labels between 16 and
+ * 1048575. The label is put after the VLAN tags, if any.
+ * The tags are inserted by the NIC, if it supports it, or in software. The
+ * MPLS labels are always inserted in software.
+ * `tunnel` - optional, the packets are encapsulated in a tunnel with:
+ *   - `type` - one of "vxlan", "gre" or "gtpu". The VXLAN packets keep their
+ *     Ethernet header as inner one. The GRE and GTP-U packets carry only the
+ *     IP packet.
+ *   - `cln_ips` - IPv4 network, or an array of networks, of the outer client
+ *     addresses. They are taken together with the inner addresses.
+ *   - `srv_ips` - the same as `cln_ips` but for the outer server addresses.
+ *   - `ids` - optional, tunnel id or range of ids, i.e. VNIs up to 16777215,
+ *     GRE keys or TEIDs. They are taken together with the addresses. The id
+ *     is 0 if not present.
+ * The outer headers are put after the VLAN and MPLS tags, if any.
+ * `precompiled` - optional, if true the whole send pattern of the capture is
+ * precompiled upfront to a table and no timers are used during the generation.
+ * `isn_offsets` - optional, if true every run of every flow gets its own
+ * offsets of the TCP sequence numbers of both sides. Thus the stateful DUTs
+ * don't see the restarted flows as repeated connections. The packets of such
+ * captures are never pre-rendered.
+ * `stream` - optional, if true only a window of the packets of the capture is
+ * kept in the memory at a time and it's refilled from the capture during the
+ * generation. Thus the capture may have more packets than the mbuf pool. Such
+ * capture must have a single flow, i.e. `fps` and `burst` must be 1, and it
+ * can't be `precompiled`.
 {
     "duration_secs": 10,
     "dut_ether_addr": "e4:8d:8c:20:fb:bc",
+    "rebalance_lag_usec": 20,
+    "prerender_budget_mb": 64,
     "captures": [
         {
             "name": "test.pcap",
             "burst": 1,
             "fps": 1,
             "ipg": 10000,
-            "cln_ips": "16.0.0.1/29",
+            "cln_ips": ["16.0.0.0/16", "17.0.0.0/24"],
             "srv_ips": "48.0.0.1/29",
-            "cln_port": 1024
+            "ips_order": "random",
+            "ips_seed": 12345,
+            "cln_ports": "1024-65535",
+            "srv_ports": 80,
+            "ports_policy": "random",
+            "vlans": "100-4000",
+            "inner_vlans": 10,
+            "mpls_labels": "1000-1999",
+            "tunnel": {
+                "type": "vxlan",
+                "cln_ips": "10.0.0.0/24",
+                "srv_ips": "10.1.0.1",
+                "ids": "5000-5999"
+            },
+            "precompiled": true,
+            "isn_offsets": true
         },
         {
             "name": "test2.pcap",
@@ -41,7 +124,16 @@
             "ipg": 10000,
             "cln_ips": "16.0.0.1/29",
             "srv_ips": "48.0.0.1/29",
-            "cln_port": 1024
+            "cln_ips_stride": 3,
+            "cln_port": 1024,
+            "stream": true
+        },
+        {
+            "name": "test6.pcap",
+            "burst": 1,
+            "fps": 1,
+            "cln_ips": "2001:db8:1::/64",
+            "srv_ips": ["2001:db8:2::/120", "2001:db8:3::/120"]
         }
         ...
     ]
@@ -57,16 +149,174 @@ struct fmt::formatter<bjson::string> : fmt::ostream_formatter
 namespace mgmt
 {
 
+// The ranges of ports, tags, etc. are given either as a single number or as
+// "first-last" string. The `what` is the name of a single value.
+template <typename T>
+static std::optional<std::pair<T, T>> load_range(const bjson::object& cap_obj,
+                                                 std::string_view name,
+                                                 std::string_view what,
+                                                 uint64_t min_val,
+                                                 uint64_t max_val)
+{
+    const auto* val = cap_obj.if_contains(name);
+    if (!val) return std::nullopt;
+    std::optional<uint64_t> first;
+    std::optional<uint64_t> last;
+    if (const auto* p = val->if_uint64(); p) {
+        first = last = *p;
+    } else if (const auto* p = val->if_string(); p) {
+        auto to_port = [](std::string_view str) {
+            return put::str_to_int<uint64_t>(put::str_trim(str));
+        };
+        const std::string_view str = *p;
+        if (const auto pos = str.find('-'); pos != std::string_view::npos) {
+            first = to_port(str.substr(0, pos));
+            last  = to_port(str.substr(pos + 1));
+        }
+    }
+    if (!first || !last || (*first > *last) ||
+        !put::in_range_inclusive(*first, min_val, max_val) ||
+        !put::in_range_inclusive(*last, min_val, max_val)) {
+        put::throw_runtime_error("The `{}` value must be a {} or a range "
+                                 "of {}s between {} and {}",
+                                 name, what, what, min_val, max_val);
+    }
+    return std::pair<T, T>(*first, *last);
+}
+
+static std::optional<std::pair<uint16_t, uint16_t>>
+load_ports(const bjson::object& cap_obj,
+           std::string_view name,
+           uint16_t min_port)
+{
+    return load_range<uint16_t>(cap_obj, name, "port", min_port, 65535);
+}
+
+// The networks are given either as a single string or as array of strings.
+static ip_networks load_networks(const bjson::object& cap_obj,
+                                 std::string_view name)
+{
+    const auto& val = cap_obj.at(name);
+    std::vector<std::string_view> strs;
+    if (const auto* arr = val.if_array(); arr) {
+        for (const auto& elem : *arr) strs.push_back(elem.as_string());
+    } else {
+        strs.push_back(val.as_string());
+    }
+    if (strs.empty()) {
+        put::throw_runtime_error("The `{}` value must contain at least one "
+                                 "network",
+                                 name);
+    }
+    ip_networks nets;
+    for (const auto str : strs) {
+        bsys::error_code ec;
+        if (str.find(':') != std::string_view::npos) {
+            nets.v6.push_back(baio::ip::make_network_v6(str, ec));
+        } else {
+            nets.v4.push_back(baio::ip::make_network_v4(str, ec));
+        }
+        if (ec) {
+            put::throw_runtime_error("Invalid `{}` network: {}", name, str);
+        }
+    }
+    return nets;
+}
+
+static uint32_t load_ips_stride(const bjson::object& cap_obj,
+                                std::string_view name)
+{
+    const auto* val = cap_obj.if_contains(name);
+    if (!val) return 1;
+    const auto stride = val->as_uint64();
+    if (!put::in_range_inclusive(stride, 1ul, 0xFFFF'FFFFul)) {
+        put::throw_runtime_error("The `{}` value must be between 1 and "
+                                 "4'294'967'295",
+                                 name);
+    }
+    return static_cast<uint32_t>(stride);
+}
+
+static addr_order load_ips_order(const bjson::object& cap_obj)
+{
+    const auto* val = cap_obj.if_contains("ips_order");
+    if (!val) return addr_order::sequential;
+    const std::string_view str = val->as_string();
+    if (str == "sequential") return addr_order::sequential;
+    if (str == "random") return addr_order::random;
+    put::throw_runtime_error("The `ips_order` value must be one of "
+                             "\"sequential\" or \"random\"");
+}
+
+static std::optional<std::pair<uint16_t, uint16_t>>
+load_vlans(const bjson::object& cap_obj, std::string_view name)
+{
+    return load_range<uint16_t>(cap_obj, name, "VLAN ID", 1, 4094);
+}
+
+static std::optional<std::pair<uint32_t, uint32_t>>
+load_mpls_labels(const bjson::object& cap_obj)
+{
+    // The labels 0-15 are reserved.
+    return load_range<uint32_t>(cap_obj, "mpls_labels", "label", 16, 1048575);
+}
+
+static std::optional<tunnel_config> load_tunnel(const bjson::object& cap_obj)
+{
+    const auto* val = cap_obj.if_contains("tunnel");
+    if (!val) return std::nullopt;
+    const auto& tnl_obj        = val->as_object();
+    const std::string_view str = tnl_obj.at("type").as_string();
+    tunnel_type type;
+    uint32_t max_id = UINT32_MAX;
+    if (str == "vxlan") {
+        type   = tunnel_type::vxlan;
+        max_id = 0xFF'FFFF;
+    } else if (str == "gre") {
+        type = tunnel_type::gre;
+    } else if (str == "gtpu") {
+        type = tunnel_type::gtpu;
+    } else {
+        put::throw_runtime_error("The `tunnel.type` value must be one of "
+                                 "\"vxlan\", \"gre\" or \"gtpu\"");
+    }
+    auto cln_ips = load_networks(tnl_obj, "cln_ips");
+    auto srv_ips = load_networks(tnl_obj, "srv_ips");
+    if (!cln_ips.v6.empty() || !srv_ips.v6.empty()) {
+        put::throw_runtime_error("The `tunnel` networks must be IPv4 ones");
+    }
+    return tunnel_config{
+        .type    = type,
+        .cln_ips = std::move(cln_ips.v4),
+        .srv_ips = std::move(srv_ips.v4),
+        .ids     = load_range<uint32_t>(tnl_obj, "ids", "id", 0, max_id),
+    };
+}
+
+static port_policy load_ports_policy(const bjson::object& cap_obj)
+{
+    const auto* val = cap_obj.if_contains("ports_policy");
+    if (!val) return port_policy::sequential;
+    const std::string_view str = val->as_string();
+    if (str == "sequential") return port_policy::sequential;
+    if (str == "random") return port_policy::random;
+    if (str == "paired") return port_policy::paired;
+    put::throw_runtime_error("The `ports_policy` value must be one of "
+                             "\"sequential\", \"random\" or \"paired\"");
+}
+
 gen_config::gen_config(std::string_view cfg_info)
 {
     bjson::parser parser;
     parser.write(cfg_info);
 
-    const auto json_val   = parser.release();
-    const auto& json_obj  = json_val.as_object();
-    const auto dur_num    = json_obj.at("duration_secs").as_double();
-    const auto& ether_str = json_obj.at("dut_ether_addr").as_string();
-    const auto& captures  = json_obj.at("captures").as_array();
+    const auto json_val    = parser.release();
+    const auto& json_obj   = json_val.as_object();
+    const auto dur_num     = json_obj.at("duration_secs").as_double();
+    const auto& ether_str  = json_obj.at("dut_ether_addr").as_string();
+    const auto& captures   = json_obj.at("captures").as_array();
+    const auto* lag_val    = json_obj.if_contains("rebalance_lag_usec");
+    const auto* budget_val = json_obj.if_contains("prerender_budget_mb");
 
     const auto dut_addr = put::parse_ether_addr(ether_str);
     if (!dut_addr) {
@@ -79,6 +329,26 @@ gen_config::gen_config(std::string_view cfg_info)
         return std::nullopt;
     };
 
+    using lag_type = std::optional<stdcr::microseconds>;
+    lag_type rebalance_lag;
+    if (lag_val) {
+        const auto lag_num = lag_val->as_uint64();
+        if (!put::in_range_inclusive(lag_num, 1ul, 1'000'000ul)) {
+            put::throw_runtime_error("The `rebalance_lag_usec` value "
+                                     "must be between 1 and 1'000'000");
+        }
+        rebalance_lag = stdcr::microseconds(lag_num);
+    }
+    std::optional<size_t> prerender_budget;
+    if (budget_val) {
+        const auto budget_num = budget_val->as_uint64();
+        if (!put::in_range_inclusive(budget_num, 1ul, 65'536ul)) {
+            put::throw_runtime_error("The `prerender_budget_mb` value "
+                                     "must be between 1 and 65'536");
+        }
+        prerender_budget = budget_num * 1024 * 1024;
+    }
+
     std::vector<flows_config> flows_cfgs;
     for (const auto& cap : captures) {
         const auto& cap_obj     = cap.as_object();
@@ -86,10 +356,34 @@ gen_config::gen_config(std::string_view cfg_info)
         const auto burst_num    = cap_obj.at("burst").as_uint64();
         const auto fps_num      = cap_obj.at("fps").as_uint64();
         const auto ipg_num      = load_opt_u64(cap_obj, "ipg");
-        const auto& cln_ips_str = cap_obj.at("cln_ips").as_string();
-        const auto& srv_ips_str = cap_obj.at("cln_ips").as_string();
-        const auto cln_port_num = load_opt_u64(cap_obj, "cln_port");
+        const auto cln_ips      = load_networks(cap_obj, "cln_ips");
+        const auto srv_ips      = load_networks(cap_obj, "srv_ips");
+        const auto cln_stride   = load_ips_stride(cap_obj, "cln_ips_stride");
+        const auto srv_stride   = load_ips_stride(cap_obj, "srv_ips_stride");
+        const auto ips_order    = load_ips_order(cap_obj);
+        const auto* seed_val    = cap_obj.if_contains("ips_seed");
+        const auto cln_ports    = cap_obj.contains("cln_port")
+                                      ? load_ports(cap_obj, "cln_port", 1024)
+                                      : load_ports(cap_obj, "cln_ports", 1024);
+        const auto srv_ports    = load_ports(cap_obj, "srv_ports", 1);
+        const auto ports_policy = load_ports_policy(cap_obj);
+        const auto vlans        = load_vlans(cap_obj, "vlans");
+        const auto inner_vlans  = load_vlans(cap_obj, "inner_vlans");
+        const auto mpls_labels  = load_mpls_labels(cap_obj);
+        const auto tunnel       = load_tunnel(cap_obj);
+        const auto* precomp_val = cap_obj.if_contains("precompiled");
+        const auto* isn_val     = cap_obj.if_contains("isn_offsets");
+        const auto* stream_val  = cap_obj.if_contains("stream");
 
+        if ((!cln_ips.v4.empty() || !srv_ips.v4.empty()) &&
+            (!cln_ips.v6.empty() || !srv_ips.v6.empty())) {
+            put::throw_runtime_error("The `cln_ips` and `srv_ips` networks "
+                                     "must be of the same IP version");
+        }
+        if (inner_vlans && !vlans) {
+            put::throw_runtime_error(
+                "The `inner_vlans` value needs `vlans` value");
+        }
         // The limits are kind of arbitrary but there should be some limits
         if (!put::in_range_inclusive(burst_num, 1ul, 5ul)) {
             put::throw_runtime_error(
@@ -103,38 +397,46 @@ gen_config::gen_config(std::string_view cfg_info)
             put::throw_runtime_error("The `inter_packet_gaps (ipg)` value "
                                      "must be between 1 and 1'000'000");
         }
-        if (cln_port_num &&
-            !put::in_range_inclusive(*cln_port_num, 1024ul, 65535ul)) {
-            put::throw_runtime_error(
-                "The `cln_port` value must be between 1024 and 65535");
-        }
-        bsys::error_code ec;
-        const auto cln_ips = baio::ip::make_network_v4(cln_ips_str, ec);
-        if (ec) {
-            put::throw_runtime_error("Invalid `cln_ips` network: {}",
-                                     cln_ips_str);
-        }
-        const auto srv_ips = baio::ip::make_network_v4(srv_ips_str, ec);
-        if (ec) {
-            put::throw_runtime_error("Invalid `srv_ips` network: {}",
-                                     srv_ips_str);
+
+        const bool precompiled = precomp_val && precomp_val->as_bool();
+        const bool stream      = stream_val && stream_val->as_bool();
+        if (stream && ((fps_num != 1) || (burst_num != 1) || precompiled)) {
+            put::throw_runtime_error("The `stream` capture must have `fps` "
+                                     "and `burst` equal to 1 and must not be "
+                                     "`precompiled`");
         }
 
         using ipg_type = std::optional<stdcr::microseconds>;
         flows_cfgs.push_back(flows_config{
-            .name           = std::string_view(name_str),
-            .burst          = static_cast<uint32_t>(burst_num),
-            .flows_per_sec  = static_cast<uint32_t>(fps_num),
-            .inter_pkts_gap = ipg_num ? ipg_type(*ipg_num) : ipg_type{},
-            .cln_ips        = cln_ips,
-            .srv_ips        = srv_ips,
-            .cln_port       = cln_port_num,
+            .name                 = std::string_view(name_str),
+            .burst                = static_cast<uint32_t>(burst_num),
+            .flows_per_sec        = static_cast<uint32_t>(fps_num),
+            .inter_pkts_gap       = ipg_num ? ipg_type(*ipg_num) : ipg_type{},
+            .cln_ips              = cln_ips,
+            .srv_ips              = srv_ips,
+            .cln_ips_stride       = cln_stride,
+            .srv_ips_stride       = srv_stride,
+            .ips_order            = ips_order,
+            .ips_seed             = seed_val ? seed_val->as_uint64() : 0,
+            .cln_ports            = cln_ports,
+            .srv_ports            = srv_ports,
+            .ports_policy         = ports_policy,
+            .vlans                = vlans,
+            .inner_vlans          = inner_vlans,
+            .mpls_labels          = mpls_labels,
+            .tunnel               = tunnel,
+            .precompiled_schedule = precompiled,
+            .isn_offsets          = isn_val && isn_val->as_bool(),
+            .stream               = stream,
         });
     }
 
-    duration_   = stdcr::milliseconds(static_cast<uint64_t>(dur_num * 1000));
-    dut_addr_   = *dut_addr;
-    flows_cfgs_ = std::move(flows_cfgs);
+    duration_ = stdcr::milliseconds(static_cast<uint64_t>(dur_num * 1000));
+    dut_addr_ = *dut_addr;
+
+    rebalance_lag_    = rebalance_lag;
+    prerender_budget_ = prerender_budget;
+    flows_cfgs_       = std::move(flows_cfgs);
 }
 
 gen_config::~gen_config() noexcept                            = default;
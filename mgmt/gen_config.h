@@ -3,21 +3,80 @@
 namespace mgmt
 {
 
+// How the ports of the flows are chosen from the configured ranges
+enum class port_policy : uint8_t
+{
+    sequential,
+    random,
+    paired,
+};
+
+// How the addresses of the flows are chosen from the configured networks
+enum class addr_order : uint8_t
+{
+    sequential,
+    random,
+};
+
+// The networks of one side of the flows. Only one of the vectors is non-empty
+// because all networks of a capture are of the same IP version.
+struct ip_networks
+{
+    std::vector<baio_ip_net4> v4;
+    std::vector<baio_ip_net6> v6;
+};
+
+// The tunnel in which the packets of a capture are encapsulated
+enum class tunnel_type : uint8_t
+{
+    vxlan,
+    gre,
+    gtpu,
+};
+
+// The outer addresses are always IPv4 ones. The tunnel id range is [first,
+// last] and the id is 0 without a range.
+struct tunnel_config
+{
+    tunnel_type type;
+    std::vector<baio_ip_net4> cln_ips;
+    std::vector<baio_ip_net4> srv_ips;
+    std::optional<std::pair<uint32_t, uint32_t>> ids;
+};
+
 struct flows_config
 {
     stdfs::path name;
     uint32_t burst;
     uint32_t flows_per_sec;
     std::optional<stdcr::microseconds> inter_pkts_gap;
-    baio_ip_net4 cln_ips;
-    baio_ip_net4 srv_ips;
-    std::optional<uint16_t> cln_port;
+    // Every side may have several disjoint networks
+    ip_networks cln_ips;
+    ip_networks srv_ips;
+    uint32_t cln_ips_stride;
+    uint32_t srv_ips_stride;
+    addr_order ips_order;
+    uint64_t ips_seed;
+    // The port ranges are [first, last]
+    std::optional<std::pair<uint16_t, uint16_t>> cln_ports;
+    std::optional<std::pair<uint16_t, uint16_t>> srv_ports;
+    port_policy ports_policy;
+    // The tag ranges are [first, last]. The inner VLAN tags need outer ones.
+    std::optional<std::pair<uint16_t, uint16_t>> vlans;
+    std::optional<std::pair<uint16_t, uint16_t>> inner_vlans;
+    std::optional<std::pair<uint32_t, uint32_t>> mpls_labels;
+    std::optional<tunnel_config> tunnel;
+    bool precompiled_schedule;
+    bool isn_offsets;
+    bool stream; // the packets are streamed instead of loaded as templates
 };
 
 class gen_config
 {
     stdcr::milliseconds duration_;
     rte_ether_addr dut_addr_;
+    std::optional<stdcr::microseconds> rebalance_lag_;
+    std::optional<size_t> prerender_budget_; // in bytes
     std::vector<flows_config> flows_cfgs_;
 
 public:
@@ -34,6 +93,14 @@ public:
 
     rte_ether_addr dut_address() const noexcept { return dut_addr_; }
     stdcr::milliseconds duration() const noexcept { return duration_; }
+    std::optional<stdcr::microseconds> rebalance_lag() const noexcept
+    {
+        return rebalance_lag_;
+    }
+    std::optional<size_t> prerender_budget() const noexcept
+    {
+        return prerender_budget_;
+    }
     std::span<const flows_config> flows_configs() const noexcept
     {
         return flows_cfgs_;
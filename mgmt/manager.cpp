@@ -24,14 +24,29 @@ class manager_impl
 private:
     baio_context io_ctx_;
     mgmt::priv::http_server http_server_;
-    inc_messages_queue* inc_queue_;
-    out_messages_queue* out_queue_;
+    // One pair of queues per generation worker
+    std::span<inc_messages_queue> inc_queues_;
+    std::span<out_messages_queue> out_queues_;
 
     req_handlers_type req_handlers_;
     resp_callback_type start_cb_;
     resp_callback_type stop_cb_;
     resp_callback_type stats_cb_;
 
+    // Every request is sent to all generation workers and the HTTP response
+    // is sent when all of them have responded. Meanwhile the responses are
+    // combined here.
+    uint32_t cnt_start_pending_    = 0;
+    uint32_t cnt_stop_pending_     = 0;
+    uint32_t cnt_stats_pending_    = 0;
+    uint32_t cnt_rollback_pending_ = 0;
+    // The epoch of the last start request. Zero is never used because the
+    // workers publish it when they don't generate.
+    uint32_t epoch_ = 0;
+    std::string start_error_;
+    mgmt::summary_stats stop_res_;
+    mgmt::stats stats_res_;
+
 public:
     explicit manager_impl(const config_type&);
 
@@ -45,6 +60,9 @@ private: // Callbacks called by the embedded HTTP server
 private:
     void init_req_handlers() noexcept;
 
+    template <typename MakeMsg>
+    uint32_t broadcast(MakeMsg&&) noexcept;
+
     void on_req_start_gen(req_body_type, resp_callback_type&&) noexcept;
     void on_req_stop_gen(req_body_type, resp_callback_type&&) noexcept;
     void on_req_get_stats(req_body_type, resp_callback_type&&) noexcept;
@@ -53,6 +71,14 @@ private:
     void on_inc_msg(mgmt::res_stop_generation&&) noexcept;
     void on_inc_msg(mgmt::res_stats_report&&) noexcept;
     void on_inc_msg(mgmt::generation_report&&) noexcept;
+    void on_inc_msg(mgmt::generation_report6&&) noexcept;
+    template <typename Report>
+    void write_report(const Report&) noexcept;
+
+    void send_start_response() noexcept;
+    void rollback_start() noexcept;
+    void send_stop_response() noexcept;
+    void send_stats_response() noexcept;
 
     template <typename... Args>
     static resp_body_type make_response_body(fmt::format_string<Args...>,
@@ -63,9 +89,12 @@ private:
 
 manager_impl::manager_impl(const config_type& cfg)
 : http_server_(io_ctx_, cfg.endpoint)
-, inc_queue_(cfg.inc_queue)
-, out_queue_(cfg.out_queue)
+, inc_queues_(cfg.inc_queues)
+, out_queues_(cfg.out_queues)
 {
+    TG_ENFORCE(!inc_queues_.empty());
+    TG_ENFORCE(inc_queues_.size() == out_queues_.size());
+
     TG_LOG_INFO("Started management server at {}\n", cfg.endpoint);
 
     init_req_handlers();
@@ -82,7 +111,9 @@ manager_impl::manager_impl(const config_type& cfg)
 void manager_impl::process_events() noexcept
 {
     io_ctx_.poll_one();
-    inc_queue_->dequeue([this](auto&& msg) { on_inc_msg(std::move(msg)); });
+    for (auto& queue : inc_queues_) {
+        queue.dequeue([this](auto&& msg) { on_inc_msg(std::move(msg)); });
+    }
 }
 
 void manager_impl::on_http_request(target_type target,
@@ -114,6 +145,18 @@ void manager_impl::init_req_handlers() noexcept
     req_handlers_["/get_stats"sv] = &manager_impl::on_req_get_stats;
 }
 
+template <typename MakeMsg>
+uint32_t manager_impl::broadcast(MakeMsg&& make_msg) noexcept
+{
+    // Returns the number of workers which got the message and thus the number
+    // of the responses which need to be waited for.
+    uint32_t cnt = 0;
+    for (auto& queue : out_queues_) {
+        if (queue.enqueue(make_msg())) ++cnt;
+    }
+    return cnt;
+}
+
 void manager_impl::on_req_start_gen(req_body_type req,
                                     resp_callback_type&& cb) noexcept
 {
@@ -125,10 +168,22 @@ void manager_impl::on_req_start_gen(req_body_type req,
         return;
     }
     try {
-        auto cfg = std::make_unique<mgmt::gen_config>(req);
-        if (out_queue_->enqueue(req_start_generation{std::move(cfg)})) {
+        // Every worker gets its own copy of the configuration.
+        const mgmt::gen_config cfg(req);
+        const uint32_t epoch = ++epoch_;
+        const auto cnt       = broadcast([&] {
+            return req_start_generation{
+                .cfg   = std::make_unique<mgmt::gen_config>(cfg),
+                .epoch = epoch,
+            };
+        });
+        if (cnt > 0) {
             TG_LOG_INFO("Enqueued start generation request\n");
-            start_cb_ = std::move(cb);
+            start_cb_          = std::move(cb);
+            cnt_start_pending_ = cnt;
+            if (cnt != out_queues_.size()) {
+                start_error_ = "Failed to enqueue request to all workers";
+            }
         } else {
             TG_LOG_INFO("Failed to enqueue start generation request\n");
             cb(bhttp::status::internal_server_error,
@@ -152,9 +207,10 @@ void manager_impl::on_req_stop_gen(req_body_type,
            make_response_body("Stop already in progress"));
         return;
     }
-    if (out_queue_->enqueue(req_stop_generation{})) {
+    if (const auto cnt = broadcast([] { return req_stop_generation{}; })) {
         TG_LOG_INFO("Enqueued stop generation request\n");
-        stop_cb_ = std::move(cb);
+        stop_cb_          = std::move(cb);
+        cnt_stop_pending_ = cnt;
     } else {
         TG_LOG_INFO("Failed to enqueue stop generation request\n");
         cb(bhttp::status::internal_server_error,
@@ -172,9 +228,10 @@ void manager_impl::on_req_get_stats(req_body_type,
            make_response_body("Stats request already in progress"));
         return;
     }
-    if (out_queue_->enqueue(req_stats_report{})) {
+    if (const auto cnt = broadcast([] { return req_stats_report{}; })) {
         TG_LOG_DEBUG("Enqueued stats request\n");
-        stats_cb_ = std::move(cb);
+        stats_cb_          = std::move(cb);
+        cnt_stats_pending_ = cnt;
     } else {
         TG_LOG_DEBUG("Failed to enqueue stsyd request\n");
         cb(bhttp::status::internal_server_error,
@@ -183,23 +240,80 @@ void manager_impl::on_req_get_stats(req_body_type,
 }
 
 void manager_impl::on_inc_msg(mgmt::res_start_generation&& msg) noexcept
+{
+    TG_ENFORCE(cnt_start_pending_ > 0);
+    // Only the first error is reported back
+    if (!msg.res && start_error_.empty()) start_error_ = msg.res.error();
+    if (--cnt_start_pending_ == 0) send_start_response();
+}
+
+void manager_impl::on_inc_msg(mgmt::res_stop_generation&& msg) noexcept
+{
+    if (msg.rollback) {
+        TG_ENFORCE(cnt_rollback_pending_ > 0);
+        if (--cnt_rollback_pending_ == 0) {
+            TG_LOG_INFO("Rolled back failed start generation\n");
+        }
+        return;
+    }
+    TG_ENFORCE(cnt_stop_pending_ > 0);
+    stop_res_.summary += msg.res.summary;
+    stop_res_.detailed.insert(stop_res_.detailed.end(),
+                              msg.res.detailed.begin(),
+                              msg.res.detailed.end());
+    stop_res_.schedule.insert(stop_res_.schedule.end(),
+                              msg.res.schedule.begin(),
+                              msg.res.schedule.end());
+    stop_res_.pipeline.insert(stop_res_.pipeline.end(),
+                              msg.res.pipeline.begin(),
+                              msg.res.pipeline.end());
+    if (--cnt_stop_pending_ == 0) send_stop_response();
+}
+
+void manager_impl::on_inc_msg(mgmt::res_stats_report&& msg) noexcept
+{
+    TG_ENFORCE(cnt_stats_pending_ > 0);
+    stats_res_ += msg.res;
+    if (--cnt_stats_pending_ == 0) send_stats_response();
+}
+
+void manager_impl::send_start_response() noexcept
 {
     TG_ENFORCE(start_cb_);
-    if (msg.res) {
+    if (start_error_.empty()) {
         TG_LOG_INFO("Successfully started generation\n");
         start_cb_(bhttp::status::ok, make_response_body("Generation started"));
     } else {
-        TG_LOG_INFO("Failed to start generation: {}\n", msg.res.error());
+        TG_LOG_INFO("Failed to start generation: {}\n", start_error_);
+        rollback_start();
         start_cb_(bhttp::status::precondition_failed,
                   make_response_body("Failed to start generation: {}\n",
-                                     msg.res.error()));
+                                     start_error_));
     }
     start_cb_ = {};
+    start_error_.clear();
 }
 
-void manager_impl::on_inc_msg(mgmt::res_stop_generation&& msg) noexcept
+void manager_impl::rollback_start() noexcept
+{
+    // The workers which have started need to be stopped when any of them
+    // fails to start or doesn't get the request at all. Otherwise they would
+    // generate with only part of the flows. The stop is sent to all workers
+    // because it's ignored by the ones which haven't started in this epoch.
+    const auto cnt = broadcast(
+        [this] { return req_stop_generation{.rollback_epoch = epoch_}; });
+    if (cnt != out_queues_.size()) {
+        TG_LOG_ERROR("Failed to enqueue rollback stop generation request to "
+                     "{} workers\n",
+                     out_queues_.size() - cnt);
+    }
+    cnt_rollback_pending_ += cnt;
+}
+
+void manager_impl::send_stop_response() noexcept
 {
     TG_LOG_INFO("Successfully stopped generation\n");
+    const auto& res = stop_res_;
     // This manual JSON generation is ugly and verbose but:
     // - there are only few messages where this is needed
     // - it's faster than putting the content into boost::json::value and
@@ -207,12 +321,12 @@ void manager_impl::on_inc_msg(mgmt::res_stop_generation&& msg) noexcept
     std::string body;
     body.reserve(4096);
     body += R"({"result": {)";
-    msg.res.summary.visit([&](std::string_view nam, auto val) {
+    res.summary.visit([&](std::string_view nam, auto val) {
         fmt::format_to(std::back_inserter(body), "\"{}\":{},", nam, val);
     });
     body.pop_back(); // Remove the last comma
     body += R"(}, "detailed": [)";
-    for (const auto& ent : msg.res.detailed) {
+    for (const auto& ent : res.detailed) {
         body += '{';
         fmt::format_to(std::back_inserter(body), "\"gen_idx\":{},",
                        ent.gen_idx);
@@ -227,21 +341,62 @@ void manager_impl::on_inc_msg(mgmt::res_stop_generation&& msg) noexcept
         body += "},";
     }
     if (body.back() == ',') body.pop_back();
+    body += R"(], "schedule": [)";
+    for (const auto& ent : res.schedule) {
+        const auto avg_error =
+            put::cycles{ent.cnt_pkts ? (ent.total_error.num / ent.cnt_pkts)
+                                     : 0};
+        body += '{';
+        fmt::format_to(std::back_inserter(body), "\"worker_idx\":{},",
+                       ent.worker_idx);
+        fmt::format_to(std::back_inserter(body), "\"gen_idx\":{},",
+                       ent.gen_idx);
+        fmt::format_to(std::back_inserter(body), "\"cnt_pkts\":{},",
+                       ent.cnt_pkts);
+        fmt::format_to(std::back_inserter(body), "\"total_error_usec\":{},",
+                       ent.total_error.to<stdcr::microseconds>().count());
+        fmt::format_to(std::back_inserter(body), "\"max_error_usec\":{},",
+                       ent.max_error.to<stdcr::microseconds>().count());
+        fmt::format_to(std::back_inserter(body), "\"avg_error_nsec\":{},",
+                       avg_error.to<stdcr::nanoseconds>().count());
+        fmt::format_to(std::back_inserter(body), "\"cnt_flows_in\":{},",
+                       ent.cnt_flows_in);
+        fmt::format_to(std::back_inserter(body), "\"cnt_flows_out\":{}",
+                       ent.cnt_flows_out);
+        body += "},";
+    }
+    if (body.back() == ',') body.pop_back();
+    body += R"(], "pipeline": [)";
+    for (const auto& ent : res.pipeline) {
+        body += '{';
+        fmt::format_to(std::back_inserter(body), "\"worker_idx\":{},",
+                       ent.worker_idx);
+        fmt::format_to(std::back_inserter(body), "\"ring_size\":{},",
+                       ent.ring_size);
+        fmt::format_to(std::back_inserter(body), "\"avg_occupancy\":{},",
+                       ent.avg_occupancy);
+        fmt::format_to(std::back_inserter(body), "\"max_occupancy\":{},",
+                       ent.max_occupancy);
+        fmt::format_to(std::back_inserter(body), "\"cnt_tx_busy\":{}",
+                       ent.cnt_tx_busy);
+        body += "},";
+    }
+    if (body.back() == ',') body.pop_back();
     body += R"(]})";
 
     TG_ENFORCE(stop_cb_);
     stop_cb_(bhttp::status::ok, std::move(body));
-    stop_cb_ = {};
+    stop_cb_  = {};
+    stop_res_ = {};
 }
 
-void manager_impl::on_inc_msg(mgmt::res_stats_report&& msg) noexcept
+void manager_impl::send_stats_response() noexcept
 {
-    TG_LOG_INFO("Successfully stopped generation\n");
 
     std::string body;
     body.reserve(1024);
     body += R"({"result": {)";
-    msg.res.visit([&](std::string_view nam, auto val) {
+    stats_res_.visit([&](std::string_view nam, auto val) {
         fmt::format_to(std::back_inserter(body), "\"{}\":{},", nam, val);
     });
     body.pop_back(); // Remove the last comma
@@ -249,10 +404,24 @@ void manager_impl::on_inc_msg(mgmt::res_stats_report&& msg) noexcept
 
     TG_ENFORCE(stats_cb_);
     stats_cb_(bhttp::status::ok, std::move(body));
-    stats_cb_ = {};
+    stats_cb_  = {};
+    stats_res_ = {};
+}
+
+void manager_impl::on_inc_msg(mgmt::generation_report&& msg) noexcept
+{
+    write_report(msg);
+}
+
+// The IPv6 reports go the same way as the IPv4 ones and only their addresses
+// are different.
+void manager_impl::on_inc_msg(mgmt::generation_report6&& msg) noexcept
+{
+    write_report(msg);
 }
 
-void manager_impl::on_inc_msg(mgmt::generation_report&&) noexcept
+template <typename Report>
+void manager_impl::write_report(const Report&) noexcept
 {
     // TODO Write the generation report in CSV format:
     // - it can be written in the memory and dumped to a file when the
@@ -13,8 +13,9 @@ public:
     struct config
     {
         baio_tcp_endpoint endpoint;
-        inc_messages_queue* inc_queue;
-        out_messages_queue* out_queue;
+        // One pair of queues per generation worker
+        std::span<inc_messages_queue> inc_queues;
+        std::span<out_messages_queue> out_queues;
     };
 
 public:
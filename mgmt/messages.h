@@ -8,9 +8,12 @@
 namespace mgmt
 {
 
+// The management assigns a new epoch to every start request so that the
+// workers agree on it even if some of them miss some of the requests.
 struct req_start_generation
 {
     std::unique_ptr<gen_config> cfg;
+    uint32_t epoch;
 };
 
 struct res_start_generation
@@ -18,13 +21,18 @@ struct res_start_generation
     bout::result<void, std::string> res = bout::success();
 };
 
+// The rollback stops are sent by the management itself when a start fails
+// and their responses aren't reported. They stop only a generation started
+// by the failed request, if any, but not one started before it.
 struct req_stop_generation
 {
+    uint32_t rollback_epoch = 0; // zero for the regular stops
 };
 
 struct res_stop_generation
 {
     mgmt::summary_stats res = {};
+    bool rollback           = false;
 };
 
 struct req_stats_report
@@ -87,7 +95,8 @@ struct inc_messages_queue
                  res_start_generation,
                  res_stop_generation,
                  res_stats_report,
-                 generation_report>
+                 generation_report,
+                 generation_report6>
 {
 };
 
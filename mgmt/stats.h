@@ -8,19 +8,28 @@ namespace mgmt
 // TODO: Further development
 // These stats could be extended with stats per generator so that we can draw
 // not only real-time summary graphs but also real-time graphs per generator
+// The device and the templates library counters are reported only by the
+// first generation worker while the other counters are reported by every
+// worker and they are summed.
 struct stats
 {
-#define TG_COUNTERS(MACRO)              \
-    MACRO(uint64_t, cnt_rx_pkts)        \
-    MACRO(uint64_t, cnt_tx_pkts)        \
-    MACRO(uint64_t, cnt_rx_bytes)       \
-    MACRO(uint64_t, cnt_tx_bytes)       \
-    MACRO(uint64_t, cnt_rx_pkts_qfull)  \
-    MACRO(uint64_t, cnt_rx_pkts_nombuf) \
-    MACRO(uint64_t, cnt_tx_pkts_qfull)  \
-    MACRO(uint64_t, cnt_tx_pkts_nombuf) \
-    MACRO(uint64_t, cnt_rx_pkts_err)    \
-    MACRO(uint64_t, cnt_tx_pkts_err)
+#define TG_COUNTERS(MACRO)                  \
+    MACRO(uint64_t, cnt_rx_pkts)            \
+    MACRO(uint64_t, cnt_tx_pkts)            \
+    MACRO(uint64_t, cnt_rx_bytes)           \
+    MACRO(uint64_t, cnt_tx_bytes)           \
+    MACRO(uint64_t, cnt_rx_pkts_qfull)      \
+    MACRO(uint64_t, cnt_rx_pkts_nombuf)     \
+    MACRO(uint64_t, cnt_tx_pkts_qfull)      \
+    MACRO(uint64_t, cnt_tx_pkts_nombuf)     \
+    MACRO(uint64_t, cnt_rx_pkts_err)        \
+    MACRO(uint64_t, cnt_tx_pkts_err)        \
+    MACRO(uint64_t, cnt_tmpl_lib_hits)      \
+    MACRO(uint64_t, cnt_tmpl_lib_misses)    \
+    MACRO(uint64_t, cnt_tmpl_lib_evictions) \
+    MACRO(uint64_t, tmpl_lib_cnt_entries)   \
+    MACRO(uint64_t, tmpl_lib_cnt_mbufs)     \
+    MACRO(uint64_t, tmpl_lib_cnt_bytes)
 
 #define XXX(type, name) type name = 0;
     TG_COUNTERS(XXX)
@@ -34,6 +43,15 @@ struct stats
 #undef XXX
     }
 
+    // Used to sum the stats coming from the different generation workers
+    stats& operator+=(const stats& rhs) noexcept
+    {
+#define XXX(type, name) name += rhs.name;
+        TG_COUNTERS(XXX)
+#undef XXX
+        return *this;
+    }
+
 #undef TG_COUNTERS
 };
 
@@ -51,6 +69,33 @@ struct summary_stats
         put::cycles duration;
     };
     std::vector<entry> detailed;
+
+    // The difference between the intended and the actual send time of the
+    // packets accumulated per generator.
+    struct sched_entry
+    {
+        uint32_t worker_idx;
+        uint32_t gen_idx;
+        uint64_t cnt_pkts;
+        put::cycles total_error;
+        put::cycles max_error;
+        // The flows handed over from/to the other workers
+        uint64_t cnt_flows_in;
+        uint64_t cnt_flows_out;
+    };
+    std::vector<sched_entry> schedule;
+
+    // The occupancy of the ring between the scheduling and the transmission
+    // stage of every worker. Present only in the pipeline mode.
+    struct pipeline_entry
+    {
+        uint32_t worker_idx;
+        uint64_t ring_size;
+        uint64_t avg_occupancy;
+        uint64_t max_occupancy;
+        uint64_t cnt_tx_busy;
+    };
+    std::vector<pipeline_entry> pipeline;
 };
 
 // Report used for producing a CSV report with per generator/flow/packet
@@ -68,4 +113,19 @@ struct generation_report
     uint32_t ok       : 1; // true - generated, false - generation missed
 };
 
+// The same for the IPv6 packets. It's a separate type so that the reports of
+// the IPv4 packets stay small.
+struct generation_report6
+{
+    put::cycles tstamp;
+    uint32_t gen_idx;
+    uint32_t flow_idx;
+    uint32_t pkt_idx;
+    uint32_t pkt_len;
+    in6_addr src_addr;
+    in6_addr dst_addr;
+    uint32_t from_cln : 1; // true - from client, false - from server
+    uint32_t ok       : 1; // true - generated, false - generation missed
+};
+
 } // namespace mgmt
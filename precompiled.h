@@ -15,7 +15,9 @@
 #include <unistd.h>
 
 #include <pcap/pcap.h>
+#include <sys/mman.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // DPDK headers
@@ -23,12 +25,16 @@
 #include <rte_errno.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_gre.h>
+#include <rte_gtp.h>
 #include <rte_ip.h>
 #include <rte_launch.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
 #include <rte_mbuf.h>
 #include <rte_tcp.h>
-#include <rte_timer.h>
 #include <rte_udp.h>
+#include <rte_vxlan.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 // c++ standard library headers
@@ -36,17 +42,23 @@
 #include <atomic>
 #include <charconv>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <exception>
 #include <filesystem>
 #include <functional>
+#include <list>
 #include <optional>
 #include <memory>
+#include <mutex>
 #include <new> // launder
+#include <numeric>
 #include <span>
 #include <stdexcept>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -57,6 +69,7 @@
 #include <boost/algorithm/string/split.hpp>
 #include <boost/asio/ip/address.hpp>
 #include <boost/asio/ip/network_v4.hpp>
+#include <boost/asio/ip/network_v6.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/as_tuple.hpp>
 #include <boost/asio/awaitable.hpp>
@@ -66,6 +79,7 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/container/flat_map.hpp>
+#include <boost/container/vector.hpp>
 #include <boost/endian/conversion.hpp>
 #include <boost/json/parser.hpp>
 #include <boost/json/value.hpp>
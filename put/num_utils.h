@@ -3,6 +3,10 @@
 namespace put // project utilities
 {
 
+// The 128 bit integers are an extension of GCC and Clang. They are used for
+// the arithmetic with IPv6 addresses.
+using uint128 = unsigned __int128;
+
 // Range [x1, x2)
 template <std::integral T, std::integral U, std::integral V>
 constexpr bool in_range(T x, U x1, V x2) noexcept
@@ -25,4 +29,13 @@ constexpr bool is_pow2(T n) noexcept
     return ((n & (n - 1)) == 0);
 }
 
+// The finalizer of the SplitMix64 generator. It's a bijection which spreads
+// every bit of the input over all bits of the output.
+constexpr uint64_t mix64(uint64_t x) noexcept
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
 } // namespace put
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "put/num_utils.h"
+#include "put/tg_assert.h"
+
+namespace put
+{
+
+// Seeded pseudo random permutation of the range [0, size).
+// It's a Feistel network over the smallest power of two domain which covers
+// the range. The halves are unbalanced for odd count of bits and they swap
+// their widths on every round. The values which fall out of the range are
+// passed through the network again until they come in it (cycle walking).
+// The domain is less than 2 times bigger than the range and thus the expected
+// count of walks is less than 2. Every value is computed in O(1) without
+// any tables.
+class feistel_permutation
+{
+    static constexpr uint32_t cnt_rounds = 4; // must be even
+
+    uint64_t size_;
+    uint32_t left_bits_;
+    uint32_t right_bits_;
+    std::array<uint64_t, cnt_rounds> keys_;
+
+public:
+    feistel_permutation(uint64_t size, uint64_t seed) noexcept : size_(size)
+    {
+        TG_ENFORCE(size > 0);
+        uint32_t bits = 1;
+        while ((bits < 64) && ((1ull << bits) < size)) ++bits;
+        left_bits_  = (bits + 1) / 2;
+        right_bits_ = bits / 2;
+        for (auto& key : keys_) key = seed = mix64(seed + 1);
+    }
+
+    uint64_t size() const noexcept { return size_; }
+
+    uint64_t operator()(uint64_t val) const noexcept
+    {
+        TG_ASSERT(val < size_);
+        do {
+            val = encrypt(val);
+        } while (val >= size_);
+        return val;
+    }
+
+private:
+    static uint64_t mask(uint32_t bits) noexcept
+    {
+        return (bits < 64) ? ((1ull << bits) - 1) : UINT64_MAX;
+    }
+
+    uint64_t encrypt(uint64_t val) const noexcept
+    {
+        uint32_t lbits = left_bits_;
+        uint32_t rbits = right_bits_;
+        uint64_t left  = val >> rbits;
+        uint64_t right = val & mask(rbits);
+        for (const auto key : keys_) {
+            const uint64_t tmp = left ^ (mix64(right ^ key) & mask(lbits));
+            left               = right;
+            right              = tmp;
+            std::swap(lbits, rbits);
+        }
+        return (left << rbits) | right;
+    }
+};
+
+} // namespace put
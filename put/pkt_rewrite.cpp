@@ -0,0 +1,801 @@
+#include "put/pkt_rewrite.h"
+#include "put/pkt_utils.h"
+#include "put/tg_assert.h"
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+namespace put
+{
+
+void select_ipv4_addrs(std::span<ipv4_addrs> out,
+                       const uint32_t* cln_addrs,
+                       const uint32_t* srv_addrs,
+                       const uint8_t* from_cln) noexcept
+{
+    const size_t cnt = out.size();
+    size_t i         = 0;
+#if defined(__AVX2__)
+    // Reverses the bytes of every 32 bit lane.
+    const __m256i bswap = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, //
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; (i + 8) <= cnt; i += 8) {
+        const auto cln = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(cln_addrs + i));
+        const auto srv = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(srv_addrs + i));
+        // The direction flags are widened to masks over the whole lanes.
+        const auto fc8 =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(from_cln + i));
+        const auto fc  = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(fc8),
+                                            _mm256_setzero_si256());
+        const auto src = _mm256_shuffle_epi8(_mm256_blendv_epi8(srv, cln, fc),
+                                             bswap);
+        const auto dst = _mm256_shuffle_epi8(_mm256_blendv_epi8(cln, srv, fc),
+                                             bswap);
+        // The unpacking works inside the 128 bit halves and gives the pairs
+        // 0, 1, 4, 5 and 2, 3, 6, 7 which are put back in order.
+        const auto lo = _mm256_unpacklo_epi32(src, dst);
+        const auto hi = _mm256_unpackhi_epi32(src, dst);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i]),
+                            _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(&out[i + 4]),
+                            _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+#elif defined(__SSE4_2__)
+    // Reverses the bytes of every 32 bit lane.
+    const __m128i bswap =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; (i + 4) <= cnt; i += 4) {
+        const auto cln =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(cln_addrs + i));
+        const auto srv =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(srv_addrs + i));
+        // The direction flags are widened to masks over the whole lanes.
+        int32_t fc4 = 0;
+        ::memcpy(&fc4, from_cln + i, sizeof(fc4));
+        const auto fc8 = _mm_cvtsi32_si128(fc4);
+        const auto fc  = _mm_cmpgt_epi32(_mm_cvtepu8_epi32(fc8),
+                                         _mm_setzero_si128());
+        const auto src = _mm_shuffle_epi8(_mm_blendv_epi8(srv, cln, fc), bswap);
+        const auto dst = _mm_shuffle_epi8(_mm_blendv_epi8(cln, srv, fc), bswap);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                         _mm_unpacklo_epi32(src, dst));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i + 2]),
+                         _mm_unpackhi_epi32(src, dst));
+    }
+#endif
+    // The tail of the batch or the whole batch without SIMD support.
+    for (; i < cnt; ++i) {
+        const uint32_t cln = ben::native_to_big(cln_addrs[i]);
+        const uint32_t srv = ben::native_to_big(srv_addrs[i]);
+        out[i] = from_cln[i] ? ipv4_addrs{.src = cln, .dst = srv}
+                             : ipv4_addrs{.src = srv, .dst = cln};
+    }
+}
+
+void select_ipv6_addrs(std::span<ipv6_addrs> out,
+                       const uint128* cln_addrs,
+                       const uint128* srv_addrs,
+                       const uint8_t* from_cln) noexcept
+{
+    // The numbers are stored in little endian order and the reversal of all
+    // of their bytes gives the addresses in network byte order.
+#if defined(__AVX2__)
+    const __m256i bswap = _mm256_setr_epi8(
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0, //
+        15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (size_t i = 0; i < out.size(); ++i) {
+        // The client address is in the low half and the server address is
+        // in the high half and the swap of the halves gives the other order.
+        const auto cln =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(cln_addrs + i));
+        const auto srv =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(srv_addrs + i));
+        const auto cs =
+            _mm256_inserti128_si256(_mm256_castsi128_si256(cln), srv, 1);
+        const auto sc = _mm256_permute2x128_si256(cs, cs, 0x01);
+        const auto fc = _mm256_set1_epi8(-static_cast<char>(from_cln[i]));
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(&out[i]),
+            _mm256_shuffle_epi8(_mm256_blendv_epi8(sc, cs, fc), bswap));
+    }
+#elif defined(__SSE4_2__)
+    const __m128i bswap =
+        _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (size_t i = 0; i < out.size(); ++i) {
+        const auto cln = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(cln_addrs + i)),
+            bswap);
+        const auto srv = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(srv_addrs + i)),
+            bswap);
+        const auto fc = _mm_set1_epi8(-static_cast<char>(from_cln[i]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i].src),
+                         _mm_blendv_epi8(srv, cln, fc));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i].dst),
+                         _mm_blendv_epi8(cln, srv, fc));
+    }
+#else
+    auto to_addr = [](uint128 num) {
+        const std::array<uint64_t, 2> halves = {
+            ben::native_to_big(static_cast<uint64_t>(num >> 64)),
+            ben::native_to_big(static_cast<uint64_t>(num)),
+        };
+        in6_addr ret;
+        ::memcpy(&ret, halves.data(), sizeof(ret));
+        return ret;
+    };
+    for (size_t i = 0; i < out.size(); ++i) {
+        const auto cln = to_addr(cln_addrs[i]);
+        const auto srv = to_addr(srv_addrs[i]);
+        out[i] = from_cln[i] ? ipv6_addrs{.src = cln, .dst = srv}
+                             : ipv6_addrs{.src = srv, .dst = cln};
+    }
+#endif
+}
+
+void select_l4_ports(std::span<uint32_t> out,
+                     const uint32_t* ports,
+                     const uint8_t* from_cln) noexcept
+{
+    // The client port is in the high half of the value and the byte swap of
+    // the whole value puts it first, as source port, in network byte order.
+    // The byte swap of the halves puts the server port first.
+    const size_t cnt = out.size();
+    size_t i         = 0;
+#if defined(__AVX2__)
+    const __m256i to_cln = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12, //
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i to_srv = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14, //
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; (i + 8) <= cnt; i += 8) {
+        const auto po =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ports + i));
+        const auto fc8 =
+            _mm_loadl_epi64(reinterpret_cast<const __m128i*>(from_cln + i));
+        const auto fc = _mm256_cmpgt_epi32(_mm256_cvtepu8_epi32(fc8),
+                                           _mm256_setzero_si256());
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(&out[i]),
+            _mm256_blendv_epi8(_mm256_shuffle_epi8(po, to_srv),
+                               _mm256_shuffle_epi8(po, to_cln), fc));
+    }
+#elif defined(__SSE4_2__)
+    const __m128i to_cln =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m128i to_srv =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    for (; (i + 4) <= cnt; i += 4) {
+        const auto po =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(ports + i));
+        int32_t fc4 = 0;
+        ::memcpy(&fc4, from_cln + i, sizeof(fc4));
+        const auto fc8 = _mm_cvtsi32_si128(fc4);
+        const auto fc  = _mm_cmpgt_epi32(_mm_cvtepu8_epi32(fc8),
+                                         _mm_setzero_si128());
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&out[i]),
+                         _mm_blendv_epi8(_mm_shuffle_epi8(po, to_srv),
+                                         _mm_shuffle_epi8(po, to_cln), fc));
+    }
+#endif
+    for (; i < cnt; ++i) {
+        const uint32_t po = ports[i];
+        out[i] = from_cln[i] ? ben::native_to_big(po)
+                             : ben::native_to_big((po << 16) | (po >> 16));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+static uint32_t sum_words(uint32_t v1, uint32_t v2) noexcept
+{
+    return (v1 & 0xFFFF) + (v1 >> 16) + (v2 & 0xFFFF) + (v2 >> 16);
+}
+
+// Adds the 16 bit words of both addresses of every packet without folding
+// the carries. The words are taken in memory order and so are the checksums
+// calculated from them.
+static void sum_ipv4_addrs(const ipv4_addrs* addrs,
+                           size_t cnt,
+                           uint32_t* sums) noexcept
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i lo_mask = _mm256_set1_epi32(0xFFFF);
+    for (; (i + 8) <= cnt; i += 8) {
+        const auto a0 =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&addrs[i]));
+        const auto a1 = _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(&addrs[i + 4]));
+        const auto w0 = _mm256_add_epi32(_mm256_and_si256(a0, lo_mask),
+                                         _mm256_srli_epi32(a0, 16));
+        const auto w1 = _mm256_add_epi32(_mm256_and_si256(a1, lo_mask),
+                                         _mm256_srli_epi32(a1, 16));
+        // The horizontal add works inside the 128 bit halves and gives the
+        // sums of the packets 0, 1, 4, 5 and 2, 3, 6, 7.
+        const auto sw = _mm256_hadd_epi32(w0, w1);
+        _mm256_storeu_si256(
+            reinterpret_cast<__m256i*>(sums + i),
+            _mm256_permute4x64_epi64(sw, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+#elif defined(__SSE4_2__)
+    const __m128i lo_mask = _mm_set1_epi32(0xFFFF);
+    for (; (i + 4) <= cnt; i += 4) {
+        const auto a0 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&addrs[i]));
+        const auto a1 =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&addrs[i + 2]));
+        const auto w0 = _mm_add_epi32(_mm_and_si128(a0, lo_mask),
+                                      _mm_srli_epi32(a0, 16));
+        const auto w1 = _mm_add_epi32(_mm_and_si128(a1, lo_mask),
+                                      _mm_srli_epi32(a1, 16));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i),
+                         _mm_hadd_epi32(w0, w1));
+    }
+#endif
+    for (; i < cnt; ++i) sums[i] = sum_words(addrs[i].src, addrs[i].dst);
+}
+
+// The same for the IPv6 addresses. The vectorized versions work on four
+// packets at once and reduce their words with horizontal adds.
+static void sum_ipv6_addrs(const ipv6_addrs* addrs,
+                           size_t cnt,
+                           uint32_t* sums) noexcept
+{
+    size_t i = 0;
+#if defined(__AVX2__)
+    const __m256i lo_mask = _mm256_set1_epi32(0xFFFF);
+    auto words            = [&lo_mask](const ipv6_addrs& a) {
+        const auto v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&a));
+        return _mm256_add_epi32(_mm256_and_si256(v, lo_mask),
+                                _mm256_srli_epi32(v, 16));
+    };
+    for (; (i + 4) <= cnt; i += 4) {
+        const auto s01 =
+            _mm256_hadd_epi32(words(addrs[i]), words(addrs[i + 1]));
+        const auto s23 =
+            _mm256_hadd_epi32(words(addrs[i + 2]), words(addrs[i + 3]));
+        // The 128 bit halves have the sums of the packets 0, 1, 2, 3 over
+        // the low and over the high halves of their addresses.
+        const auto s4 = _mm256_hadd_epi32(s01, s23);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i),
+                         _mm_add_epi32(_mm256_castsi256_si128(s4),
+                                       _mm256_extracti128_si256(s4, 1)));
+    }
+#elif defined(__SSE4_2__)
+    const __m128i lo_mask = _mm_set1_epi32(0xFFFF);
+    auto words            = [&lo_mask](const ipv6_addrs& a) {
+        const auto s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a));
+        const auto d =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(&a.dst));
+        return _mm_add_epi32(
+            _mm_add_epi32(_mm_and_si128(s, lo_mask), _mm_srli_epi32(s, 16)),
+            _mm_add_epi32(_mm_and_si128(d, lo_mask), _mm_srli_epi32(d, 16)));
+    };
+    for (; (i + 4) <= cnt; i += 4) {
+        const auto s01 = _mm_hadd_epi32(words(addrs[i]), words(addrs[i + 1]));
+        const auto s23 =
+            _mm_hadd_epi32(words(addrs[i + 2]), words(addrs[i + 3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + i),
+                         _mm_hadd_epi32(s01, s23));
+    }
+#endif
+    for (; i < cnt; ++i) {
+        std::array<uint32_t, sizeof(ipv6_addrs) / sizeof(uint32_t)> vals;
+        ::memcpy(vals.data(), &addrs[i], sizeof(vals));
+        sums[i] = 0;
+        for (size_t v = 0; v < vals.size(); v += 2) {
+            sums[i] += sum_words(vals[v], vals[v + 1]);
+        }
+    }
+}
+
+static void
+sum_addrs(const ipv4_addrs* addrs, size_t cnt, uint32_t* sums) noexcept
+{
+    sum_ipv4_addrs(addrs, cnt, sums);
+}
+
+static void
+sum_addrs(const ipv6_addrs* addrs, size_t cnt, uint32_t* sums) noexcept
+{
+    sum_ipv6_addrs(addrs, cnt, sums);
+}
+
+static uint16_t fold_sum(uint32_t sum) noexcept
+{
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return static_cast<uint16_t>(sum);
+}
+
+// The base is the sum of all words covered by the checksum except the words
+// which change per packet, i.e. `~cksum - changing` in one's complement
+// arithmetic.
+static uint16_t cksum_base(uint16_t cksum, uint32_t changing_sum) noexcept
+{
+    return fold_sum(uint16_t(~cksum) + uint16_t(~fold_sum(changing_sum)));
+}
+
+// Returns the checksum over the base and the given sum of the changed words.
+// The zero result is given as 0xFFFF which is the same in one's complement
+// arithmetic and it's required for the UDP where zero means no checksum.
+static uint16_t finish_cksum(uint16_t base, uint32_t sum) noexcept
+{
+    const auto ret = static_cast<uint16_t>(~fold_sum(base + sum));
+    return (ret == 0) ? 0xFFFF : ret;
+}
+
+// Returns the L4 protocol of the IPv4 or IPv6 packet and the offset of its
+// L4 header. The IP version is taken from the first IP header byte.
+static std::pair<uint8_t, size_t> l4_hdr_of(const rte_mbuf* pkt,
+                                            uint16_t l2_len) noexcept
+{
+    const auto* ver = rte_pktmbuf_mtod_offset(pkt, const uint8_t*, l2_len);
+    if ((*ver >> 4) == 6) {
+        const auto* ih = read_hdr<rte_ipv6_hdr>(pkt, l2_len);
+        TG_ASSERT(ih);
+        return {ih->proto, l2_len + sizeof(rte_ipv6_hdr)};
+    }
+    const auto* ih = read_hdr<rte_ipv4_hdr>(pkt, l2_len);
+    TG_ASSERT(ih);
+    return {ih->next_proto_id, l2_len + hdr_len(ih)};
+}
+
+void init_l4_tx_meta(tx_meta& meta, const rte_mbuf* pkt) noexcept
+{
+    const auto [proto, l4_off] = l4_hdr_of(pkt, meta.l2_len);
+    switch (proto) {
+    case IPPROTO_TCP:
+        if (const auto* th = read_hdr<rte_tcp_hdr>(pkt, l4_off); th) {
+            meta.tcp_seq_off = static_cast<uint16_t>(
+                l4_off + offsetof(rte_tcp_hdr, sent_seq));
+            meta.tcp_has_ack = (th->tcp_flags & RTE_TCP_ACK_FLAG) != 0;
+            meta.tcp_seq     = ben::big_to_native(th->sent_seq);
+            meta.tcp_ack     = ben::big_to_native(th->recv_ack);
+            break;
+        }
+        return;
+    case IPPROTO_UDP:
+        if (read_hdr<rte_udp_hdr>(pkt, l4_off)) break;
+        return;
+    default: return;
+    }
+    // Both headers start with the source and the destination ports.
+    static_assert((offsetof(rte_tcp_hdr, src_port) == 0) &&
+                  (offsetof(rte_tcp_hdr, dst_port) == 2) &&
+                  (offsetof(rte_udp_hdr, src_port) == 0) &&
+                  (offsetof(rte_udp_hdr, dst_port) == 2));
+    meta.l4_off = static_cast<uint16_t>(l4_off);
+    ::memcpy(&meta.l4_ports, rte_pktmbuf_mtod_offset(pkt, const char*, l4_off),
+             sizeof(meta.l4_ports));
+}
+
+// Calculates the L4 checksum of the template packet, if any, and prepares
+// its base. The `addrs_sum` is the sum of the words of the addresses which
+// are part of the pseudo header.
+template <typename IpHdr>
+static void
+init_l4_cksum(tx_meta& meta, rte_mbuf* pkt, const IpHdr* ih, uint32_t addrs_sum)
+{
+    constexpr bool is_ipv4     = std::is_same_v<IpHdr, rte_ipv4_hdr>;
+    const auto [proto, l4_off] = l4_hdr_of(pkt, meta.l2_len);
+    uint16_t* l4_cksum         = nullptr;
+    // The ports and the TCP sequence numbers may change per packet as well.
+    uint32_t l4_sum = addrs_sum + sum_words(meta.l4_ports, 0);
+    switch (proto) {
+    case IPPROTO_TCP:
+        if (auto* th = read_hdr<rte_tcp_hdr>(pkt, l4_off); th) {
+            l4_cksum = &th->cksum;
+            l4_sum += sum_words(th->sent_seq, th->recv_ack);
+        }
+        break;
+    case IPPROTO_UDP:
+        if (auto* uh = read_hdr<rte_udp_hdr>(pkt, l4_off);
+            uh && (!is_ipv4 || (uh->dgram_cksum != 0))) {
+            l4_cksum = &uh->dgram_cksum;
+        }
+        break;
+    }
+    if (!l4_cksum) return;
+    *l4_cksum = 0;
+    if constexpr (is_ipv4) {
+        *l4_cksum = rte_ipv4_udptcp_cksum_mbuf(pkt, ih, l4_off);
+    } else {
+        *l4_cksum = rte_ipv6_udptcp_cksum_mbuf(pkt, ih, l4_off);
+    }
+    meta.l4_cksum_off  = static_cast<uint16_t>(
+        reinterpret_cast<const char*>(l4_cksum) -
+        rte_pktmbuf_mtod(pkt, const char*));
+    meta.l4_cksum_base = cksum_base(*l4_cksum, l4_sum);
+}
+
+static tx_meta make_sw_tx_meta(uint16_t l2_len) noexcept
+{
+    return {
+        .ol_flags      = 0,
+        .tx_offload    = 0,
+        .l2_len        = l2_len,
+        .sw_cksum      = true,
+        .l4_cksum_off  = 0,
+        .ip_cksum_base = 0,
+        .l4_cksum_base = 0,
+        .l4_off        = 0,
+        .l4_ports      = 0,
+        .tcp_seq_off   = 0,
+        .tcp_has_ack   = false,
+        .tcp_seq       = 0,
+        .tcp_ack       = 0,
+    };
+}
+
+tx_meta make_ipv4_sw_tx_meta(rte_mbuf* pkt, uint16_t l2_len) noexcept
+{
+    auto* ih = read_hdr<rte_ipv4_hdr>(pkt, l2_len);
+    TG_ASSERT(ih);
+    ih->hdr_checksum = 0;
+    ih->hdr_checksum = rte_ipv4_cksum(ih);
+    const uint32_t addrs_sum = sum_words(ih->src_addr, ih->dst_addr);
+    tx_meta ret              = make_sw_tx_meta(l2_len);
+    ret.ip_cksum_base        = cksum_base(ih->hdr_checksum, addrs_sum);
+    init_l4_tx_meta(ret, pkt);
+    init_l4_cksum(ret, pkt, ih, addrs_sum);
+    return ret;
+}
+
+tx_meta make_ipv6_sw_tx_meta(rte_mbuf* pkt, uint16_t l2_len) noexcept
+{
+    const auto* ih = read_hdr<rte_ipv6_hdr>(pkt, l2_len);
+    TG_ASSERT(ih);
+    ipv6_addrs addrs;
+    static_assert(offsetof(rte_ipv6_hdr, dst_addr) ==
+                  offsetof(rte_ipv6_hdr, src_addr) + sizeof(addrs.src));
+    ::memcpy(&addrs, reinterpret_cast<const char*>(ih) +
+                         offsetof(rte_ipv6_hdr, src_addr),
+             sizeof(addrs));
+    uint32_t addrs_sum = 0;
+    sum_ipv6_addrs(&addrs, 1, &addrs_sum);
+    tx_meta ret = make_sw_tx_meta(l2_len);
+    init_l4_tx_meta(ret, pkt);
+    init_l4_cksum(ret, pkt, ih, addrs_sum);
+    return ret;
+}
+
+// Writes the TCP sequence and acknowledgment numbers of the template changed
+// with the given deltas and returns the sum of their words.
+static uint32_t write_tcp_nums(rte_mbuf* pkt,
+                               const tx_meta& meta,
+                               tcp_seq_deltas deltas) noexcept
+{
+    static_assert(offsetof(rte_tcp_hdr, recv_ack) ==
+                  offsetof(rte_tcp_hdr, sent_seq) + sizeof(uint32_t));
+    const std::array<uint32_t, 2> nums = {
+        ben::native_to_big(meta.tcp_seq + deltas.seq),
+        ben::native_to_big(meta.tcp_has_ack ? (meta.tcp_ack + deltas.ack)
+                                            : meta.tcp_ack),
+    };
+    ::memcpy(rte_pktmbuf_mtod_offset(pkt, char*, meta.tcp_seq_off),
+             nums.data(), sizeof(nums));
+    return sum_words(nums[0], nums[1]);
+}
+
+// Changes the L4 fields of the packet, if requested, and returns the sum of
+// the words of all changeable fields as needed for the software checksum.
+static uint32_t write_l4_fields(rte_mbuf* pkt,
+                                const tx_meta& meta,
+                                const uint32_t* l4_ports,
+                                const tcp_seq_deltas* seq_deltas) noexcept
+{
+    if (meta.l4_off == 0) return 0;
+    uint32_t ret = 0;
+    if (l4_ports) {
+        ::memcpy(rte_pktmbuf_mtod_offset(pkt, char*, meta.l4_off), l4_ports,
+                 sizeof(*l4_ports));
+        ret += sum_words(*l4_ports, 0);
+    } else {
+        ret += sum_words(meta.l4_ports, 0);
+    }
+    if (meta.tcp_seq_off == 0) return ret;
+    if (seq_deltas) {
+        ret += write_tcp_nums(pkt, meta, *seq_deltas);
+    } else {
+        ret += sum_words(ben::native_to_big(meta.tcp_seq),
+                         ben::native_to_big(meta.tcp_ack));
+    }
+    return ret;
+}
+
+// The rewrite is the same for both IP versions except that only the IPv4
+// packets have IP checksum.
+template <typename Addrs>
+static void write_ip_hdrs(std::span<rte_mbuf* const> pkts,
+                          const Addrs* addrs,
+                          const tx_meta* const* metas,
+                          const uint32_t* l4_ports,
+                          const tcp_seq_deltas* seq_deltas) noexcept
+{
+    constexpr bool is_ipv4 = std::is_same_v<Addrs, ipv4_addrs>;
+    using ip_hdr = std::conditional_t<is_ipv4, rte_ipv4_hdr, rte_ipv6_hdr>;
+    constexpr size_t addrs_off = offsetof(ip_hdr, src_addr);
+    static_assert((addrs_off + sizeof(Addrs)) ==
+                  offsetof(ip_hdr, dst_addr) + sizeof(Addrs::dst));
+    // The sums of the addresses are needed only for the software checksums
+    // but it's cheaper to calculate them for all packets than to check.
+    constexpr size_t chunk_size = 64;
+    std::array<uint32_t, chunk_size> sums;
+    for (size_t beg = 0; beg < pkts.size(); beg += chunk_size) {
+        const size_t end = std::min(beg + chunk_size, pkts.size());
+        sum_addrs(addrs + beg, end - beg, sums.data());
+        for (size_t i = beg; i < end; ++i) {
+            rte_mbuf* pkt = pkts[i];
+            if (!pkt) continue;
+            const auto& meta = *metas[i];
+            // Both addresses are written at once. The packets have been
+            // checked upon loading and the header is known to be in the
+            // first segment.
+            char* ih = rte_pktmbuf_mtod_offset(pkt, char*, meta.l2_len);
+            ::memcpy(ih + addrs_off, &addrs[i], sizeof(Addrs));
+            const uint32_t l4_sum =
+                sums[i - beg] +
+                write_l4_fields(pkt, meta, l4_ports ? &l4_ports[i] : nullptr,
+                                seq_deltas ? &seq_deltas[i] : nullptr);
+            if (!meta.sw_cksum) {
+                pkt->ol_flags  |= meta.ol_flags;
+                pkt->tx_offload = meta.tx_offload;
+                continue;
+            }
+            if constexpr (is_ipv4) {
+                const uint16_t ip_cksum =
+                    finish_cksum(meta.ip_cksum_base, sums[i - beg]);
+                ::memcpy(ih + offsetof(rte_ipv4_hdr, hdr_checksum), &ip_cksum,
+                         sizeof(ip_cksum));
+            }
+            if (meta.l4_cksum_off != 0) {
+                const uint16_t l4_cksum =
+                    finish_cksum(meta.l4_cksum_base, l4_sum);
+                ::memcpy(rte_pktmbuf_mtod_offset(pkt, char*, meta.l4_cksum_off),
+                         &l4_cksum, sizeof(l4_cksum));
+            }
+        }
+    }
+}
+
+void write_ipv4_hdrs(std::span<rte_mbuf* const> pkts,
+                     const ipv4_addrs* addrs,
+                     const tx_meta* const* metas,
+                     const uint32_t* l4_ports,
+                     const tcp_seq_deltas* seq_deltas) noexcept
+{
+    write_ip_hdrs(pkts, addrs, metas, l4_ports, seq_deltas);
+}
+
+void write_ipv6_hdrs(std::span<rte_mbuf* const> pkts,
+                     const ipv6_addrs* addrs,
+                     const tx_meta* const* metas,
+                     const uint32_t* l4_ports,
+                     const tcp_seq_deltas* seq_deltas) noexcept
+{
+    write_ip_hdrs(pkts, addrs, metas, l4_ports, seq_deltas);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The MPLS label stack entry with the bottom of stack bit and TTL 64
+static uint32_t mpls_entry(uint32_t label) noexcept
+{
+    return ben::native_to_big((label << 12) | (1u << 8) | 64u);
+}
+
+bool insert_l2_tags(rte_mbuf* pkt, const l2_tags_layout& layout) noexcept
+{
+    const uint16_t len = layout.sw_len();
+    if (len == 0) return true;
+    char* data = rte_pktmbuf_prepend(pkt, len);
+    if (!data) return false;
+    // The Ethernet addresses are moved to the front and the tags are placed
+    // between them and the Ethernet type. The MPLS type replaces the latter.
+    ::memmove(data, data + len, 2 * RTE_ETHER_ADDR_LEN);
+    char* pos = data + (2 * RTE_ETHER_ADDR_LEN);
+    auto put  = [&pos](auto val) {
+        ::memcpy(pos, &val, sizeof(val));
+        pos += sizeof(val);
+    };
+    if (!layout.hw_vlans && (layout.cnt_vlans > 0)) {
+        put(ben::native_to_big<uint16_t>(
+            (layout.cnt_vlans == 2) ? RTE_ETHER_TYPE_QINQ
+                                    : RTE_ETHER_TYPE_VLAN));
+        put(uint16_t(0));
+        if (layout.cnt_vlans == 2) {
+            put(ben::native_to_big<uint16_t>(RTE_ETHER_TYPE_VLAN));
+            put(uint16_t(0));
+        }
+    }
+    if (layout.mpls) {
+        put(ben::native_to_big<uint16_t>(RTE_ETHER_TYPE_MPLS));
+        put(mpls_entry(0));
+    }
+    return true;
+}
+
+void write_l2_tags(std::span<rte_mbuf* const> pkts,
+                   const l2_tags* tags,
+                   const l2_tags_layout& layout) noexcept
+{
+    // The tags are at the same offsets in all packets. Only the tag values,
+    // i.e. the VLAN TCIs and the MPLS entry, are written per packet.
+    // Every tag value follows its 16 bit type.
+    constexpr size_t vlan_len = sizeof(rte_vlan_hdr);
+    constexpr size_t tci_off  = (2 * RTE_ETHER_ADDR_LEN) + sizeof(uint16_t);
+    const size_t cnt_sw_vlans = layout.hw_vlans ? 0 : layout.cnt_vlans;
+    const size_t mpls_off     = tci_off + (cnt_sw_vlans * vlan_len);
+    uint64_t hw_flags         = 0;
+    if (layout.hw_vlans && (layout.cnt_vlans > 0)) {
+        hw_flags = (layout.cnt_vlans == 2)
+                       ? (RTE_MBUF_F_TX_VLAN | RTE_MBUF_F_TX_QINQ)
+                       : RTE_MBUF_F_TX_VLAN;
+    }
+    for (size_t i = 0; i < pkts.size(); ++i) {
+        rte_mbuf* pkt = pkts[i];
+        if (!pkt) continue;
+        const auto& tg = tags[i];
+        char* data     = rte_pktmbuf_mtod(pkt, char*);
+        for (size_t v = 0; v < cnt_sw_vlans; ++v) {
+            const uint16_t tci = ben::native_to_big(tg.vlans[v]);
+            ::memcpy(data + tci_off + (v * vlan_len), &tci, sizeof(tci));
+        }
+        if (layout.mpls) {
+            const uint32_t entry = mpls_entry(tg.mpls_label);
+            ::memcpy(data + mpls_off, &entry, sizeof(entry));
+        }
+        if (hw_flags != 0) {
+            // The single VLAN tag and the inner tag of QinQ go in `vlan_tci`.
+            pkt->ol_flags |= hw_flags;
+            pkt->vlan_tci  = tg.vlans[layout.cnt_vlans - 1];
+            if (layout.cnt_vlans == 2) pkt->vlan_tci_outer = tg.vlans[0];
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+// The offset of the tunnel id from the outer IP header
+static size_t tunnel_id_off(tunnel_type type) noexcept
+{
+    constexpr size_t ip_len = sizeof(rte_ipv4_hdr);
+    switch (type) {
+    case tunnel_type::none: break;
+    case tunnel_type::vxlan:
+        return ip_len + sizeof(rte_udp_hdr) + offsetof(rte_vxlan_hdr, vx_vni);
+    case tunnel_type::gre: return ip_len + sizeof(rte_gre_hdr);
+    case tunnel_type::gtpu:
+        return ip_len + sizeof(rte_udp_hdr) + offsetof(rte_gtp_hdr, teid);
+    }
+    TG_UNREACHABLE();
+}
+
+// The VNI takes the upper 24 bits of its 32 bit word
+static uint32_t tunnel_id_val(tunnel_type type, uint32_t id) noexcept
+{
+    return ben::native_to_big((type == tunnel_type::vxlan) ? (id << 8) : id);
+}
+
+tx_meta make_tunnel_hw_tx_meta(uint64_t ol_flags,
+                               const tunnel_layout& layout,
+                               uint16_t l3_len) noexcept
+{
+    uint64_t tunnel_flag = 0;
+    switch (layout.type) {
+    case tunnel_type::none: break;
+    case tunnel_type::vxlan: tunnel_flag = RTE_MBUF_F_TX_TUNNEL_VXLAN; break;
+    case tunnel_type::gre: tunnel_flag = RTE_MBUF_F_TX_TUNNEL_GRE; break;
+    case tunnel_type::gtpu: tunnel_flag = RTE_MBUF_F_TX_TUNNEL_GTP; break;
+    }
+    // The inner L2 length of a tunneled packet covers the outer UDP/GRE
+    // header, the tunnel header and the inner Ethernet header, if any.
+    // The `l2_len` of the meta is still the offset of the inner IP header.
+    constexpr uint16_t outer_l3_len = sizeof(rte_ipv4_hdr);
+    const uint64_t flags = ol_flags | tunnel_flag | RTE_MBUF_F_TX_OUTER_IPV4 |
+                           RTE_MBUF_F_TX_OUTER_IP_CKSUM;
+    const auto l2_len =
+        static_cast<uint16_t>(layout.outer_l2_len + layout.hdrs_len());
+    tx_meta ret    = make_hw_tx_meta(flags, l2_len, l3_len);
+    ret.tx_offload = rte_mbuf_tx_offload(layout.hdrs_len() - outer_l3_len,
+                                         l3_len, 0, 0, outer_l3_len,
+                                         layout.outer_l2_len, 0);
+    return ret;
+}
+
+bool insert_tunnel_hdrs(rte_mbuf* pkt, const tunnel_layout& layout) noexcept
+{
+    const uint16_t len = layout.hdrs_len();
+    if (len == 0) return true;
+    char* data = rte_pktmbuf_prepend(pkt, len);
+    if (!data) return false;
+    // The Ethernet header becomes the outer one. The VXLAN packets keep it as
+    // inner one as well.
+    uint16_t inner_type;
+    ::memcpy(&inner_type, data + len + (2 * RTE_ETHER_ADDR_LEN),
+             sizeof(inner_type));
+    ::memmove(data, data + len, RTE_ETHER_HDR_LEN);
+    const uint16_t ether_type = ben::native_to_big<uint16_t>(
+        RTE_ETHER_TYPE_IPV4);
+    ::memcpy(data + (2 * RTE_ETHER_ADDR_LEN), &ether_type, sizeof(ether_type));
+    char* pos = data + RTE_ETHER_HDR_LEN;
+    auto put  = [&pos](auto val) {
+        ::memcpy(pos, &val, sizeof(val));
+        pos += sizeof(val);
+    };
+    const size_t ip_len = rte_pktmbuf_pkt_len(pkt) - RTE_ETHER_HDR_LEN;
+    rte_ipv4_hdr ih     = {};
+    ih.version_ihl      = RTE_IPV4_VHL_DEF;
+    ih.total_length     = ben::native_to_big(static_cast<uint16_t>(ip_len));
+    ih.time_to_live     = 64;
+    ih.next_proto_id    = (layout.type == tunnel_type::gre) ? IPPROTO_GRE
+                                                            : IPPROTO_UDP;
+    put(ih);
+    auto put_udp = [&](uint16_t port) {
+        const auto udp_len = ip_len - sizeof(rte_ipv4_hdr);
+        put(rte_udp_hdr{
+            .src_port    = ben::native_to_big(port),
+            .dst_port    = ben::native_to_big(port),
+            .dgram_len   = ben::native_to_big(static_cast<uint16_t>(udp_len)),
+            .dgram_cksum = 0,
+        });
+    };
+    switch (layout.type) {
+    case tunnel_type::none: break;
+    case tunnel_type::vxlan:
+        put_udp(RTE_VXLAN_DEFAULT_PORT);
+        put(ben::native_to_big(0x0800'0000u)); // the VNI is valid
+        put(uint32_t(0));
+        break;
+    case tunnel_type::gre:
+        put(ben::native_to_big<uint16_t>(0x2000)); // the key is present
+        put(inner_type);
+        put(uint32_t(0));
+        break;
+    case tunnel_type::gtpu: {
+        // The length of a G-PDU excludes the mandatory GTP header.
+        const auto gtp_len = ip_len - len;
+        put_udp(RTE_GTPU_UDP_PORT);
+        put(uint8_t(0x30)); // version 1, GTP
+        put(uint8_t(0xFF)); // G-PDU
+        put(ben::native_to_big(static_cast<uint16_t>(gtp_len)));
+        put(uint32_t(0));
+        break;
+    }
+    }
+    return true;
+}
+
+void write_tunnel_hdrs(std::span<rte_mbuf* const> pkts,
+                       const ipv4_addrs* addrs,
+                       const uint32_t* ids,
+                       const tunnel_layout& layout) noexcept
+{
+    // The outer headers are at the same offsets in all packets. The outer IP
+    // header is only 20 bytes and its checksum is calculated from scratch
+    // instead of keeping a base for every template packet.
+    constexpr size_t addrs_off = offsetof(rte_ipv4_hdr, src_addr);
+    const size_t id_off        = tunnel_id_off(layout.type);
+    for (size_t i = 0; i < pkts.size(); ++i) {
+        rte_mbuf* pkt = pkts[i];
+        if (!pkt) continue;
+        char* ih = rte_pktmbuf_mtod_offset(pkt, char*, layout.outer_l2_len);
+        ::memcpy(ih + addrs_off, &addrs[i], sizeof(addrs[i]));
+        const uint32_t id = tunnel_id_val(layout.type, ids[i]);
+        ::memcpy(ih + id_off, &id, sizeof(id));
+        if (layout.hw_cksum) continue;
+        auto* hdr         = reinterpret_cast<rte_ipv4_hdr*>(ih);
+        hdr->hdr_checksum = 0;
+        hdr->hdr_checksum = rte_ipv4_cksum(hdr);
+    }
+}
+
+} // namespace put
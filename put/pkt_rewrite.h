@@ -0,0 +1,253 @@
+#pragma once
+
+#include "put/num_utils.h"
+
+namespace put
+{
+
+// The source and destination addresses as they are placed in the IPv4 header
+// i.e. one after another and in network byte order.
+struct ipv4_addrs
+{
+    uint32_t src;
+    uint32_t dst;
+};
+static_assert(sizeof(ipv4_addrs) == 8);
+
+// The same for the IPv6 header
+struct ipv6_addrs
+{
+    in6_addr src;
+    in6_addr dst;
+};
+static_assert(sizeof(ipv6_addrs) == 32);
+
+// The offload setup of a packet. It's the same for all copies of the packet
+// and thus it's prepared once, upon loading.
+// The checksums are either calculated by the NIC, as requested by the offload
+// flags, or they are updated in software. The software update is incremental,
+// as described in RFC 1624, because only the addresses change relative to the
+// template packet. The checksum bases are the one's complement sums of the
+// template header words without the addresses. The IPv6 packets have only
+// L4 checksum.
+// The ports of the template are kept as they are stored in the packet. The
+// TCP sequence and acknowledgment numbers of the template are in host byte
+// order and the acknowledgment number is changed only if the ACK flag is set.
+struct tx_meta
+{
+    uint64_t ol_flags;
+    uint64_t tx_offload; // the l2_len, l3_len, etc. as stored in the mbuf
+    uint16_t l2_len;
+    bool sw_cksum;
+    uint16_t l4_cksum_off; // from the packet start, 0 - no L4 checksum
+    uint16_t ip_cksum_base;
+    uint16_t l4_cksum_base;
+    uint16_t l4_off; // from the packet start, 0 - not a TCP/UDP packet
+    uint32_t l4_ports;
+    uint16_t tcp_seq_off; // from the packet start, 0 - not a TCP packet
+    bool tcp_has_ack;
+    uint32_t tcp_seq;
+    uint32_t tcp_ack;
+};
+
+// The kinds of the VLAN and MPLS tags of the packets of a capture. The tags are
+// placed right after the Ethernet addresses. The outer VLAN tag is an 802.1ad
+// service tag if there are two VLAN tags. The MPLS label is the only entry of
+// the label stack and it follows the VLAN tags. The VLAN tags may be inserted
+// by the NIC and then only the MPLS label, if any, is in the packet data.
+struct l2_tags_layout
+{
+    uint8_t cnt_vlans; // 0, 1 or 2
+    bool hw_vlans;     // the VLAN tags are inserted by the NIC
+    bool mpls;
+
+    // The length of the tags in the packet data
+    uint16_t sw_len() const noexcept
+    {
+        return static_cast<uint16_t>(
+            (hw_vlans ? 0 : (cnt_vlans * sizeof(rte_vlan_hdr))) +
+            (mpls ? sizeof(uint32_t) : 0));
+    }
+    bool empty() const noexcept { return (cnt_vlans == 0) && !mpls; }
+};
+// The max length of the tags in the packet data
+inline constexpr uint16_t max_l2_tags_len = 3 * sizeof(uint32_t);
+
+// The values of the tags of a packet. The VLAN tags have only VLAN ID, with
+// priority 0, and the outer one is first.
+struct l2_tags
+{
+    std::array<uint16_t, 2> vlans;
+    uint32_t mpls_label;
+};
+
+// The tunnel, if any, in which the packets of a capture are encapsulated.
+// The outer IPv4 header follows the outer Ethernet header and the L2 tags, if
+// any. The VXLAN packets keep their inner Ethernet header while the GRE and
+// the GTP-U ones carry the inner IP packet right after the tunnel header. The
+// GRE header has only a key, which is the tunnel id. The outer UDP checksum is
+// 0 as allowed for IPv4.
+enum class tunnel_type : uint8_t
+{
+    none,
+    vxlan,
+    gre,
+    gtpu,
+};
+
+struct tunnel_layout
+{
+    tunnel_type type;
+    uint16_t outer_l2_len; // the outer Ethernet header and the L2 tags
+    bool hw_cksum;         // the outer IP checksum is calculated by the NIC
+
+    // The length of the outer IP, UDP/GRE and tunnel headers and of the inner
+    // Ethernet header, if any, i.e. of the headers inserted in the packets.
+    uint16_t hdrs_len() const noexcept
+    {
+        constexpr size_t ip_len = sizeof(rte_ipv4_hdr);
+        switch (type) {
+        case tunnel_type::none: return 0;
+        case tunnel_type::vxlan:
+            return ip_len + sizeof(rte_udp_hdr) + sizeof(rte_vxlan_hdr) +
+                   RTE_ETHER_HDR_LEN;
+        case tunnel_type::gre:
+            return ip_len + sizeof(rte_gre_hdr) + sizeof(uint32_t);
+        case tunnel_type::gtpu:
+            return ip_len + sizeof(rte_udp_hdr) + sizeof(rte_gtp_hdr);
+        }
+        return 0;
+    }
+    bool empty() const noexcept { return type == tunnel_type::none; }
+};
+// The max length of the inserted tunnel headers
+inline constexpr uint16_t max_tunnel_hdrs_len =
+    sizeof(rte_ipv4_hdr) + sizeof(rte_udp_hdr) + sizeof(rte_vxlan_hdr) +
+    RTE_ETHER_HDR_LEN;
+
+// The values added to the TCP sequence and acknowledgment numbers of a packet
+struct tcp_seq_deltas
+{
+    uint32_t seq;
+    uint32_t ack;
+};
+
+// The offload setup for the checksums calculated by the NIC. It works for
+// both IP versions and the offload flags define the version.
+inline tx_meta make_hw_tx_meta(uint64_t ol_flags,
+                               uint16_t l2_len,
+                               uint16_t l3_len) noexcept
+{
+    return {
+        .ol_flags      = ol_flags,
+        .tx_offload    = rte_mbuf_tx_offload(l2_len, l3_len, 0, 0, 0, 0, 0),
+        .l2_len        = l2_len,
+        .sw_cksum      = false,
+        .l4_cksum_off  = 0,
+        .ip_cksum_base = 0,
+        .l4_cksum_base = 0,
+        .l4_off        = 0,
+        .l4_ports      = 0,
+        .tcp_seq_off   = 0,
+        .tcp_has_ack   = false,
+        .tcp_seq       = 0,
+        .tcp_ack       = 0,
+    };
+}
+
+// The same as above but for the tunneled packets. The flags are for the inner
+// packet and the outer ones are added here.
+tx_meta make_tunnel_hw_tx_meta(uint64_t ol_flags,
+                               const tunnel_layout&,
+                               uint16_t l3_len) noexcept;
+
+// Prepares the change of the ports and of the TCP sequence and acknowledgment
+// numbers if the packet is a TCP/UDP one. The TCP/UDP header must be in the
+// first segment. The IPv6 packets are TCP/UDP ones only if the TCP/UDP header
+// follows the IPv6 header, without extension headers in between.
+void init_l4_tx_meta(tx_meta&, const rte_mbuf* pkt) noexcept;
+
+// Calculates the checksums of the template packet, stores them in it and
+// prepares the bases for the incremental updates. The IP header and the
+// TCP/UDP header, if any, must be in the first segment. The IPv4 UDP packets
+// without checksum are left without one. The checksum is mandatory for the
+// IPv6 UDP packets and it's always calculated for them.
+tx_meta make_ipv4_sw_tx_meta(rte_mbuf* pkt, uint16_t l2_len) noexcept;
+tx_meta make_ipv6_sw_tx_meta(rte_mbuf* pkt, uint16_t l2_len) noexcept;
+
+// Inserts the tunnel headers, with zero addresses and tunnel id, in the
+// template packet right after its Ethernet header. The lengths in them are set
+// for the packet. Must be called before the insertion of the tags. Returns
+// false if there is no headroom for them.
+bool insert_tunnel_hdrs(rte_mbuf* pkt, const tunnel_layout&) noexcept;
+
+// Inserts the tags, with zero values, in the template packet right after its
+// Ethernet addresses. Returns false if there is no headroom for them.
+bool insert_l2_tags(rte_mbuf* pkt, const l2_tags_layout&) noexcept;
+
+// The per packet rewrite of the headers is done for a whole batch of packets
+// in two passes. The first one works only on the addresses and it's
+// vectorized with AVX2 or SSE4.2, if available at compile time. The second
+// one writes the results to the packets and it's a sequence of plain stores
+// because the packets are spread in the memory.
+
+// Chooses the source and the destination address of every packet depending on
+// its direction and converts them to network byte order. The input addresses
+// are in host byte order and `from_cln[i]` is 1 if the packet `i` goes from
+// the client to the server and 0 otherwise.
+void select_ipv4_addrs(std::span<ipv4_addrs> out,
+                       const uint32_t* cln_addrs,
+                       const uint32_t* srv_addrs,
+                       const uint8_t* from_cln) noexcept;
+
+// The same as above but for IPv6 addresses. The input addresses are 128 bit
+// numbers in host byte order. Every address pair is handled in a single
+// 256 bit register with AVX2 or in two 128 bit registers with SSE4.2.
+void select_ipv6_addrs(std::span<ipv6_addrs> out,
+                       const uint128* cln_addrs,
+                       const uint128* srv_addrs,
+                       const uint8_t* from_cln) noexcept;
+
+// Chooses the source and the destination port of every packet depending on
+// its direction and converts them to network byte order. Every input value
+// has the client port in its high 16 bits and the server port in its low 16
+// bits, in host byte order. Every output value is the pair of ports as it's
+// stored at the beginning of the TCP/UDP header.
+void select_l4_ports(std::span<uint32_t> out,
+                     const uint32_t* ports,
+                     const uint8_t* from_cln) noexcept;
+
+// Writes the addresses to the IPv4 header of every packet and sets the offload
+// setup of the packet or updates its checksums. The IPv4 header must be in the
+// first segment right after the L2 header. The null packets are skipped.
+// The ports of the TCP/UDP packets are changed with the given ones, if any,
+// and the TCP sequence and acknowledgment numbers are changed with the given
+// deltas, if any.
+void write_ipv4_hdrs(std::span<rte_mbuf* const> pkts,
+                     const ipv4_addrs* addrs,
+                     const tx_meta* const* metas,
+                     const uint32_t* l4_ports = nullptr,
+                     const tcp_seq_deltas* seq_deltas = nullptr) noexcept;
+// The same as above but for the IPv6 header
+void write_ipv6_hdrs(std::span<rte_mbuf* const> pkts,
+                     const ipv6_addrs* addrs,
+                     const tx_meta* const* metas,
+                     const uint32_t* l4_ports = nullptr,
+                     const tcp_seq_deltas* seq_deltas = nullptr) noexcept;
+
+// Writes the tag values of every packet. The values of the VLAN tags inserted
+// by the NIC are set in the mbuf fields. The null packets are skipped.
+void write_l2_tags(std::span<rte_mbuf* const> pkts,
+                   const l2_tags* tags,
+                   const l2_tags_layout&) noexcept;
+
+// Writes the outer addresses and the tunnel id of every packet and updates
+// the outer IP checksum, unless it's calculated by the NIC. The outer
+// addresses are in network byte order and the ids are in host byte order.
+// The null packets are skipped.
+void write_tunnel_hdrs(std::span<rte_mbuf* const> pkts,
+                       const ipv4_addrs* addrs,
+                       const uint32_t* ids,
+                       const tunnel_layout&) noexcept;
+
+} // namespace put
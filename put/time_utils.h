@@ -5,7 +5,8 @@ namespace put
 // The functionality here:
 // - allows easy switching between rte_get_tsc_cycles/rte_get_tsc_hz and
 // rte_get_timer_cycles/rte_get_timer_hz. Currently the functionality uses the
-// latter pair of functions because the DPDK `rte_timer` functionality uses them
+// latter pair of functions because the DPDK `rte_timer` functionality, used as
+// a reference in the benchmarks, uses them
 // - strong typing is always better than a weak one
 // - provides conversion functions between the std::chrono duration types and
 // the `cycles` type.
@@ -28,9 +29,14 @@ struct cycles
     {
         return {(dur.count() * frequency_hz()) / 1'000'000ul};
     }
+    // The whole seconds are converted separately so that the durations of
+    // more than a few seconds don't overflow.
     static cycles from_duration(stdcr::nanoseconds dur) noexcept
     {
-        return {(dur.count() * frequency_hz()) / 1'000'000'000ul};
+        const uint64_t secs = dur.count() / 1'000'000'000ul;
+        const uint64_t nsec = dur.count() % 1'000'000'000ul;
+        return {(secs * frequency_hz()) +
+                ((nsec * frequency_hz()) / 1'000'000'000ul)};
     }
 
     template <typename Dur>